@@ -146,9 +146,12 @@ void AppWindow::SetVisible(BOOL visible)
 
 void AppWindow::Render()
 {
-	Colour *pBuffer = m_pRenderer->GetFramebuffer()->GetBuffer();
+	m_pScene->UpdateAccelerationStructure();
 	m_pRenderer->DoTrace(m_pScene);
 
+	//compact framebuffer formats are converted by GetBuffer, so fetch it after the trace
+	Colour *pBuffer = m_pRenderer->GetFramebuffer()->GetBuffer();
+
 	glDrawPixels(m_width, m_height, GL_RGBA, GL_FLOAT, pBuffer);
 	glFlush();
 
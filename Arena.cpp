@@ -0,0 +1,65 @@
+#include <immintrin.h>
+#include "Arena.h"
+
+Arena::Arena(size_t blockSize)
+{
+	m_blockSize = blockSize > ALIGNMENT ? blockSize : ALIGNMENT;
+}
+
+Arena::~Arena()
+{
+	Release();
+}
+
+void* Arena::Allocate(size_t size, size_t alignment)
+{
+	alignment = alignment > ALIGNMENT ? alignment : ALIGNMENT;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (!m_blocks.empty())
+	{
+		Block& block = m_blocks.back();
+		size_t start = (block.used + alignment - 1) & ~(alignment - 1);
+
+		if (start + size <= block.size)
+		{
+			block.used = start + size;
+			return block.data + start;
+		}
+	}
+
+	//a big allocation goes in a block of its own, slotted in before the block being filled
+	//so the space left in that is not lost
+	bool own = size > m_blockSize / 4;
+	Block block = { (char*)_mm_malloc(own ? size : m_blockSize, alignment), own ? size : m_blockSize, size };
+
+	if (!block.data)
+		throw std::bad_alloc();
+
+	if (own && !m_blocks.empty())
+		m_blocks.insert(m_blocks.end() - 1, block);
+	else
+		m_blocks.push_back(block);
+
+	return block.data;
+}
+
+void Arena::Release()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for (size_t i = m_destructors.size(); i > 0; i--)
+	{
+		const Destructor& destructor = m_destructors[i - 1];
+		destructor.destroy(destructor.objects, destructor.count);
+	}
+
+	for (size_t i = 0; i < m_blocks.size(); i++)
+	{
+		_mm_free(m_blocks[i].data);
+	}
+
+	m_destructors.clear();
+	m_blocks.clear();
+}
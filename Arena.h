@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+#include <mutex>
+#include <utility>
+#include <type_traits>
+
+//Bump allocator for objects that live and die together, e.g. the contents of a scene.
+//Objects are placed one after another in large blocks, each starting on a 64 byte
+//boundary so SIMD data and cache lines line up, and nothing is freed on its own.
+//Release runs the destructors of the objects that have one, newest first, and frees
+//every block in one go. Allocation is safe from several threads at once
+class Arena
+{
+	public:
+		enum
+		{
+			ALIGNMENT = 64
+		};
+
+	private:
+		struct Block
+		{
+			char*	data;
+			size_t	size;
+			size_t	used;
+		};
+
+		struct Destructor
+		{
+			void	(*destroy)(void* objects, size_t count);
+			void*	objects;
+			size_t	count;
+		};
+
+		std::vector<Block>		m_blocks;			//the last block is the one being filled
+		std::vector<Destructor>	m_destructors;
+		size_t					m_blockSize;
+		std::mutex				m_mutex;
+
+		template <class T>
+		static void Destroy(void* objects, size_t count)
+		{
+			for (size_t i = count; i > 0; i--)
+			{
+				((T*)objects)[i - 1].~T();
+			}
+		}
+
+		template <class T>
+		void AddDestructor(T* objects, size_t count)
+		{
+			if (!std::is_trivially_destructible<T>::value)
+			{
+				Destructor destructor = { &Destroy<T>, objects, count };
+
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_destructors.push_back(destructor);
+			}
+		}
+
+		Arena(const Arena&);
+		Arena& operator=(const Arena&);
+
+	public:
+		Arena(size_t blockSize = 1 << 20);
+		~Arena();
+
+		//Uninitialised memory aligned to ALIGNMENT, or more if alignment asks for it. Allocations
+		//bigger than a quarter of a block get a block of their own rather than waste the rest of one
+		void* Allocate(size_t size, size_t alignment = ALIGNMENT);
+
+		//Construct an object in the arena, it is destroyed by Release
+		template <class T, class... Args>
+		T* New(Args&&... args)
+		{
+			T* object = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+			AddDestructor(object, 1);
+			return object;
+		}
+
+		//Default construct count objects side by side, they are destroyed by Release
+		template <class T>
+		T* NewArray(size_t count)
+		{
+			T* objects = (T*)Allocate(sizeof(T) * (count > 0 ? count : 1), alignof(T));
+
+			for (size_t i = 0; i < count; i++)
+			{
+				new (&objects[i]) T();
+			}
+
+			AddDestructor(objects, count);
+			return objects;
+		}
+
+		//Destroy every object and free every block, the arena can be used again afterwards
+		void Release();
+};
@@ -0,0 +1,53 @@
+#include "AssetLoader.h"
+#include "TriMesh.h"
+#include "Material.h"
+#include "Profiler.h"
+
+AssetLoader::AssetLoader(int numThreads) : m_pool(numThreads)
+{
+	m_pendingMeshes = 0;
+}
+
+AssetLoader::~AssetLoader()
+{
+	m_pool.Wait();
+}
+
+void AssetLoader::LoadMesh(TriMesh* mesh, const std::string& filename)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_pendingMeshes++;
+	}
+
+	m_pool.Submit([this, mesh, filename]()
+	{
+		mesh->LoadTriMeshFromOBJFile(filename.c_str());
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (--m_pendingMeshes == 0)
+			m_meshesLoaded.notify_all();
+	});
+}
+
+void AssetLoader::PrefetchTexture(Texture* texture)
+{
+	m_pool.Submit([texture]() { texture->Load(); });
+}
+
+void AssetLoader::WaitForMeshes()
+{
+	PROFILE_SCOPE("WaitForMeshes");
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (m_pendingMeshes > 0)
+	{
+		m_meshesLoaded.wait(lock);
+	}
+}
+
+void AssetLoader::Wait()
+{
+	m_pool.Wait();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include "ThreadPool.h"
+
+class TriMesh;
+class Texture;
+
+//Loads scene assets in parallel on a pool of threads, so that loading a
+//scene takes about as long as its slowest asset rather than the sum of all
+class AssetLoader
+{
+	private:
+		ThreadPool				m_pool;
+		std::mutex				m_mutex;
+		std::condition_variable	m_meshesLoaded;
+		int						m_pendingMeshes;
+
+	public:
+		//numThreads of 0 uses one thread per hardware thread
+		AssetLoader(int numThreads = 0);
+		~AssetLoader();
+
+		//Queue reading an OBJ file into the mesh and building its BVH, the mesh
+		//must not be used until WaitForMeshes has returned
+		void	LoadMesh(TriMesh* mesh, const std::string& filename);
+
+		//Queue loading a deferred texture ahead of its first use. Rendering can
+		//start before this finishes, the first sample then waits for the load
+		void	PrefetchTexture(Texture* texture);
+
+		//Block until the meshes queued so far have loaded, textures may still be loading
+		void	WaitForMeshes();
+
+		//Block until everything queued so far has loaded
+		void	Wait();
+};
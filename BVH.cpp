@@ -0,0 +1,335 @@
+#include <algorithm>
+#include "BVH.h"
+#include "Profiler.h"
+
+BVH::BVH()
+{
+	m_areaSum = 0.0f;
+	m_buildCost = 0.0f;
+}
+
+BVH::~BVH()
+{
+}
+
+void BVH::Clear()
+{
+	m_nodes.clear();
+	m_refs.clear();
+	m_refSlots.clear();
+	m_slotLeaves.clear();
+	m_heights.clear();
+	m_areaSum = 0.0f;
+	m_buildCost = 0.0f;
+}
+
+void BVH::Build(const std::vector<PrimRef>& refs, const std::vector<BoundingBox>& bounds)
+{
+	Clear();
+
+	int numrefs = (int)refs.size();
+
+	if (numrefs == 0)
+		return;
+
+	PROFILE_SCOPE_ARG("BuildBVH", numrefs);
+
+	std::vector<Vector3> centroids(numrefs);
+	std::vector<int> order(numrefs);
+
+	for (int i = 0; i < numrefs; i++)
+	{
+		centroids[i] = bounds[i].GetCentre();
+		order[i] = i;
+	}
+
+	m_nodes.reserve(numrefs * 2);
+	m_heights.reserve(numrefs * 2);
+
+	BuildRecursive(-1, 0, numrefs, 0, bounds, centroids, order);
+
+	//store the references in leaf order so that each leaf is a contiguous run
+	m_refs.resize(numrefs);
+	for (int i = 0; i < numrefs; i++)
+	{
+		m_refs[i] = refs[order[i]];
+	}
+
+	m_refSlots = order;
+	m_slotLeaves.resize(numrefs);
+
+	for (int i = 0; i < (int)m_nodes.size(); i++)
+	{
+		const BVHNode& node = m_nodes[i];
+		float weight = node.count > 0 ? (float)node.count : 1.0f;
+
+		m_areaSum += weight * node.bounds.GetSurfaceArea();
+
+		for (int j = 0; j < node.count; j++)
+		{
+			m_slotLeaves[m_refSlots[node.left + j]] = i;
+		}
+	}
+
+	m_buildCost = GetSAHCost();
+}
+
+float BVH::GetSAHCost() const
+{
+	if (m_nodes.empty())
+		return 0.0f;
+
+	float rootarea = m_nodes[0].bounds.GetSurfaceArea();
+
+	return rootarea > 0.0f ? m_areaSum / rootarea : 0.0f;
+}
+
+void BVH::SetNodeBounds(int nodeindex, const BoundingBox& bounds)
+{
+	BVHNode& node = m_nodes[nodeindex];
+	float weight = node.count > 0 ? (float)node.count : 1.0f;
+
+	m_areaSum += weight * (bounds.GetSurfaceArea() - node.bounds.GetSurfaceArea());
+	node.bounds = bounds;
+}
+
+static inline bool SameBounds(const BoundingBox& a, const BoundingBox& b)
+{
+	Vec4 eq = _mm_and_ps(_mm_cmpeq_ps(a.m_min.GetVec4(), b.m_min.GetVec4()), _mm_cmpeq_ps(a.m_max.GetVec4(), b.m_max.GetVec4()));
+	return (_mm_movemask_ps(eq) & 0x7) == 0x7;
+}
+
+void BVH::Refit(const std::vector<int>& dirtySlots, const std::vector<BoundingBox>& bounds)
+{
+	for (size_t i = 0; i < dirtySlots.size(); i++)
+	{
+		int nodeindex = m_slotLeaves[dirtySlots[i]];
+		const BVHNode& leaf = m_nodes[nodeindex];
+
+		BoundingBox leafbounds;
+		for (int j = 0; j < leaf.count; j++)
+		{
+			leafbounds.Expand(bounds[m_refSlots[leaf.left + j]]);
+		}
+
+		SetNodeBounds(nodeindex, leafbounds);
+		nodeindex = leaf.parent;
+
+		//walk up until an ancestor is left unchanged, everything above it is unchanged too
+		while (nodeindex >= 0)
+		{
+			Rotate(nodeindex);
+
+			BVHNode& node = m_nodes[nodeindex];
+			BoundingBox nodebounds = m_nodes[node.left].bounds;
+			nodebounds.Expand(m_nodes[node.right].bounds);
+
+			int height = 1 + std::max(m_heights[node.left], m_heights[node.right]);
+
+			if (SameBounds(nodebounds, node.bounds) && height == m_heights[nodeindex])
+				break;
+
+			SetNodeBounds(nodeindex, nodebounds);
+			m_heights[nodeindex] = height;
+			nodeindex = node.parent;
+		}
+	}
+}
+
+void BVH::Rotate(int nodeindex)
+{
+	//try swapping one child with a grandchild under the other child (Kensler 2008),
+	//that only changes the bounds of the other child, so keep the swap that shrinks it most
+	BVHNode& node = m_nodes[nodeindex];
+	int children[2] = { node.left, node.right };
+
+	float bestsaving = 0.0f;
+	int bestchild = -1;
+	int bestgrandchild = -1;
+	int bestheight = 0;
+	BoundingBox bestbounds;
+
+	for (int c = 0; c < 2; c++)
+	{
+		int moved = children[c];
+		int other = children[1 - c];
+
+		if (m_nodes[other].count > 0)
+			continue;
+
+		int grandchildren[2] = { m_nodes[other].left, m_nodes[other].right };
+		float otherarea = m_nodes[other].bounds.GetSurfaceArea();
+
+		for (int g = 0; g < 2; g++)
+		{
+			int kept = grandchildren[1 - g];
+
+			//rotations are never allowed to deepen the tree so traversal stays within MAX_DEPTH
+			int otherheight = 1 + std::max(m_heights[moved], m_heights[kept]);
+			int nodeheight = 1 + std::max(m_heights[grandchildren[g]], otherheight);
+
+			if (nodeheight > m_heights[nodeindex])
+				continue;
+
+			BoundingBox newbounds = m_nodes[moved].bounds;
+			newbounds.Expand(m_nodes[kept].bounds);
+
+			float saving = otherarea - newbounds.GetSurfaceArea();
+
+			if (saving > bestsaving)
+			{
+				bestsaving = saving;
+				bestchild = c;
+				bestgrandchild = g;
+				bestheight = otherheight;
+				bestbounds = newbounds;
+			}
+		}
+	}
+
+	if (bestchild < 0)
+		return;
+
+	int moved = children[bestchild];
+	int other = children[1 - bestchild];
+	int promoted = bestgrandchild == 0 ? m_nodes[other].left : m_nodes[other].right;
+
+	if (bestchild == 0)
+		node.left = promoted;
+	else
+		node.right = promoted;
+
+	if (bestgrandchild == 0)
+		m_nodes[other].left = moved;
+	else
+		m_nodes[other].right = moved;
+
+	m_nodes[promoted].parent = nodeindex;
+	m_nodes[moved].parent = other;
+
+	SetNodeBounds(other, bestbounds);
+	m_heights[other] = bestheight;
+}
+
+int BVH::BuildRecursive(int parent, int first, int count, int depth,
+	const std::vector<BoundingBox>& bounds, std::vector<Vector3>& centroids, std::vector<int>& order)
+{
+	int nodeindex = (int)m_nodes.size();
+	m_nodes.push_back(BVHNode());
+	m_heights.push_back(0);
+
+	BoundingBox nodebounds;
+	BoundingBox centroidbounds;
+
+	for (int i = first; i < first + count; i++)
+	{
+		nodebounds.Expand(bounds[order[i]]);
+		centroidbounds.Expand(centroids[order[i]]);
+	}
+
+	m_nodes[nodeindex].bounds = nodebounds;
+	m_nodes[nodeindex].parent = parent;
+	m_nodes[nodeindex].left = first;
+	m_nodes[nodeindex].right = -1;
+	m_nodes[nodeindex].count = count;
+
+	//split along the axis with the largest centroid extent
+	Vector3 extent = centroidbounds.GetExtent();
+	int axis = 0;
+	if (extent[1] > extent[axis]) axis = 1;
+	if (extent[2] > extent[axis]) axis = 2;
+
+	if (count <= 1 || depth >= MAX_DEPTH || extent[axis] <= 0.0f)
+		return nodeindex;
+
+	//bin the centroids and evaluate the SAH cost of splitting between each pair of bins
+	int bincount[NUM_BINS] = { 0 };
+	BoundingBox binbounds[NUM_BINS];
+
+	float cmin = centroidbounds.m_min[axis];
+	float scale = NUM_BINS / extent[axis];
+
+	for (int i = first; i < first + count; i++)
+	{
+		int bin = (int)((centroids[order[i]][axis] - cmin) * scale);
+		bin = bin < NUM_BINS - 1 ? bin : NUM_BINS - 1;
+		bincount[bin]++;
+		binbounds[bin].Expand(bounds[order[i]]);
+	}
+
+	float leftarea[NUM_BINS - 1];
+	int leftcount[NUM_BINS - 1];
+	BoundingBox accum;
+	int accumcount = 0;
+
+	for (int i = 0; i < NUM_BINS - 1; i++)
+	{
+		accum.Expand(binbounds[i]);
+		accumcount += bincount[i];
+		leftarea[i] = accum.GetSurfaceArea();
+		leftcount[i] = accumcount;
+	}
+
+	float bestcost = FLT_MAX;
+	int bestsplit = -1;
+	accum.SetEmpty();
+	accumcount = 0;
+
+	for (int i = NUM_BINS - 1; i > 0; i--)
+	{
+		accum.Expand(binbounds[i]);
+		accumcount += bincount[i];
+
+		if (leftcount[i - 1] == 0 || accumcount == 0)
+			continue;
+
+		float cost = leftcount[i - 1] * leftarea[i - 1] + accumcount * accum.GetSurfaceArea();
+
+		if (cost < bestcost)
+		{
+			bestcost = cost;
+			bestsplit = i - 1;
+		}
+	}
+
+	//relative cost of a traversal step against a primitive test is taken as 1
+	float nodearea = nodebounds.GetSurfaceArea();
+	float splitcost = 1.0f + (nodearea > 0.0f ? bestcost / nodearea : 0.0f);
+
+	if (count <= MAX_LEAF_SIZE && (bestsplit < 0 || splitcost >= (float)count))
+		return nodeindex;
+
+	int mid;
+
+	if (bestsplit >= 0)
+	{
+		int* split = std::partition(&order[first], &order[first] + count,
+			[&](int i) {
+				int bin = (int)((centroids[i][axis] - cmin) * scale);
+				return bin <= bestsplit;
+			});
+		mid = (int)(split - &order[0]);
+	}
+	else
+	{
+		mid = first;
+	}
+
+	//fall back to an object median split if binning could not separate the references
+	if (mid == first || mid == first + count)
+	{
+		mid = first + count / 2;
+		std::nth_element(&order[first], &order[mid], &order[first] + count,
+			[&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+	}
+
+	int left = BuildRecursive(nodeindex, first, mid - first, depth + 1, bounds, centroids, order);
+	int right = BuildRecursive(nodeindex, mid, first + count - mid, depth + 1, bounds, centroids, order);
+
+	m_nodes[nodeindex].left = left;
+	m_nodes[nodeindex].right = right;
+	m_nodes[nodeindex].count = 0;
+	m_heights[nodeindex] = 1 + std::max(m_heights[left], m_heights[right]);
+
+	return nodeindex;
+}
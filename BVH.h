@@ -0,0 +1,173 @@
+#pragma once
+
+#include <vector>
+#include "BoundingBox.h"
+#include "Primitive.h"
+#include "Ray.h"
+#include "RayStats.h"
+
+struct BVHNode
+{
+	BoundingBox		bounds;
+	int				left;		//left child for an interior node, first reference for a leaf
+	int				right;		//right child for an interior node
+	int				count;		//number of references in a leaf, 0 for an interior node
+	int				parent;		//-1 for the root
+};
+
+//A bounding volume hierarchy built with a binned surface area heuristic.
+//Leaves reference primitives by (type, index) so the caller decides how
+//the referenced primitives are intersected
+class BVH
+{
+	public:
+		enum
+		{
+			MAX_LEAF_SIZE = 4,
+			MAX_DEPTH = 48,
+			NUM_BINS = 16
+		};
+
+	private:
+		std::vector<BVHNode>	m_nodes;
+		std::vector<PrimRef>	m_refs;
+
+		//bookkeeping for refitting, a slot is the position of a reference in the array given to Build
+		std::vector<int>		m_refSlots;			//slot of each entry in m_refs
+		std::vector<int>		m_slotLeaves;		//leaf node holding each slot
+		std::vector<int>		m_heights;			//height of each node's subtree, leaves are 0
+
+		float					m_areaSum;			//SAH cost of the tree before dividing by the root area
+		float					m_buildCost;		//SAH cost when the tree was last built
+
+		int		BuildRecursive(int parent, int first, int count, int depth,
+							const std::vector<BoundingBox>& bounds, std::vector<Vector3>& centroids, std::vector<int>& order);
+
+		void	SetNodeBounds(int nodeindex, const BoundingBox& bounds);
+		void	Rotate(int nodeindex);
+
+	public:
+		BVH();
+		~BVH();
+
+		//Build the hierarchy over the given references, bounds[i] being the bounds of refs[i]
+		void	Build(const std::vector<PrimRef>& refs, const std::vector<BoundingBox>& bounds);
+		void	Clear();
+
+		inline bool IsEmpty() const
+		{
+			return m_nodes.empty();
+		}
+
+		inline const BoundingBox& GetBounds() const
+		{
+			return m_nodes[0].bounds;
+		}
+
+		inline int GetNumNodes() const
+		{
+			return (int)m_nodes.size();
+		}
+
+		//Update the bounds of the given slots and refit their ancestors bottom up. Nodes on the
+		//refitted paths are rotated where that lowers the SAH cost without deepening the tree
+		void	Refit(const std::vector<int>& dirtySlots, const std::vector<BoundingBox>& bounds);
+
+		//Expected cost of a ray query in primitive tests, relative to the root
+		float	GetSAHCost() const;
+
+		inline float GetBuildSAHCost() const
+		{
+			return m_buildCost;
+		}
+
+		//Walk the hierarchy front to back, calling leafIntersector(refs, count, tmax) for every leaf
+		//the ray reaches. The intersector returns the distance of the closest hit so far, which is
+		//used to cull nodes further away
+		template <class LeafIntersector>
+		void Traverse(Ray& ray, float tmax, LeafIntersector& leafIntersector) const;
+};
+
+template <class LeafIntersector>
+void BVH::Traverse(Ray& ray, float tmax, LeafIntersector& leafIntersector) const
+{
+	if (m_nodes.empty())
+		return;
+
+	struct StackEntry
+	{
+		int		node;
+		float	tnear;
+	};
+
+	StackEntry stack[MAX_DEPTH + 2];
+	int stacksize = 0;
+
+	const Vec4 origin = ray.GetRayStart().GetVec4();
+	const Vec4 invdir = _mm_div_ps(_mm_set1_ps(1.0f), ray.GetRay().GetVec4());
+
+	float tnear;
+
+	if (!m_nodes[0].bounds.IntersectByRay(origin, invdir, tmax, tnear))
+		return;
+
+	stack[stacksize].node = 0;
+	stack[stacksize].tnear = tnear;
+	stacksize++;
+
+#if defined(TINYRAY_STATS)
+	//counted locally, one add per traversal keeps the counting off the inner loop
+	unsigned int visited = 0;
+#endif
+
+	while (stacksize > 0)
+	{
+		stacksize--;
+
+		if (stack[stacksize].tnear > tmax)
+			continue;
+
+		const BVHNode* node = &m_nodes[stack[stacksize].node];
+
+#if defined(TINYRAY_STATS)
+		visited++;
+#endif
+
+		if (node->count > 0)
+		{
+			tmax = leafIntersector(&m_refs[node->left], node->count, tmax);
+			continue;
+		}
+
+		float tleft, tright;
+		bool hitleft = m_nodes[node->left].bounds.IntersectByRay(origin, invdir, tmax, tleft);
+		bool hitright = m_nodes[node->right].bounds.IntersectByRay(origin, invdir, tmax, tright);
+
+		if (hitleft && hitright)
+		{
+			//push the far child first so the near one is visited next
+			bool leftfirst = tleft <= tright;
+
+			stack[stacksize].node = leftfirst ? node->right : node->left;
+			stack[stacksize].tnear = leftfirst ? tright : tleft;
+			stacksize++;
+			stack[stacksize].node = leftfirst ? node->left : node->right;
+			stack[stacksize].tnear = leftfirst ? tleft : tright;
+			stacksize++;
+		}
+		else if (hitleft)
+		{
+			stack[stacksize].node = node->left;
+			stack[stacksize].tnear = tleft;
+			stacksize++;
+		}
+		else if (hitright)
+		{
+			stack[stacksize].node = node->right;
+			stack[stacksize].tnear = tright;
+			stacksize++;
+		}
+	}
+
+	RAYSTATS_ADD(STAT_NODES, visited);
+}
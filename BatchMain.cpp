@@ -0,0 +1,404 @@
+//Headless entry point rendering a camera animation of the default scene, or
+//of a scene file, to a sequence of TGA files, no window or GL context is needed
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "Scene.h"
+#include "RayTracer.h"
+#include "PathTracer.h"
+#include "CameraPath.h"
+#include "FrameSequence.h"
+#include "TextureCache.h"
+#include "Denoiser.h"
+#include "IrradianceCache.h"
+#include "Profiler.h"
+#include "RenderControl.h"
+#include "TileServer.h"
+#include "TileWorker.h"
+
+static void PrintUsage()
+{
+	printf("Usage: tinyray-batch [options]\n");
+	printf("  -frames n         number of frames to render (default 36)\n");
+	printf("  -size w h         frame size in pixels (default 640 480)\n");
+	printf("  -out pattern      output file pattern (default frame%%04d.tga)\n");
+	printf("  -pathtrace        use the path tracer instead of the ray tracer\n");
+	printf("  -format f         framebuffer storage: rgba32f, rgb32f, rgba16f or rgb9e5 (default rgba32f)\n");
+	printf("  -aov list         also write AOVs as PFM files, a comma separated list of\n");
+	printf("                    albedo, normal, depth, primid and matid, or all\n");
+	printf("  -spp n            samples per pixel of the path tracer\n");
+	printf("  -samplerange first count\n");
+	printf("                    trace count of the path tracer's samples per pixel from sample first on,\n");
+	printf("                    checkpoints of ranges that do not overlap merge with tinyray-merge\n");
+	printf("  -timebudget s     stop each frame after s seconds, keeping the samples traced so far\n");
+	printf("  -maxspp n         cap the samples per pixel of the path tracer\n");
+	printf("  -checkpoint pat   keep the progress of each path traced frame in a checkpoint file and\n");
+	printf("                    resume from it, pat takes the frame number as -out does\n");
+	printf("  -checkpointinterval s\n");
+	printf("                    seconds between checkpoint writes (default 60)\n");
+	printf("  -seed n           sample seed of the path tracer, checkpoints of different seeds merge\n");
+	printf("                    with tinyray-merge\n");
+	printf("  -coordinator addr hand the frames out in bands to worker processes connecting to addr,\n");
+	printf("                    host:port, :port or unix:path, instead of tracing them here\n");
+	printf("  -worker addr      trace bands of frames for the coordinator at addr, the other options\n");
+	printf("                    must be those of the coordinator\n");
+	printf("  -tilerows n       rows of each band handed to a worker (default 16)\n");
+	printf("  -lightsamples n   lights picked per shading point in scenes with more lights,\n");
+	printf("                    0 to shade with every light (default 8)\n");
+	printf("  -denoise          denoise each frame, guided by AOVs that are written too\n");
+	printf("  -irrcache         path trace indirect diffuse lighting through an irradiance cache\n");
+	printf("                    kept across the frames\n");
+	printf("  -stats file       append ray statistics of each frame to a file as lines of JSON,\n");
+	printf("                    in builds with TINYRAY_STATS\n");
+	printf("  -profile file     write a timeline of scene loading, BVH builds, rendering and\n");
+	printf("                    image writes as Chrome trace JSON\n");
+	printf("  -heatmap mode     draw BVH nodes visited plus primitives tested instead of shading,\n");
+	printf("                    primary for the primary ray or path for every ray of a sample,\n");
+	printf("                    in builds with TINYRAY_STATS\n");
+	printf("  -heatmapscale n   cost drawn in red by -heatmap (default 100)\n");
+	printf("  -scene file       render a scene file instead of the default scene\n");
+	printf("  -path file        camera keyframes, a line of \"px py pz lx ly lz\" each, the frames are\n");
+	printf("                    spread evenly over them (default the scene file's camera,\n");
+	printf("                    or a turn around the default scene)\n");
+	printf("  -texcache mb      memory budget of the out-of-core texture cache (default 256)\n");
+	printf("  -maketiled in out convert a TGA texture to a tiled texture file and exit\n");
+}
+
+int main(int argc, char** argv)
+{
+	int numframes = 36;
+	int width = 640;
+	int height = 480;
+	const char* pattern = "frame%04d.tga";
+	bool pathtrace = false;
+	const char* scenefile = NULL;
+	const char* pathfile = NULL;
+	Framebuffer::FORMAT format = Framebuffer::FORMAT_RGBA32F;
+	unsigned int aovs = 0;
+	int samples = 0;
+	int firstsample = 0;
+	int numsamples = 0;
+	int lightsamples = -1;
+	bool denoise = false;
+	bool irradiancecache = false;
+	const char* statsfile = NULL;
+	const char* profilefile = NULL;
+	RenderControl control;
+	bool controlled = false;
+	bool timed = false;
+	const char* checkpointpattern = NULL;
+	double checkpointinterval = 60.0;
+	int seed = 0;
+	const char* coordinator = NULL;
+	const char* worker = NULL;
+	int tilerows = 16;
+	Renderer::HeatmapMode heatmap = Renderer::HEATMAP_NONE;
+	float heatmapscale = 100.0f;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+		{
+			numframes = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-size") == 0 && i + 2 < argc)
+		{
+			width = atoi(argv[++i]);
+			height = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-out") == 0 && i + 1 < argc)
+		{
+			pattern = argv[++i];
+		}
+		else if (strcmp(argv[i], "-pathtrace") == 0)
+		{
+			pathtrace = true;
+		}
+		else if (strcmp(argv[i], "-format") == 0 && i + 1 < argc)
+		{
+			if (!Framebuffer::ParseFormat(argv[++i], format))
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-aov") == 0 && i + 1 < argc)
+		{
+			std::string list = argv[++i];
+			size_t start = 0;
+
+			while (start <= list.size())
+			{
+				size_t end = list.find(',', start);
+				end = end == std::string::npos ? list.size() : end;
+
+				unsigned int flag;
+				if (!Renderer::ParseAOV(list.substr(start, end - start).c_str(), flag))
+				{
+					PrintUsage();
+					return 1;
+				}
+
+				aovs |= flag;
+				start = end + 1;
+			}
+		}
+		else if (strcmp(argv[i], "-spp") == 0 && i + 1 < argc)
+		{
+			samples = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-samplerange") == 0 && i + 2 < argc)
+		{
+			firstsample = atoi(argv[++i]);
+			numsamples = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-timebudget") == 0 && i + 1 < argc)
+		{
+			control.SetTimeBudget(atof(argv[++i]));
+			controlled = true;
+			timed = true;
+		}
+		else if (strcmp(argv[i], "-maxspp") == 0 && i + 1 < argc)
+		{
+			control.SetMaxSamples(atoi(argv[++i]));
+			controlled = true;
+		}
+		else if (strcmp(argv[i], "-checkpoint") == 0 && i + 1 < argc)
+		{
+			checkpointpattern = argv[++i];
+		}
+		else if (strcmp(argv[i], "-checkpointinterval") == 0 && i + 1 < argc)
+		{
+			checkpointinterval = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+		{
+			seed = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-coordinator") == 0 && i + 1 < argc)
+		{
+			coordinator = argv[++i];
+		}
+		else if (strcmp(argv[i], "-worker") == 0 && i + 1 < argc)
+		{
+			worker = argv[++i];
+		}
+		else if (strcmp(argv[i], "-tilerows") == 0 && i + 1 < argc)
+		{
+			tilerows = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-lightsamples") == 0 && i + 1 < argc)
+		{
+			lightsamples = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-denoise") == 0)
+		{
+			denoise = true;
+		}
+		else if (strcmp(argv[i], "-irrcache") == 0)
+		{
+			irradiancecache = true;
+		}
+		else if (strcmp(argv[i], "-stats") == 0 && i + 1 < argc)
+		{
+			statsfile = argv[++i];
+		}
+		else if (strcmp(argv[i], "-profile") == 0 && i + 1 < argc)
+		{
+			profilefile = argv[++i];
+		}
+		else if (strcmp(argv[i], "-heatmap") == 0 && i + 1 < argc)
+		{
+			if (!Renderer::ParseHeatmap(argv[++i], heatmap))
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-heatmapscale") == 0 && i + 1 < argc)
+		{
+			heatmapscale = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-scene") == 0 && i + 1 < argc)
+		{
+			scenefile = argv[++i];
+		}
+		else if (strcmp(argv[i], "-path") == 0 && i + 1 < argc)
+		{
+			pathfile = argv[++i];
+		}
+		else if (strcmp(argv[i], "-texcache") == 0 && i + 1 < argc)
+		{
+			TextureCache::GetInstance().SetBudget((size_t)atoi(argv[++i]) * 1024 * 1024);
+		}
+		else if (strcmp(argv[i], "-maketiled") == 0 && i + 2 < argc)
+		{
+			Texture texture;
+			const char* input = argv[++i];
+			const char* output = argv[++i];
+
+			if (!texture.LoadFromFile(input) || !texture.SaveTiledFile(output))
+			{
+				printf("Error converting %s to %s\n", input, output);
+				return 1;
+			}
+
+			return 0;
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (numframes <= 0 || width <= 0 || height <= 0 || (coordinator && worker))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	//a band traced in a worker must come out as it would in the whole frame
+	if ((coordinator || worker) && (timed || checkpointpattern || irradiancecache))
+	{
+		printf("-timebudget, -checkpoint and -irrcache need the whole frame traced in one process\n");
+		return 1;
+	}
+
+	Renderer* renderer;
+
+	if (pathtrace)
+	{
+		renderer = new PathTracer(width, height);
+		renderer->m_traceflag = (Renderer::TraceFlags)(Renderer::TRACE_REFRACTION | Renderer::TRACE_REFLECTION);
+	}
+	else
+	{
+		renderer = new RayTracer(width, height);
+		renderer->m_traceflag = (Renderer::TraceFlags)(Renderer::TRACE_AMBIENT | Renderer::TRACE_DIFFUSE_AND_SPEC
+			| Renderer::TRACE_REFLECTION | Renderer::TRACE_SHADOW);
+	}
+
+	renderer->SetFramebufferFormat(format);
+	renderer->EnableAOVs(aovs);
+	renderer->SetSamplesPerPixel(samples);
+	renderer->SetSampleRange(firstsample, numsamples);
+	renderer->SetStatsFile(statsfile);
+
+	if (controlled)
+		renderer->SetRenderControl(&control);
+
+	renderer->SetSampleSeed(seed);
+
+	if (!renderer->SetHeatmap(heatmap, heatmapscale))
+	{
+		printf("Heatmaps need a build with TINYRAY_STATS\n");
+		delete renderer;
+		return 1;
+	}
+
+	if (lightsamples >= 0)
+		renderer->SetLightSamples(lightsamples);
+
+	Denoiser denoiser;
+
+	if (denoise)
+		renderer->SetDenoiser(&denoiser);
+
+	IrradianceCache cache;
+
+	if (irradiancecache)
+		renderer->SetIrradianceCache(&cache);
+
+	if (profilefile)
+		Profiler::Enable();
+
+	Scene* scene = new Scene();
+
+	if (scenefile && !scene->LoadSceneFile(scenefile))
+	{
+		delete scene;
+		delete renderer;
+		return 1;
+	}
+
+	scene->SetSceneWidth((float)width / (float)height);
+
+	bool ok;
+
+	if (worker)
+	{
+		//the coordinator may take a while to load its own scene
+		ok = TileWorker::Run(worker, scene, renderer, 30.0);
+	}
+	else
+	{
+		CameraPath path;
+
+		if (pathfile)
+		{
+			bool loaded = path.LoadKeyframes(pathfile);
+
+			if (loaded && path.IsEmpty())
+				printf("No camera keyframes in %s\n", pathfile);
+
+			if (!loaded || path.IsEmpty())
+			{
+				delete scene;
+				delete renderer;
+				return 1;
+			}
+		}
+		else if (scenefile)
+		{
+			//a still camera where the scene file put it
+			Camera* cam = scene->GetSceneCamera();
+			path.AddKeyframe(0.0f, cam->GetPosition(), cam->GetLookAt());
+		}
+		else
+		{
+			//turn around the boxes and spheres of the default scene, staying inside its walls
+			path.AddOrbit(Vector3(0.0, 8.0, 8.0), Vector3(0.0, 5.0, -10.0), 0.0f, 1.0f);
+		}
+
+		FrameSequence sequence(renderer);
+		sequence.SetCheckpointPattern(checkpointpattern, checkpointinterval);
+
+		TileServer server(renderer, tilerows);
+		ok = true;
+
+		if (coordinator)
+		{
+			ok = server.Listen(coordinator, scene);
+
+			if (ok)
+				sequence.SetTileServer(&server);
+			else
+				printf("Error listening for workers on %s\n", coordinator);
+		}
+
+		ok = ok && sequence.Render(scene, path, numframes, pattern);
+	}
+
+	TextureCache::Stats stats;
+	TextureCache::GetInstance().GetStats(stats);
+
+	if (stats.misses > 0)
+		TextureCache::GetInstance().PrintStats();
+
+	if (denoise)
+		denoiser.PrintStats();
+
+	if (profilefile && !Profiler::WriteTrace(profilefile))
+	{
+		printf("Error writing the profile to %s\n", profilefile);
+		ok = false;
+	}
+
+	delete scene;
+	delete renderer;
+
+	return ok ? 0 : 1;
+}
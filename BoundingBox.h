@@ -0,0 +1,144 @@
+#pragma once
+
+#include <float.h>
+#include "Vector3.h"
+
+//An axis aligned bounding box used by the acceleration structures
+class BoundingBox
+{
+	public:
+		Vector3			m_min;
+		Vector3			m_max;
+
+		BoundingBox()
+		{
+			SetEmpty();
+		}
+
+		BoundingBox(const Vector3& bmin, const Vector3& bmax)
+		{
+			m_min = bmin;
+			m_max = bmax;
+		}
+
+		inline void SetEmpty()
+		{
+			m_min.SetVector(FLT_MAX, FLT_MAX, FLT_MAX);
+			m_max.SetVector(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		}
+
+		inline bool IsEmpty() const
+		{
+			return m_min[0] > m_max[0];
+		}
+
+		inline void Expand(const Vector3& point)
+		{
+			m_min = Vector3(_mm_min_ps(m_min.GetVec4(), point.GetVec4()));
+			m_max = Vector3(_mm_max_ps(m_max.GetVec4(), point.GetVec4()));
+		}
+
+		inline void Expand(const BoundingBox& box)
+		{
+			m_min = Vector3(_mm_min_ps(m_min.GetVec4(), box.m_min.GetVec4()));
+			m_max = Vector3(_mm_max_ps(m_max.GetVec4(), box.m_max.GetVec4()));
+		}
+
+		inline bool Contains(const Vector3& point) const
+		{
+			Vec4 inside = _mm_and_ps(_mm_cmpge_ps(point.GetVec4(), m_min.GetVec4()), _mm_cmple_ps(point.GetVec4(), m_max.GetVec4()));
+			return (_mm_movemask_ps(inside) & 0x7) == 0x7;
+		}
+
+		inline Vector3 GetCentre() const
+		{
+			return (m_min + m_max) * 0.5f;
+		}
+
+		inline Vector3 GetExtent() const
+		{
+			return m_max - m_min;
+		}
+
+		inline float GetSurfaceArea() const
+		{
+			if (IsEmpty())
+				return 0.0f;
+
+			Vector3 e = m_max - m_min;
+			return 2.0f * (e[0] * e[1] + e[1] * e[2] + e[2] * e[0]);
+		}
+
+		//Slab test against a ray given its origin and reciprocal direction
+		//the w lanes are ignored. On a hit tnear holds the entry distance clamped to zero
+		inline bool IntersectByRay(const Vec4& origin, const Vec4& invdir, float tmax, float& tnear) const
+		{
+			Vec4 t0 = _mm_mul_ps(_mm_sub_ps(m_min.GetVec4(), origin), invdir);
+			Vec4 t1 = _mm_mul_ps(_mm_sub_ps(m_max.GetVec4(), origin), invdir);
+			Vec4 tlo = _mm_min_ps(t0, t1);
+			Vec4 thi = _mm_max_ps(t0, t1);
+
+			//horizontal max/min over x, y and z
+			Vec4 lo = _mm_max_ps(tlo, _mm_shuffle_ps(tlo, tlo, _MM_SHUFFLE(3, 0, 2, 1)));
+			lo = _mm_max_ps(lo, _mm_shuffle_ps(tlo, tlo, _MM_SHUFFLE(3, 1, 0, 2)));
+			Vec4 hi = _mm_min_ps(thi, _mm_shuffle_ps(thi, thi, _MM_SHUFFLE(3, 0, 2, 1)));
+			hi = _mm_min_ps(hi, _mm_shuffle_ps(thi, thi, _MM_SHUFFLE(3, 1, 0, 2)));
+
+			lo = _mm_max_ss(lo, _mm_setzero_ps());
+			hi = _mm_min_ss(hi, _mm_set_ss(tmax));
+
+			tnear = _mm_cvtss_f32(lo);
+
+			return (_mm_movemask_ps(_mm_cmple_ss(lo, hi)) & 1) != 0;
+		}
+
+		//Branchless slab test treating the box as a solid. A ray starting inside hits the exit face.
+		//face is set to axis*2 for a face whose normal points along +axis and axis*2 + 1 for -axis
+		inline bool IntersectFaces(const Vec4& origin, const Vec4& dir, const Vec4& invdir, float tmax, float& t, int& face) const
+		{
+			static const int s_lowestAxis[8] = { 0, 0, 1, 0, 2, 0, 1, 0 };
+
+			const Vec4 zero = _mm_setzero_ps();
+			const Vec4 signmask = _mm_set1_ps(-0.0f);
+			const Vec4 wmask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+
+			Vec4 t0 = _mm_mul_ps(_mm_sub_ps(m_min.GetVec4(), origin), invdir);
+			Vec4 t1 = _mm_mul_ps(_mm_sub_ps(m_max.GetVec4(), origin), invdir);
+
+			//keep the w lane out of the horizontal min/max
+			Vec4 tlo = _mm_or_ps(_mm_andnot_ps(wmask, _mm_min_ps(t0, t1)), _mm_and_ps(wmask, _mm_set1_ps(-FLT_MAX)));
+			Vec4 thi = _mm_or_ps(_mm_andnot_ps(wmask, _mm_max_ps(t0, t1)), _mm_and_ps(wmask, _mm_set1_ps(FLT_MAX)));
+
+			//horizontal max/min broadcast to every lane
+			Vec4 tnear = _mm_max_ps(tlo, _mm_shuffle_ps(tlo, tlo, _MM_SHUFFLE(2, 3, 0, 1)));
+			tnear = _mm_max_ps(tnear, _mm_shuffle_ps(tnear, tnear, _MM_SHUFFLE(1, 0, 3, 2)));
+			Vec4 tfar = _mm_min_ps(thi, _mm_shuffle_ps(thi, thi, _MM_SHUFFLE(2, 3, 0, 1)));
+			tfar = _mm_min_ps(tfar, _mm_shuffle_ps(tfar, tfar, _MM_SHUFFLE(1, 0, 3, 2)));
+
+			//select the exit distance and exit axis when the ray starts inside
+			Vec4 inside = _mm_cmple_ps(tnear, zero);
+			Vec4 thit = _mm_or_ps(_mm_and_ps(inside, tfar), _mm_andnot_ps(inside, tnear));
+			Vec4 axes = _mm_or_ps(_mm_and_ps(inside, _mm_cmpeq_ps(thi, tfar)), _mm_andnot_ps(inside, _mm_cmpeq_ps(tlo, tnear)));
+
+			//entry faces point against the ray, exit faces along it
+			Vec4 facesign = _mm_xor_ps(_mm_and_ps(dir, signmask), _mm_andnot_ps(inside, signmask));
+
+			int axis = s_lowestAxis[_mm_movemask_ps(axes) & 0x7];
+			face = (axis << 1) | ((_mm_movemask_ps(facesign) >> axis) & 1);
+
+			Vec4 valid = _mm_and_ps(_mm_cmple_ps(tnear, tfar),
+				_mm_and_ps(_mm_cmpgt_ps(tfar, zero), _mm_cmplt_ps(thit, _mm_set1_ps(tmax))));
+
+			t = _mm_cvtss_f32(thit);
+
+			return (_mm_movemask_ps(valid) & 1) != 0;
+		}
+
+		static inline Vector3 GetFaceNormal(int face)
+		{
+			Vector3 normal;
+			normal.SetZero();
+			normal[face >> 1] = (face & 1) ? -1.0f : 1.0f;
+			return normal;
+		}
+};
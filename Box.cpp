@@ -3,6 +3,7 @@
 
 Box::Box()
 {
+	m_hasTransform = false;
 	SetBox(Vector3(0.0, 0.0, 0.0), 1, 1, 1);
 	m_primtype = Primitive::PRIMTYPE_Box;
 }
@@ -14,75 +15,65 @@ Box::~Box()
 
 Box::Box(Vector3 position, double width, double height, double depth)
 {
+	m_hasTransform = false;
 	SetBox(position, width, height, depth);
 	m_primtype = Primitive::PRIMTYPE_Box;
 }
 
 void Box::SetBox(Vector3 position, double width, double height, double depth)
 {
-	double halfwidth = width*0.5;
-	double halfheight = height*0.5;
-	double halfdepth = depth*0.5;
-	
-	Vector3 tempVerts[8];
-
-	tempVerts[0].SetVector(-halfwidth + position[0], -halfheight + position[1], halfdepth + position[2]);
-	tempVerts[1].SetVector(halfwidth + position[0], -halfheight + position[1], halfdepth + position[2]);
-	tempVerts[2].SetVector(halfwidth + position[0], halfheight + position[1], halfdepth + position[2]);
-	tempVerts[3].SetVector(-halfwidth + position[0], halfheight + position[1], halfdepth + position[2]);
-	
-	tempVerts[4].SetVector(-halfwidth + position[0], -halfheight + position[1], -halfdepth + position[2]);
-	tempVerts[5].SetVector(halfwidth + position[0], -halfheight + position[1], -halfdepth + position[2]);
-	tempVerts[6].SetVector(halfwidth + position[0], halfheight + position[1], -halfdepth + position[2]);
-	tempVerts[7].SetVector(-halfwidth + position[0], halfheight + position[1], -halfdepth + position[2]);
-
-	m_triangles[0].SetVertices(tempVerts[0], tempVerts[1], tempVerts[2]);
-	
-	m_triangles[1].SetVertices(tempVerts[0], tempVerts[2], tempVerts[3]);
-	
-	m_triangles[2].SetVertices(tempVerts[1], tempVerts[6], tempVerts[2]);
-	
-	m_triangles[3].SetVertices(tempVerts[1], tempVerts[5], tempVerts[6]);
-	
-	m_triangles[4].SetVertices(tempVerts[0], tempVerts[3], tempVerts[7]);
-	
-	m_triangles[5].SetVertices(tempVerts[0], tempVerts[7], tempVerts[4]);
-	
-	m_triangles[6].SetVertices(tempVerts[4], tempVerts[7], tempVerts[6]);
-	
-	m_triangles[7].SetVertices(tempVerts[4], tempVerts[6], tempVerts[5]);
-	
-	m_triangles[8].SetVertices(tempVerts[3], tempVerts[6], tempVerts[7]);
-	
-	m_triangles[9].SetVertices(tempVerts[3], tempVerts[2], tempVerts[6]);
-	
-	m_triangles[10].SetVertices(tempVerts[0], tempVerts[4], tempVerts[5]);
-	
-	m_triangles[11].SetVertices(tempVerts[0], tempVerts[5], tempVerts[1]);
-	
+	Vector3 halfsize(width*0.5, height*0.5, depth*0.5);
+
+	m_bounds = BoundingBox(position - halfsize, position + halfsize);
+}
+
+void Box::SetTransform(const Transform& toWorld)
+{
+	m_toWorld = toWorld;
+	m_toObject = toWorld.GetInverse();
+	m_hasTransform = true;
+}
+
+void Box::ClearTransform()
+{
+	m_toWorld.SetIdentity();
+	m_toObject.SetIdentity();
+	m_hasTransform = false;
+}
+
+BoundingBox Box::GetBounds() const
+{
+	return m_hasTransform ? m_toWorld.TransformBounds(m_bounds) : m_bounds;
 }
 
 RayHitResult Box::IntersectByRay(Ray& ray)
 {
 	RayHitResult result = Ray::s_defaultHitResult;
 
-	for (int i = 0; i < 12; i++)
+	//an oriented box is intersected in its own space, the ray direction is not
+	//renormalised so t is the same in both spaces
+	Vec4 origin = ray.GetRayStart().GetVec4();
+	Vec4 dir = ray.GetRay().GetVec4();
+
+	if (m_hasTransform)
 	{
-		Primitive* prim = static_cast<Primitive*>(&m_triangles[i]);
+		origin = m_toObject.TransformPoint(origin);
+		dir = m_toObject.TransformVector(dir);
+	}
 
-		RayHitResult tempresult = prim->IntersectByRay(ray);
-		
-		if (tempresult.t < result.t)
-		{
-			Vector3 v01 = m_triangles[i].m_vertices[1].m_position - m_triangles[i].m_vertices[0].m_position;
-			Vector3 v02 = m_triangles[i].m_vertices[2].m_position - m_triangles[i].m_vertices[0].m_position;
+	Vec4 invdir = _mm_div_ps(_mm_set1_ps(1.0f), dir);
+	float t;
+	int face;
 
-			tempresult.normal = v01.CrossProduct(v02).Normalise();
-			tempresult.data = this;
-			result = tempresult;
-		}
+	if (!m_bounds.IntersectFaces(origin, dir, invdir, FARFAR_AWAY, t, face))
+		return result;
 
-	}
+	result.t = t;
+	result.point = ray.GetRayStart() + ray.GetRay()*t;
+	result.normal = BoundingBox::GetFaceNormal(face);
+	if (m_hasTransform)
+		result.normal = m_toObject.TransformNormalByInverse(result.normal);
+	result.data = this;
 
 	return result;
 }
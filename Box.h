@@ -10,12 +10,16 @@
 #pragma	once
 #include "Primitive.h"
 #include "Vector3.h"
-#include "Triangle.h"
+#include "BoundingBox.h"
+#include "Transform.h"
 
 class Box : public Primitive
 {
 	private:
-		Triangle m_triangles[12];
+		BoundingBox m_bounds;			//the box in object space
+		Transform m_toWorld;
+		Transform m_toObject;
+		bool m_hasTransform;
 
 	public:
 		Box();
@@ -24,6 +28,28 @@ class Box : public Primitive
 
 		void SetBox(Vector3 position, double width, double height, double depth);
 
+		//Place the box as set by SetBox with an arbitrary affine transform, e.g. to orient it
+		void SetTransform(const Transform& toWorld);
+		void ClearTransform();
+
+		inline const BoundingBox& GetObjectBounds() const
+		{
+			return m_bounds;
+		}
+
+		inline bool HasTransform() const
+		{
+			return m_hasTransform;
+		}
+
+		inline const Transform& GetWorldToObject() const
+		{
+			return m_toObject;
+		}
+
+		//Bounds in world space
+		BoundingBox GetBounds() const;
+
 		RayHitResult IntersectByRay(Ray& ray);
 
 };
@@ -31,11 +31,13 @@ void Camera::InitDefaultCamera()
 
 	//Calculate viewplane centre;
 	m_viewCentre = m_position + m_viewVector*m_focalLength;
+	m_lookAt = m_viewCentre;
 }
 
 void Camera::SetPositionAndLookAt( const Vector3& pos, const Vector3& lookat)
 {
 	m_position = pos;
+	m_lookAt = lookat;
 	//m_position.SetVector(0.0, 6.0, 13.0);
 	m_upVector.SetVector(0.0f, 1.0f, 0.0f);
 	m_viewVector = lookat - m_position;
@@ -19,6 +19,7 @@ class Camera
 		Vector3				m_viewVector;
 		Vector3				m_rightVector;
 		Vector3				m_viewCentre;		//centre of the near view plane
+		Vector3				m_lookAt;			//as given to SetPositionAndLookAt
 		double					m_focalLength;	    //you can think of this as the distance between the eye and the near plane of the view frustum
 
 	public:
@@ -55,6 +56,11 @@ class Camera
 			return m_viewCentre;
 		}
 
+		inline Vector3&		GetLookAt() 
+		{
+			return m_lookAt;
+		}
+
 		inline double		GetFocalLength() 
 		{
 			return m_focalLength;
@@ -0,0 +1,161 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "CameraPath.h"
+
+static Vector3 CatmullRom(const Vector3& p0, const Vector3& p1, const Vector3& p2, const Vector3& p3, float t)
+{
+	float t2 = t*t;
+	float t3 = t2*t;
+
+	return (p1*2.0f + (p2 - p0)*t + (p0*2.0f - p1*5.0f + p2*4.0f - p3)*t2 + (p1*3.0f - p0 - p2*3.0f + p3)*t3) * 0.5f;
+}
+
+CameraPath::CameraPath()
+{
+}
+
+CameraPath::~CameraPath()
+{
+}
+
+void CameraPath::AddKeyframe(float time, const Vector3& position, const Vector3& lookat)
+{
+	CameraKeyframe key;
+	key.time = time;
+	key.position = position;
+	key.lookat = lookat;
+
+	std::vector<CameraKeyframe>::iterator iter = m_keyframes.begin();
+
+	while (iter != m_keyframes.end() && iter->time <= time)
+	{
+		iter++;
+	}
+
+	m_keyframes.insert(iter, key);
+}
+
+void CameraPath::AddOrbit(const Vector3& position, const Vector3& lookat, float startTime, float endTime, int numKeyframes)
+{
+	Vector3 offset = position - lookat;
+	float radius = sqrtf(offset[0]*offset[0] + offset[2]*offset[2]);
+	float angle = atan2f(offset[2], offset[0]);
+
+	if (numKeyframes < 2)
+		numKeyframes = 2;
+
+	for (int i = 0; i < numKeyframes; i++)
+	{
+		float s = (float)i / (float)(numKeyframes - 1);
+		float a = angle + s * 2.0f * 3.14159265f;
+
+		Vector3 p(lookat[0] + radius*cosf(a), position[1], lookat[2] + radius*sinf(a));
+		AddKeyframe(startTime + s*(endTime - startTime), p, lookat);
+	}
+}
+
+bool CameraPath::LoadKeyframes(const char* filename)
+{
+	FILE* pfile;
+
+#if defined(WINDOWS) || defined(WIN32)
+	if (fopen_s(&pfile, filename, "r"))
+		pfile = NULL;
+#else
+	pfile = fopen(filename, "r");
+#endif
+
+	if (!pfile)
+	{
+		printf("Error opening camera path: %s\n", filename);
+		return false;
+	}
+
+	float time = m_keyframes.empty() ? 0.0f : GetEndTime() + 1.0f;
+	char buffer[1024];
+	int line = 0;
+	bool ok = true;
+
+	while (ok && fgets(buffer, sizeof(buffer), pfile))
+	{
+		line++;
+
+		const char* start = buffer + strspn(buffer, " \t\r\n");
+
+		if (*start == '\0' || *start == '#')
+			continue;
+
+		float p[6];
+		char extra;
+
+		if (sscanf(start, "%f %f %f %f %f %f %c", &p[0], &p[1], &p[2], &p[3], &p[4], &p[5], &extra) != 6)
+		{
+			printf("%s(%d): expected a position and look-at point\n", filename, line);
+			ok = false;
+			break;
+		}
+
+		AddKeyframe(time, Vector3(p[0], p[1], p[2]), Vector3(p[3], p[4], p[5]));
+		time += 1.0f;
+	}
+
+	fclose(pfile);
+
+	return ok;
+}
+
+void CameraPath::Clear()
+{
+	m_keyframes.clear();
+}
+
+void CameraPath::Evaluate(float time, Vector3& position, Vector3& lookat) const
+{
+	int numkeys = (int)m_keyframes.size();
+
+	if (numkeys == 0)
+		return;
+
+	if (numkeys == 1 || time <= m_keyframes[0].time)
+	{
+		position = m_keyframes[0].position;
+		lookat = m_keyframes[0].lookat;
+		return;
+	}
+
+	if (time >= m_keyframes[numkeys - 1].time)
+	{
+		position = m_keyframes[numkeys - 1].position;
+		lookat = m_keyframes[numkeys - 1].lookat;
+		return;
+	}
+
+	int k = 0;
+	while (m_keyframes[k + 1].time < time)
+	{
+		k++;
+	}
+
+	//the end keyframes are repeated to give the spline its outer control points
+	const CameraKeyframe& k0 = m_keyframes[k > 0 ? k - 1 : k];
+	const CameraKeyframe& k1 = m_keyframes[k];
+	const CameraKeyframe& k2 = m_keyframes[k + 1];
+	const CameraKeyframe& k3 = m_keyframes[k + 2 < numkeys ? k + 2 : k + 1];
+
+	float span = k2.time - k1.time;
+	float t = span > 0.0f ? (time - k1.time) / span : 0.0f;
+
+	position = CatmullRom(k0.position, k1.position, k2.position, k3.position, t);
+	lookat = CatmullRom(k0.lookat, k1.lookat, k2.lookat, k3.lookat, t);
+}
+
+void CameraPath::ApplyToCamera(Camera* camera, float time) const
+{
+	if (m_keyframes.empty())
+		return;
+
+	Vector3 position, lookat;
+	Evaluate(time, position, lookat);
+	camera->SetPositionAndLookAt(position, lookat);
+}
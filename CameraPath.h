@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include "Vector3.h"
+#include "Camera.h"
+
+struct CameraKeyframe
+{
+	float		time;
+	Vector3		position;
+	Vector3		lookat;
+};
+
+//A camera animation given as keyframes for Camera::SetPositionAndLookAt.
+//Positions and look-at points are interpolated with a Catmull-Rom spline
+//so the camera passes through every keyframe without kinks
+class CameraPath
+{
+	private:
+		std::vector<CameraKeyframe>		m_keyframes;		//sorted by time
+
+	public:
+		CameraPath();
+		~CameraPath();
+
+		void	AddKeyframe(float time, const Vector3& position, const Vector3& lookat);
+
+		//Add numKeyframes keyframes circling the look-at point about the y axis, starting from
+		//position and making one full turn between startTime and endTime
+		void	AddOrbit(const Vector3& position, const Vector3& lookat, float startTime, float endTime, int numKeyframes = 16);
+
+		void	Clear();
+
+		//Add the keyframes of a text file, one per line as "px py pz lx ly lz", a position and
+		//look-at point, one time unit apart after the last keyframe. Blank lines and lines
+		//starting with '#' are skipped. Returns false if the file cannot be read or a line is not
+		//a keyframe
+		bool	LoadKeyframes(const char* filename);
+
+		inline bool IsEmpty() const
+		{
+			return m_keyframes.empty();
+		}
+
+		inline float GetStartTime() const
+		{
+			return m_keyframes.empty() ? 0.0f : m_keyframes.front().time;
+		}
+
+		inline float GetEndTime() const
+		{
+			return m_keyframes.empty() ? 0.0f : m_keyframes.back().time;
+		}
+
+		void	Evaluate(float time, Vector3& position, Vector3& lookat) const;
+		void	ApplyToCamera(Camera* camera, float time) const;
+};
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include "Checkpoint.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+static const char s_magic[4] = { 'T', 'R', 'C', 'K' };
+static const int s_version = 2;
+
+void Checkpoint::Init(const Settings& settings)
+{
+	m_settings = settings;
+
+	int numpixels = GetNumPixels();
+	m_colours.assign((size_t)numpixels * 3, 0.0f);
+	m_counts.assign(numpixels, -1);
+}
+
+bool Checkpoint::Load(const char* filename)
+{
+	FILE* file = fopen(filename, "rb");
+
+	if (!file)
+		return false;
+
+	char magic[4];
+	int version;
+	Settings settings;
+
+	bool valid = fread(magic, 1, 4, file) == 4 && memcmp(magic, s_magic, 4) == 0 &&
+		fread(&version, sizeof(int), 1, file) == 1 && version == s_version &&
+		fread(&settings, sizeof(Settings), 1, file) == 1 &&
+		settings.width > 0 && settings.height > 0 && settings.samples > 0 &&
+		(long long)settings.width * settings.height <= (1 << 28);
+
+	if (valid)
+	{
+		Init(settings);
+
+		size_t numpixels = (size_t)GetNumPixels();
+
+		valid = fread(&m_colours[0], sizeof(float), numpixels * 3, file) == numpixels * 3 &&
+			fread(&m_counts[0], sizeof(int), numpixels, file) == numpixels;
+	}
+
+	fclose(file);
+
+	return valid;
+}
+
+bool Checkpoint::Save(const char* filename) const
+{
+	size_t numpixels = (size_t)GetNumPixels();
+	size_t colourbytes = numpixels * 3 * sizeof(float);
+	size_t countbytes = numpixels * sizeof(int);
+	size_t headerbytes = 4 + sizeof(int) + sizeof(Settings);
+	size_t size = headerbytes + colourbytes + countbytes;
+
+	std::string temp = std::string(filename) + ".tmp";
+
+#if defined(_WIN32)
+	HANDLE handle = CreateFileA(temp.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)(size & 0xffffffff), NULL);
+	char* data = mapping ? (char*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size) : NULL;
+#else
+	int handle = open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (handle < 0)
+		return false;
+
+	char* data = NULL;
+
+	if (ftruncate(handle, (off_t)size) == 0)
+	{
+		void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+		data = mapped != MAP_FAILED ? (char*)mapped : NULL;
+	}
+#endif
+
+	bool ok = data != NULL;
+
+	if (ok)
+	{
+		char* dst = data;
+		memcpy(dst, s_magic, 4);									dst += 4;
+		memcpy(dst, &s_version, sizeof(int));						dst += sizeof(int);
+		memcpy(dst, &m_settings, sizeof(Settings));					dst += sizeof(Settings);
+		memcpy(dst, &m_colours[0], colourbytes);					dst += colourbytes;
+		memcpy(dst, &m_counts[0], countbytes);
+	}
+
+	//the pages go to the file when the mapping is flushed, before the rename makes it the checkpoint
+#if defined(_WIN32)
+	if (data)
+	{
+		ok = FlushViewOfFile(data, 0) != 0;
+		UnmapViewOfFile(data);
+	}
+
+	if (mapping)
+		CloseHandle(mapping);
+
+	ok = FlushFileBuffers(handle) != 0 && ok;
+	CloseHandle(handle);
+
+	ok = ok && MoveFileExA(temp.c_str(), filename, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	if (data)
+	{
+		ok = msync(data, size, MS_SYNC) == 0;
+		munmap(data, size);
+	}
+
+	ok = close(handle) == 0 && ok;
+
+	ok = ok && rename(temp.c_str(), filename) == 0;
+#endif
+
+	if (!ok)
+		remove(temp.c_str());
+
+	return ok;
+}
+
+bool Checkpoint::IsSameFrame(const Settings& settings) const
+{
+	return m_settings.width == settings.width && m_settings.height == settings.height &&
+		m_settings.traceflags == settings.traceflags &&
+		memcmp(m_settings.camera, settings.camera, sizeof(settings.camera)) == 0;
+}
+
+void Checkpoint::SetSamples(int samples)
+{
+	if (samples <= 0 || samples == m_settings.samples)
+		return;
+
+	float scale = (float)m_settings.samples / (float)samples;
+
+	for (size_t i = 0; i < m_colours.size(); i++)
+	{
+		m_colours[i] *= scale;
+	}
+
+	m_settings.samples = samples;
+}
+
+bool Checkpoint::Merge(const Checkpoint& other)
+{
+	if (!IsSameFrame(other.m_settings))
+		return false;
+
+	//the colours of both are sums of samples weighted by their own sample counts, so the
+	//merged colours are weighted by the two counts together
+	int samples = m_settings.samples + other.m_settings.samples;
+	int initial = m_settings.initialPaths;
+	int otherinitial = other.m_settings.initialPaths;
+	int mergedinitial = std::max(initial, otherinitial);
+	int numpixels = GetNumPixels();
+
+	for (int i = 0; i < numpixels; i++)
+	{
+		int count = m_counts[i];
+		int othercount = other.m_counts[i];
+
+		if (count < 0 && othercount < 0)
+			continue;
+
+		//every pixel is left weighted as a render of the merged count with the merged initial paths,
+		//as GetColour expects. Where both brought initial paths they are scaled down to one set, where
+		//only a pixel that one of them never reached had them the samples stand in for them
+		int merged = (count > 0 ? count : 0) + (othercount > 0 ? othercount : 0);
+		int traced = (count >= 0 ? count + initial : 0) + (othercount >= 0 ? othercount + otherinitial : 0);
+		float scale = traced > 0 ? (float)(merged + mergedinitial) / (float)traced : 1.0f;
+		float mine = count >= 0 ? (float)m_settings.samples / (float)samples * scale : 0.0f;
+		float theirs = othercount >= 0 ? (float)other.m_settings.samples / (float)samples * scale : 0.0f;
+
+		for (int c = 0; c < 3; c++)
+		{
+			m_colours[i*3 + c] = m_colours[i*3 + c] * mine + other.m_colours[i*3 + c] * theirs;
+		}
+
+		m_counts[i] = merged;
+	}
+
+	//ranges that follow on from each other merge into one range, resumed past the later of them
+	m_settings.samples = samples;
+	m_settings.firstSample = std::min(m_settings.firstSample, other.m_settings.firstSample);
+	m_settings.initialPaths = mergedinitial;
+
+	return true;
+}
+
+Vector3 Checkpoint::GetColour(int index) const
+{
+	int count = m_counts[index];
+
+	if (count <= 0)
+		return Vector3(0.0, 0.0, 0.0);
+
+	//the initial paths are weighted like samples, and are in the colour however few samples were traced
+	float scale = (float)(m_settings.samples + m_settings.initialPaths) / (float)(count + m_settings.initialPaths);
+
+	return Vector3(m_colours[index*3] * scale, m_colours[index*3 + 1] * scale, m_colours[index*3 + 2] * scale);
+}
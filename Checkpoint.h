@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include "Vector3.h"
+
+//The progress of a path traced frame: the accumulated colour and samples traced of every
+//pixel, and the settings they were traced with. The path tracer writes one between sample
+//passes so a frame that is stopped or pre-empted carries on from it later. Checkpoints of a
+//frame traced with different sample seeds or sample ranges hold different samples, Merge
+//adds them up into one
+class Checkpoint
+{
+	public:
+		struct Settings
+		{
+			int		width;
+			int		height;
+			int		samples;					//samples per pixel the colours are weighted for
+			int		firstSample;				//index of the first of them, see Renderer::SetSampleRange
+			int		initialPaths;				//uncounted paths a pixel's first pass adds to its colour, as the path tracer does
+			int		seed;						//sample seed of the renderer, see Renderer::SetSampleSeed
+			int		traceflags;
+			float	camera[11];					//camera position, view and up vectors, scene width and height
+		};
+
+		Settings					m_settings;
+		std::vector<float>			m_colours;	//rgb of each pixel, every sample weighted by 1 / samples
+		std::vector<int>			m_counts;	//samples traced in each pixel, -1 before its first
+
+		//Size the buffers for the settings with nothing traced
+		void Init(const Settings& settings);
+
+		bool Load(const char* filename);
+
+		//The file is written through a memory mapping of a temporary file, which is then renamed
+		//over filename, so a render killed while writing leaves the previous checkpoint whole
+		bool Save(const char* filename) const;
+
+		//Same size, trace flags and camera, the samples, their range and seed may differ
+		bool IsSameFrame(const Settings& settings) const;
+
+		//Reweight the colours for a new number of samples per pixel
+		void SetSamples(int samples);
+
+		//Add the samples of a checkpoint of the same frame, pixels are weighted by their sample counts.
+		//The other checkpoint must hold different samples, i.e. come from a different seed or sample range
+		bool Merge(const Checkpoint& other);
+
+		//Colour of pixel index from the samples traced so far, black before any. A pixel short of
+		//the full count is scaled up to it, its initial paths counted as samples
+		Vector3 GetColour(int index) const;
+
+		inline int GetNumPixels() const
+		{
+			return m_settings.width * m_settings.height;
+		}
+};
@@ -0,0 +1,275 @@
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include "Denoiser.h"
+#include "Profiler.h"
+
+//two taps either side of the centre at the widest step
+static const int s_padding = 2 << (Denoiser::MAX_ITERATIONS - 1);
+
+//B3 spline kernel, applied separably to the weights of the 5x5 taps
+static const float s_kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+//taps are weighted by the cosine between normals to this power of two
+static const int s_normalSquarings = 7;
+
+//below these the weights are too small to matter and are cut to 0, so nothing ever
+//goes denormal, 0.8^128 and e^-30 are both around 1e-13
+static const float s_minCosine = 0.8f;
+static const float s_minExponent = -30.0f;
+
+//e^x for x <= 0, good to about 1e-5 relative which is plenty for filter weights.
+//0 below s_minExponent
+static inline Vec4 FastExp(Vec4 x)
+{
+	Vec4 inrange = _mm_cmpge_ps(x, _mm_set1_ps(s_minExponent));
+	x = _mm_max_ps(x, _mm_set1_ps(s_minExponent));
+	Vec4 t = _mm_mul_ps(x, _mm_set1_ps(1.44269504f));
+
+	//floor, SSE2 only truncates
+	Vec4 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+	whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmpgt_ps(whole, t), _mm_set1_ps(1.0f)));
+	Vec4 f = _mm_sub_ps(t, whole);
+
+	//2^f on [0, 1)
+	Vec4 p = _mm_set1_ps(0.0096181f);
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.0555041f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.2402265f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.6931472f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+
+	__m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(whole), _mm_set1_epi32(127)), 23);
+
+	return _mm_and_ps(_mm_mul_ps(p, _mm_castsi128_ps(exponent)), inrange);
+}
+
+Denoiser::Denoiser()
+{
+	m_iterations = MAX_ITERATIONS;
+	m_sigmaColour = 4.0f;
+	m_sigmaDepth = 0.1f;
+	m_stride = 0;
+	m_lastTime = 0.0;
+	m_totalTime = 0.0;
+	m_totalPixels = 0.0;
+}
+
+Denoiser::~Denoiser()
+{
+}
+
+bool Denoiser::Denoise(Framebuffer* framebuffer)
+{
+	PROFILE_SCOPE("Denoise");
+
+	int albedolayer = framebuffer->FindLayer("albedo");
+	int normallayer = framebuffer->FindLayer("normal");
+	int depthlayer = framebuffer->FindLayer("depth");
+
+	if (albedolayer < 0 || normallayer < 0 || depthlayer < 0)
+		return false;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	int width = framebuffer->GetWidth();
+	int height = framebuffer->GetHeight();
+
+	//rows are padded to a multiple of 4 so every group of 4 pixels is a whole SSE register
+	m_stride = s_padding + ((width + 3) & ~3) + s_padding;
+	size_t size = (size_t)m_stride*height;
+
+	for (int c = 0; c < 3; c++)
+	{
+		m_colour[0][c].assign(size, 0.0f);
+		m_colour[1][c].assign(size, 0.0f);
+		m_albedo[c].assign(size, 0.0f);
+		m_normal[c].assign(size, 0.0f);
+	}
+
+	m_depth.assign(size, 0.0f);
+
+	//split the layers into planes, dividing the colour by the albedo
+#pragma omp parallel for schedule (dynamic, 1)
+	for (int y = 0; y < height; y++)
+	{
+		std::vector<Colour> colour(width), albedo(width), normal(width), depth(width);
+		int layers[4] = { 0, albedolayer, normallayer, depthlayer };
+		Colour* rows[4] = { &colour[0], &albedo[0], &normal[0], &depth[0] };
+
+		for (int l = 0; l < 4; l++)
+		{
+			Framebuffer::FORMAT format = framebuffer->GetLayerFormat(layers[l]);
+			const unsigned char* data = framebuffer->GetLayerData(layers[l]);
+
+			Framebuffer::DecodePixels(format, data + (size_t)y*width*Framebuffer::GetPixelSize(format), rows[l], width);
+		}
+
+		size_t row = (size_t)y*m_stride + s_padding;
+
+		for (int x = 0; x < width; x++)
+		{
+			Colour a(_mm_max_ps(albedo[x].GetVec4(), _mm_set1_ps(0.01f)));
+			Colour irradiance(_mm_div_ps(colour[x].GetVec4(), a.GetVec4()));
+
+			for (int c = 0; c < 3; c++)
+			{
+				m_colour[0][c][row + x] = irradiance[c];
+				m_albedo[c][row + x] = a[c];
+				m_normal[c][row + x] = normal[x][c];
+			}
+
+			m_depth[row + x] = depth[x][0];
+		}
+	}
+
+	int src = 0;
+	float invsigma = 1.0f / (m_sigmaColour*m_sigmaColour);
+
+	for (int i = 0; i < m_iterations; i++)
+	{
+		FilterPass(width, height, 1 << i, invsigma, src);
+		src = 1 - src;
+
+		//the colour tolerance halves every iteration as the colour gets smoother
+		invsigma *= 4.0f;
+	}
+
+	//multiply the albedo back in and write the beauty layer
+#pragma omp parallel for schedule (dynamic, 1)
+	for (int y = 0; y < height; y++)
+	{
+		size_t row = (size_t)y*m_stride + s_padding;
+
+		for (int x = 0; x < width; x++)
+		{
+			Colour colour(m_colour[src][0][row + x] * m_albedo[0][row + x],
+				m_colour[src][1][row + x] * m_albedo[1][row + x],
+				m_colour[src][2][row + x] * m_albedo[2][row + x]);
+
+			framebuffer->WriteRGBToFramebuffer(colour, x, y);
+		}
+	}
+
+	m_lastTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	m_totalTime += m_lastTime;
+	m_totalPixels += (double)width*height;
+
+	return true;
+}
+
+void Denoiser::PrintStats() const
+{
+	if (m_totalPixels <= 0.0)
+		return;
+
+	printf("Denoiser: %.2f ms per megapixel, %.2f ms last frame (%d iterations)\n",
+		1000.0 * m_totalTime / (m_totalPixels / 1e6), 1000.0 * m_lastTime, m_iterations);
+}
+
+void Denoiser::FilterPass(int width, int height, int step, float invSigmaColourSqr, int src)
+{
+	int tilesx = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+	int tilesy = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+
+	const float* incolour[3] = { &m_colour[src][0][0], &m_colour[src][1][0], &m_colour[src][2][0] };
+	float* outcolour[3] = { &m_colour[1 - src][0][0], &m_colour[1 - src][1][0], &m_colour[1 - src][2][0] };
+	const float* normal[3] = { &m_normal[0][0], &m_normal[1][0], &m_normal[2][0] };
+	const float* depth = &m_depth[0];
+
+	const Vec4 zero = _mm_setzero_ps();
+	const Vec4 sigmacolour = _mm_set1_ps(invSigmaColourSqr);
+	const Vec4 sigmadepth = _mm_set1_ps(1.0f / m_sigmaDepth);
+	const Vec4 mincosine = _mm_set1_ps(s_minCosine);
+
+#pragma omp parallel for schedule (dynamic, 1)
+	for (int tile = 0; tile < tilesx*tilesy; tile++)
+	{
+		int x0 = (tile % tilesx) * TILE_WIDTH;
+		int y0 = (tile / tilesx) * TILE_HEIGHT;
+		int x1 = x0 + TILE_WIDTH < width ? x0 + TILE_WIDTH : width;
+		int y1 = y0 + TILE_HEIGHT < height ? y0 + TILE_HEIGHT : height;
+
+		for (int y = y0; y < y1; y++)
+		{
+			//4 neighbouring pixels are filtered at once, their taps are neighbours too so each
+			//tap is a single unaligned load per plane
+			for (int x = x0; x < x1; x += 4)
+			{
+				size_t centre = (size_t)y*m_stride + s_padding + x;
+
+				Vec4 cr = _mm_loadu_ps(incolour[0] + centre);
+				Vec4 cg = _mm_loadu_ps(incolour[1] + centre);
+				Vec4 cb = _mm_loadu_ps(incolour[2] + centre);
+				Vec4 nx = _mm_loadu_ps(normal[0] + centre);
+				Vec4 ny = _mm_loadu_ps(normal[1] + centre);
+				Vec4 nz = _mm_loadu_ps(normal[2] + centre);
+				Vec4 z = _mm_loadu_ps(depth + centre);
+
+				//pixels that missed the scene have no features and are left alone
+				Vec4 valid = _mm_cmpgt_ps(z, zero);
+				Vec4 invz = _mm_div_ps(sigmadepth, _mm_max_ps(z, _mm_set1_ps(1e-6f)));
+
+				Vec4 sumr = zero, sumg = zero, sumb = zero, sumw = zero;
+
+				for (int ky = 0; ky < 5; ky++)
+				{
+					int ty = y + (ky - 2)*step;
+
+					if (ty < 0 || ty >= height)
+						continue;
+
+					for (int kx = 0; kx < 5; kx++)
+					{
+						size_t tap = (size_t)ty*m_stride + s_padding + x + (kx - 2)*step;
+
+						Vec4 tz = _mm_loadu_ps(depth + tap);
+						Vec4 tr = _mm_loadu_ps(incolour[0] + tap);
+						Vec4 tg = _mm_loadu_ps(incolour[1] + tap);
+						Vec4 tb = _mm_loadu_ps(incolour[2] + tap);
+
+						Vec4 dr = _mm_sub_ps(cr, tr);
+						Vec4 dg = _mm_sub_ps(cg, tg);
+						Vec4 db = _mm_sub_ps(cb, tb);
+						Vec4 colourdist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+						Vec4 dz = _mm_sub_ps(z, tz);
+						dz = _mm_max_ps(dz, _mm_sub_ps(zero, dz));
+
+						//cos^128 between the normals by repeated squaring
+						Vec4 cosine = _mm_add_ps(_mm_add_ps(
+							_mm_mul_ps(nx, _mm_loadu_ps(normal[0] + tap)),
+							_mm_mul_ps(ny, _mm_loadu_ps(normal[1] + tap))),
+							_mm_mul_ps(nz, _mm_loadu_ps(normal[2] + tap)));
+						cosine = _mm_and_ps(cosine, _mm_cmpge_ps(cosine, mincosine));
+
+						for (int s = 0; s < s_normalSquarings; s++)
+						{
+							cosine = _mm_mul_ps(cosine, cosine);
+						}
+
+						Vec4 exponent = _mm_add_ps(_mm_mul_ps(colourdist, sigmacolour), _mm_mul_ps(dz, invz));
+						Vec4 weight = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(s_kernel[kx]*s_kernel[ky]), cosine), FastExp(_mm_sub_ps(zero, exponent)));
+						weight = _mm_and_ps(weight, _mm_cmpgt_ps(tz, zero));
+
+						sumr = _mm_add_ps(sumr, _mm_mul_ps(tr, weight));
+						sumg = _mm_add_ps(sumg, _mm_mul_ps(tg, weight));
+						sumb = _mm_add_ps(sumb, _mm_mul_ps(tb, weight));
+						sumw = _mm_add_ps(sumw, weight);
+					}
+				}
+
+				//keep the centre if nothing contributed, e.g. a pixel without a normal
+				Vec4 keep = _mm_or_ps(_mm_cmple_ps(sumw, zero), _mm_cmpeq_ps(valid, zero));
+				Vec4 invw = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(sumw, _mm_set1_ps(1e-20f)));
+
+				Vec4 r = _mm_mul_ps(sumr, invw);
+				Vec4 g = _mm_mul_ps(sumg, invw);
+				Vec4 b = _mm_mul_ps(sumb, invw);
+
+				_mm_storeu_ps(outcolour[0] + centre, _mm_or_ps(_mm_and_ps(keep, cr), _mm_andnot_ps(keep, r)));
+				_mm_storeu_ps(outcolour[1] + centre, _mm_or_ps(_mm_and_ps(keep, cg), _mm_andnot_ps(keep, g)));
+				_mm_storeu_ps(outcolour[2] + centre, _mm_or_ps(_mm_and_ps(keep, cb), _mm_andnot_ps(keep, b)));
+			}
+		}
+	}
+}
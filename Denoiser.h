@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include "Framebuffer.h"
+
+//An edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) for noisy path
+//traced frames. The colour is divided by the albedo AOV so texture detail isn't
+//blurred, then filtered with a 5x5 B3 spline kernel spread further apart on each
+//iteration. Taps are weighted down across changes in the normal and depth AOVs
+//and, with a tolerance that halves every iteration, in colour
+class Denoiser
+{
+	public:
+		enum
+		{
+			MAX_ITERATIONS = 5,			//kernel steps of 1, 2, 4, 8 and 16 pixels
+			TILE_WIDTH = 64,
+			TILE_HEIGHT = 16
+		};
+
+	private:
+		int		m_iterations;
+		float	m_sigmaColour;			//colour distance tolerance of the first iteration
+		float	m_sigmaDepth;			//depth difference tolerance relative to the depth of the pixel
+
+		//feature and colour planes, one float per pixel, padded on the left and right so the
+		//widest kernel never needs bounds checks. Padding has depth 0 and is never used
+		int						m_stride;
+		std::vector<float>		m_colour[2][3];
+		std::vector<float>		m_albedo[3];
+		std::vector<float>		m_normal[3];
+		std::vector<float>		m_depth;
+
+		double					m_lastTime;			//seconds taken by the last Denoise
+		double					m_totalTime;		//seconds taken by every Denoise so far
+		double					m_totalPixels;
+
+		void	FilterPass(int width, int height, int step, float invSigmaColourSqr, int src);
+
+	public:
+		Denoiser();
+		~Denoiser();
+
+		inline void SetIterations(int iterations)
+		{
+			m_iterations = iterations < 1 ? 1 : iterations > MAX_ITERATIONS ? MAX_ITERATIONS : iterations;
+		}
+
+		inline void SetSigmaColour(float sigma)
+		{
+			m_sigmaColour = sigma;
+		}
+
+		inline void SetSigmaDepth(float sigma)
+		{
+			m_sigmaDepth = sigma;
+		}
+
+		//Filter the beauty layer of the framebuffer in place, guided by its albedo, normal and
+		//depth layers, see Renderer::EnableAOVs. Returns false if a layer is missing
+		bool	Denoise(Framebuffer* framebuffer);
+
+		inline double GetLastTime() const
+		{
+			return m_lastTime;
+		}
+
+		//Print the time taken per frame and per megapixel over every frame denoised so far
+		void	PrintStats() const;
+};
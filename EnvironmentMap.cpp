@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "EnvironmentMap.h"
+#include "ImageIO.h"
+
+static const float s_pi = 3.14159265358979f;
+static const char s_magic[4] = { 'T', 'R', 'E', 'N' };
+static const int s_version = 1;
+
+static inline float Luminance(const float* rgb)
+{
+	float y = 0.2126f*rgb[0] + 0.7152f*rgb[1] + 0.0722f*rgb[2];
+
+	//NaNs and negative values are never picked
+	return y > 0.0f ? y : 0.0f;
+}
+
+EnvironmentMap::EnvironmentMap()
+{
+	m_width = 0;
+	m_height = 0;
+	m_intensity = 1.0f;
+}
+
+EnvironmentMap::~EnvironmentMap()
+{
+}
+
+bool EnvironmentMap::LoadFromFile(const char* filename)
+{
+	int width = 0, height = 0;
+	std::vector<float> texels;
+
+	size_t length = strlen(filename);
+
+	if (length > 4 && strcmp(filename + length - 4, ".pfm") == 0)
+	{
+		float* image;
+
+		if (ImageIO::LoadPFM(filename, &image, &width, &height) != E_IMAGEIO_SUCCESS)
+		{
+			printf("Error loading environment map: %s\n", filename);
+			return false;
+		}
+
+		texels.assign(image, image + (size_t)width*height*3);
+		delete[] image;
+	}
+	else
+	{
+		unsigned char* image;
+		int bpp, nchannels;
+
+		if (ImageIO::LoadTGA(filename, &image, &width, &height, &bpp, &nchannels) != E_IMAGEIO_SUCCESS)
+		{
+			printf("Error loading environment map: %s\n", filename);
+			return false;
+		}
+
+		texels.resize((size_t)width*height*3);
+
+		for (size_t i = 0; i < (size_t)width*height; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				texels[i*3 + c] = image[i*nchannels + c] / 255.0f;
+			}
+		}
+
+		delete[] image;
+	}
+
+	//both loaders give the bottom row first
+	m_width = width;
+	m_height = height;
+	m_texels.resize(texels.size());
+
+	size_t rowsize = (size_t)width*3;
+
+	for (int y = 0; y < height; y++)
+	{
+		memcpy(&m_texels[(size_t)y*rowsize], &texels[(size_t)(height - 1 - y)*rowsize], rowsize*sizeof(float));
+	}
+
+	//the tables are reused for as long as the image file is unchanged
+	std::string cachename = std::string(filename) + ".envdist";
+	struct stat source;
+	long long sourcesize = 0, sourcetime = 0;
+
+	if (stat(filename, &source) == 0)
+	{
+		sourcesize = (long long)source.st_size;
+		sourcetime = (long long)source.st_mtime;
+	}
+
+	if (!LoadDistribution(cachename.c_str(), sourcesize, sourcetime))
+	{
+		BuildDistribution();
+		SaveDistribution(cachename.c_str(), sourcesize, sourcetime);
+	}
+
+	return true;
+}
+
+void EnvironmentMap::SetImage(const float* rgb, int width, int height)
+{
+	m_width = width;
+	m_height = height;
+	m_texels.assign(rgb, rgb + (size_t)width*height*3);
+
+	BuildDistribution();
+}
+
+void EnvironmentMap::BuildAliasTable(const float* weights, int count, AliasEntry* table)
+{
+	double sum = 0.0;
+
+	for (int i = 0; i < count; i++)
+	{
+		sum += weights[i];
+	}
+
+	if (sum <= 0.0)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			table[i].probability = 1.0f;
+			table[i].alias = i;
+		}
+
+		return;
+	}
+
+	//Vose's method, pair each slot under the average with one over it
+	std::vector<double> scaled(count);
+	std::vector<int> small, large;
+
+	for (int i = 0; i < count; i++)
+	{
+		scaled[i] = weights[i] * count / sum;
+
+		if (scaled[i] < 1.0)
+			small.push_back(i);
+		else
+			large.push_back(i);
+	}
+
+	while (!small.empty() && !large.empty())
+	{
+		int s = small.back();
+		int l = large.back();
+		small.pop_back();
+		large.pop_back();
+
+		table[s].probability = (float)scaled[s];
+		table[s].alias = l;
+
+		scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+
+		if (scaled[l] < 1.0)
+			small.push_back(l);
+		else
+			large.push_back(l);
+	}
+
+	//whatever is left over is 1 up to rounding
+	for (size_t i = 0; i < large.size(); i++)
+	{
+		table[large[i]].probability = 1.0f;
+		table[large[i]].alias = large[i];
+	}
+
+	for (size_t i = 0; i < small.size(); i++)
+	{
+		table[small[i]].probability = 1.0f;
+		table[small[i]].alias = small[i];
+	}
+}
+
+int EnvironmentMap::SampleAliasTable(const AliasEntry* table, int count, float& u)
+{
+	//u picks the slot and whether to take its alias, what is left of it is
+	//rescaled to [0, 1) so it can be used again
+	u = u < 0.99999994f ? u : 0.99999994f;
+
+	float scaled = u * count;
+	int slot = (int)scaled;
+	slot = slot < count - 1 ? slot : count - 1;
+
+	float f = scaled - slot;
+	float p = table[slot].probability;
+
+	if (f < p)
+	{
+		u = f / p;
+		return slot;
+	}
+
+	u = (f - p) / (1.0f - p);
+	return table[slot].alias;
+}
+
+void EnvironmentMap::BuildDistribution()
+{
+	int width = m_width;
+	int height = m_height;
+
+	m_rows.resize(height);
+	m_texelTables.resize((size_t)width*height);
+	m_density.resize((size_t)width*height);
+
+	std::vector<float> rowweights(height);
+
+	//rows are independent so their tables are built in parallel. The image is squashed
+	//towards the poles so each texel is weighted by the solid angle it covers.
+	//m_density holds the texel weights until the total is known
+#pragma omp parallel for schedule (dynamic, 16)
+	for (int y = 0; y < height; y++)
+	{
+		float sintheta = sinf((y + 0.5f) * s_pi / height);
+		float* weights = &m_density[(size_t)y*width];
+		double rowsum = 0.0;
+
+		for (int x = 0; x < width; x++)
+		{
+			weights[x] = Luminance(&m_texels[((size_t)y*width + x)*3]) * sintheta;
+			rowsum += weights[x];
+		}
+
+		BuildAliasTable(weights, width, &m_texelTables[(size_t)y*width]);
+		rowweights[y] = (float)rowsum;
+	}
+
+	BuildAliasTable(&rowweights[0], height, &m_rows[0]);
+
+	double total = 0.0;
+
+	for (int y = 0; y < height; y++)
+	{
+		total += rowweights[y];
+	}
+
+	//a black map is sampled uniformly over the image
+	float scale = total > 0.0 ? (float)((double)width*height / total) : 0.0f;
+	int numtexels = width*height;
+
+#pragma omp parallel for schedule (static)
+	for (int i = 0; i < numtexels; i++)
+	{
+		m_density[i] = total > 0.0 ? m_density[i] * scale : 1.0f;
+	}
+}
+
+bool EnvironmentMap::LoadDistribution(const char* filename, long long sourceSize, long long sourceTime)
+{
+	FILE* file = fopen(filename, "rb");
+
+	if (!file)
+		return false;
+
+	char magic[4];
+	int header[3];
+	long long source[2];
+	size_t numtexels = (size_t)m_width*m_height;
+
+	bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, s_magic, 4) == 0 &&
+		fread(header, sizeof(int), 3, file) == 3 && fread(source, sizeof(long long), 2, file) == 2 &&
+		header[0] == s_version && header[1] == m_width && header[2] == m_height &&
+		source[0] == sourceSize && source[1] == sourceTime;
+
+	if (ok)
+	{
+		m_rows.resize(m_height);
+		m_texelTables.resize(numtexels);
+		m_density.resize(numtexels);
+
+		ok = fread(&m_rows[0], sizeof(AliasEntry), m_height, file) == (size_t)m_height &&
+			fread(&m_texelTables[0], sizeof(AliasEntry), numtexels, file) == numtexels &&
+			fread(&m_density[0], sizeof(float), numtexels, file) == numtexels;
+	}
+
+	fclose(file);
+
+	return ok;
+}
+
+bool EnvironmentMap::SaveDistribution(const char* filename, long long sourceSize, long long sourceTime) const
+{
+	FILE* file = fopen(filename, "wb");
+
+	//not being able to write the cache only costs time on the next load
+	if (!file)
+		return false;
+
+	int header[3] = { s_version, m_width, m_height };
+	long long source[2] = { sourceSize, sourceTime };
+	size_t numtexels = (size_t)m_width*m_height;
+
+	bool ok = fwrite(s_magic, 1, 4, file) == 4 && fwrite(header, sizeof(int), 3, file) == 3 &&
+		fwrite(source, sizeof(long long), 2, file) == 2 &&
+		fwrite(&m_rows[0], sizeof(AliasEntry), m_height, file) == (size_t)m_height &&
+		fwrite(&m_texelTables[0], sizeof(AliasEntry), numtexels, file) == numtexels &&
+		fwrite(&m_density[0], sizeof(float), numtexels, file) == numtexels;
+
+	fclose(file);
+
+	if (!ok)
+		remove(filename);
+
+	return ok;
+}
+
+inline int EnvironmentMap::GetTexelIndex(const Vector3& dir) const
+{
+	float y = dir[1] < -1.0f ? -1.0f : dir[1] > 1.0f ? 1.0f : dir[1];
+	float theta = acosf(y);
+	float phi = atan2f(dir[2], dir[0]);
+
+	if (phi < 0.0f)
+		phi += 2.0f * s_pi;
+
+	int column = (int)(phi * m_width / (2.0f * s_pi));
+	int row = (int)(theta * m_height / s_pi);
+
+	column = column < m_width - 1 ? column : m_width - 1;
+	row = row < m_height - 1 ? row : m_height - 1;
+
+	return row*m_width + column;
+}
+
+Colour EnvironmentMap::Lookup(const Vector3& dir) const
+{
+	const float* texel = &m_texels[(size_t)GetTexelIndex(dir)*3];
+
+	return Colour(texel[0], texel[1], texel[2]) * m_intensity;
+}
+
+Colour EnvironmentMap::Sample(float u1, float u2, Vector3& dir, float& pdf) const
+{
+	int row = SampleAliasTable(&m_rows[0], m_height, u1);
+	int column = SampleAliasTable(&m_texelTables[(size_t)row*m_width], m_width, u2);
+
+	//the leftovers of u1 and u2 place the direction within the texel
+	float theta = (row + u1) * s_pi / m_height;
+	float phi = (column + u2) * 2.0f * s_pi / m_width;
+	float sintheta = sinf(theta);
+
+	dir = Vector3(sintheta * cosf(phi), cosf(theta), sintheta * sinf(phi));
+
+	//the image covers 2pi by pi radians, and a texel's solid angle shrinks with sin(theta)
+	size_t index = (size_t)row*m_width + column;
+	pdf = sintheta > 0.0f ? m_density[index] / (2.0f * s_pi * s_pi * sintheta) : 0.0f;
+
+	const float* texel = &m_texels[index*3];
+
+	return Colour(texel[0], texel[1], texel[2]) * m_intensity;
+}
+
+float EnvironmentMap::GetPdf(const Vector3& dir) const
+{
+	float sintheta = sqrtf(fmaxf(0.0f, 1.0f - dir[1]*dir[1]));
+
+	return sintheta > 0.0f ? m_density[GetTexelIndex(dir)] / (2.0f * s_pi * s_pi * sintheta) : 0.0f;
+}
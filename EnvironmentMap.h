@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include "Material.h"
+
+//Light arriving from infinitely far away, stored as a lat-long image. The top row
+//looks straight up (+y) and the left edge looks along +x, turning towards +z.
+//Directions can be sampled in proportion to the brightness of the image so that
+//small bright regions such as the sun are found with few samples
+class EnvironmentMap
+{
+	private:
+		//one slot of a Walker alias table: the slot is kept with the given probability,
+		//otherwise its alias is taken
+		struct AliasEntry
+		{
+			float	probability;
+			int		alias;
+		};
+
+		int							m_width;
+		int							m_height;
+		float						m_intensity;
+		std::vector<float>			m_texels;			//RGB, top row first
+
+		//sampling distribution, picking a row from m_rows then a texel from that row's
+		//table in m_texelTables. m_density is the probability of each texel times the
+		//number of texels, i.e. the density over the unit square of the image
+		std::vector<AliasEntry>		m_rows;
+		std::vector<AliasEntry>		m_texelTables;
+		std::vector<float>			m_density;
+
+		static void		BuildAliasTable(const float* weights, int count, AliasEntry* table);
+		static int		SampleAliasTable(const AliasEntry* table, int count, float& u);
+
+		void	BuildDistribution();
+		bool	LoadDistribution(const char* filename, long long sourceSize, long long sourceTime);
+		bool	SaveDistribution(const char* filename, long long sourceSize, long long sourceTime) const;
+
+		inline int GetTexelIndex(const Vector3& dir) const;
+
+	public:
+		EnvironmentMap();
+		~EnvironmentMap();
+
+		//Load a lat-long image from a PFM, or from a TGA taken to be in linear colour, and
+		//prepare it for sampling. The sampling tables are cached in filename.envdist and only
+		//rebuilt when the image changes
+		bool	LoadFromFile(const char* filename);
+
+		//Use an image already in memory, RGB floats with the top row first
+		void	SetImage(const float* rgb, int width, int height);
+
+		//Scale applied to the radiance of the whole map
+		inline void SetIntensity(float intensity)
+		{
+			m_intensity = intensity;
+		}
+
+		inline bool IsValid() const
+		{
+			return !m_texels.empty();
+		}
+
+		//Radiance arriving along -dir, i.e. seen looking along the unit vector dir
+		Colour	Lookup(const Vector3& dir) const;
+
+		//Pick a direction using two uniform numbers in [0, 1). Returns the radiance
+		//arriving from it and the probability density of the pick per steradian
+		Colour	Sample(float u1, float u2, Vector3& dir, float& pdf) const;
+
+		//Probability density per steradian that Sample picks dir
+		float	GetPdf(const Vector3& dir) const;
+};
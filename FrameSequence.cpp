@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <string>
+#include "FrameSequence.h"
+#include "ImageIO.h"
+#include "TileServer.h"
+#include "Profiler.h"
+
+FrameSequence::FrameSequence(Renderer* renderer) : m_encoder(1)
+{
+	m_renderer = renderer;
+	m_encodeFailed = false;
+	m_checkpointInterval = 60.0;
+	m_tileServer = NULL;
+}
+
+FrameSequence::~FrameSequence()
+{
+	m_encoder.Wait();
+}
+
+void FrameSequence::EncodeFrame(const char* filename)
+{
+	PROFILE_SCOPE("WriteImage");
+
+	int width = m_renderer->m_buffWidth;
+	int height = m_renderer->m_buffHeight;
+	int size = width*height;
+
+	const PendingLayer& beauty = m_pending[0];
+	int rowSize = width*Framebuffer::GetPixelSize(beauty.format);
+
+	m_pixels.resize(size*3);
+	m_row.resize(width);
+
+	//decode a row at a time so compact framebuffers are never expanded whole
+	for (int y = 0; y < height; y++)
+	{
+		Framebuffer::DecodePixels(beauty.format, &beauty.data[(size_t)y*rowSize], &m_row[0], width);
+
+		for (int x = 0; x < width; x++)
+		{
+			int i = y*width + x;
+
+			for (int c = 0; c < 3; c++)
+			{
+				float value = m_row[x][c];
+				value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+				m_pixels[i*3 + c] = (unsigned char)(value*255.0f + 0.5f);
+			}
+		}
+	}
+
+	if (ImageIO::SaveTGA(filename, &m_pixels[0], width, height, 3) != E_IMAGEIO_SUCCESS)
+	{
+		m_encodeFailed = true;
+	}
+
+	//the layers go next to the frame, with the layer name in place of the extension
+	std::string base = filename;
+	size_t dot = base.find_last_of('.');
+	size_t slash = base.find_last_of("/\\");
+
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+		base.erase(dot);
+
+	for (size_t i = 1; i < m_pending.size(); i++)
+	{
+		std::string layerfile = base + "." + m_pending[i].name + ".pfm";
+
+		if (!EncodeLayer(m_pending[i], layerfile.c_str()))
+			m_encodeFailed = true;
+	}
+}
+
+bool FrameSequence::EncodeLayer(const PendingLayer& layer, const char* filename)
+{
+	int width = m_renderer->m_buffWidth;
+	int height = m_renderer->m_buffHeight;
+	int rowSize = width*Framebuffer::GetPixelSize(layer.format);
+
+	m_floats.resize((size_t)width*height*3);
+	m_row.resize(width);
+
+	for (int y = 0; y < height; y++)
+	{
+		Framebuffer::DecodePixels(layer.format, &layer.data[(size_t)y*rowSize], &m_row[0], width);
+
+		float* dst = &m_floats[(size_t)y*width*3];
+
+		for (int x = 0; x < width; x++)
+		{
+			dst[x*3] = m_row[x][0];
+			dst[x*3 + 1] = m_row[x][1];
+			dst[x*3 + 2] = m_row[x][2];
+		}
+	}
+
+	return ImageIO::SavePFM(filename, &m_floats[0], width, height) == E_IMAGEIO_SUCCESS;
+}
+
+bool FrameSequence::Render(Scene* pScene, const CameraPath& path, int numFrames, const char* filePattern)
+{
+	m_encodeFailed = false;
+
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		float s = numFrames > 1 ? (float)frame / (float)(numFrames - 1) : 0.0f;
+		float time = path.GetStartTime() + s*(path.GetEndTime() - path.GetStartTime());
+
+		path.ApplyToCamera(pScene->GetSceneCamera(), time);
+		pScene->UpdateAccelerationStructure();
+
+		if (!m_checkpointPattern.empty())
+		{
+			char checkpoint[1024];
+			snprintf(checkpoint, sizeof(checkpoint), m_checkpointPattern.c_str(), frame);
+			m_renderer->SetCheckpoint(checkpoint, m_checkpointInterval);
+		}
+
+		if (m_tileServer)
+			m_tileServer->RenderFrame(pScene);
+		else
+			m_renderer->RenderFrame(pScene);
+
+		//the previous frame has had the whole trace to finish encoding, so the copy is free to reuse
+		{
+			PROFILE_SCOPE("WaitForEncoder");
+			m_encoder.Wait();
+		}
+
+		const Framebuffer* framebuffer = m_renderer->GetFramebuffer();
+		m_pending.resize(framebuffer->GetNumLayers());
+
+		for (int layer = 0; layer < framebuffer->GetNumLayers(); layer++)
+		{
+			const unsigned char* data = framebuffer->GetLayerData(layer);
+
+			m_pending[layer].name = framebuffer->GetLayerName(layer);
+			m_pending[layer].format = framebuffer->GetLayerFormat(layer);
+			m_pending[layer].data.assign(data, data + framebuffer->GetLayerDataSize(layer));
+		}
+
+		char filename[1024];
+		snprintf(filename, sizeof(filename), filePattern, frame);
+		std::string name = filename;
+
+		m_encoder.Submit([this, name]() { EncodeFrame(name.c_str()); });
+
+		fprintf(stdout, "\nFrame %d/%d -> %s\n", frame + 1, numFrames, filename);
+	}
+
+	m_encoder.Wait();
+
+	return !m_encodeFailed;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include "Renderer.h"
+#include "Scene.h"
+#include "CameraPath.h"
+#include "ThreadPool.h"
+
+class TileServer;
+
+//Renders a camera animation to a numbered sequence of TGA files. The scene,
+//its acceleration structure and the renderer are kept across frames, and the
+//previous frame is quantised and written on a background thread while the
+//next one is traced. Any other framebuffer layers, e.g. AOVs, are written next
+//to each frame as PFM files named after the layer, frame0001.albedo.pfm
+class FrameSequence
+{
+	private:
+		Renderer*					m_renderer;
+		ThreadPool					m_encoder;
+		//copy of a framebuffer layer being encoded, in its storage format
+		struct PendingLayer
+		{
+			std::string					name;
+			Framebuffer::FORMAT			format;
+			std::vector<unsigned char>	data;
+		};
+
+		std::vector<PendingLayer>	m_pending;			//the beauty layer first
+		std::vector<Colour>			m_row;
+		std::vector<unsigned char>	m_pixels;
+		std::vector<float>			m_floats;
+		bool						m_encodeFailed;
+		std::string					m_checkpointPattern;	//printf pattern of the checkpoint file of each frame, empty for none
+		double						m_checkpointInterval;
+		TileServer*					m_tileServer;		//traces the frames on its workers, NULL to trace them here
+
+		void	EncodeFrame(const char* filename);
+		bool	EncodeLayer(const PendingLayer& layer, const char* filename);
+
+	public:
+		FrameSequence(Renderer* renderer);
+		~FrameSequence();
+
+		//Render numFrames frames spread evenly over the camera path. filePattern is a printf
+		//pattern taking the frame number, e.g. "frame%04d.tga". Returns false if a frame
+		//could not be written
+		bool	Render(Scene* pScene, const CameraPath& path, int numFrames, const char* filePattern);
+
+		//Give every frame its own checkpoint, see Renderer::SetCheckpoint. pattern takes the
+		//frame number as filePattern does, so a resumed sequence finds each frame's progress
+		inline void SetCheckpointPattern(const char* pattern, double interval)
+		{
+			m_checkpointPattern = pattern ? pattern : "";
+			m_checkpointInterval = interval;
+		}
+
+		//Hand the frames out to the workers of a tile server, which puts them together in the
+		//renderer's framebuffer. NULL to trace them with the renderer again
+		inline void SetTileServer(TileServer* server)
+		{
+			m_tileServer = server;
+		}
+};
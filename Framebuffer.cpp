@@ -8,39 +8,376 @@
 * however the author does not guarantee its performance.
 ---------------------------------------------------------------------*/
 #include <stdlib.h>
+#include <string.h>
 #include "Framebuffer.h"
 
+#if defined(__F16C__) || defined(__AVX2__)
+#define FRAMEBUFFER_F16C
+#endif
+
+static const char* s_formatNames[Framebuffer::FORMAT_COUNT] = { "rgba32f", "rgb32f", "rgba16f", "rgb9e5" };
+static const int s_pixelSizes[Framebuffer::FORMAT_COUNT] = { 16, 12, 8, 4 };
+
+#if !defined(FRAMEBUFFER_F16C)
+//Scalar conversions for CPUs without F16C, rounding to nearest even like the hardware
+static unsigned short FloatToHalf(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, 4);
+
+	unsigned int sign = (bits >> 16) & 0x8000;
+	unsigned int absbits = bits & 0x7fffffff;
+
+	if (absbits >= 0x7f800000)
+		return (unsigned short)(sign | 0x7c00 | (absbits > 0x7f800000 ? 0x200 | ((absbits >> 13) & 0x3ff) : 0));		//inf or quiet nan
+
+	if (absbits >= 0x477ff000)
+		return (unsigned short)(sign | 0x7c00);												//overflows to inf
+
+	if (absbits < 0x38800000)
+	{
+		//denormal half, shift the mantissa with its implicit bit into place
+		if (absbits < 0x33000000)
+			return (unsigned short)sign;
+
+		unsigned int exponent = absbits >> 23;
+		unsigned int mantissa = (absbits & 0x7fffff) | 0x800000;
+		unsigned int shift = 126 - exponent;
+		unsigned int half = mantissa >> shift;
+		unsigned int rest = mantissa & ((1u << shift) - 1);
+		unsigned int halfway = 1u << (shift - 1);
+
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+
+		return (unsigned short)(sign | half);
+	}
+
+	//rebias the exponent and round the mantissa, a carry out of the mantissa bumps the exponent
+	unsigned int half = (absbits - 0x38000000) >> 13;
+	unsigned int rest = absbits & 0x1fff;
+
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+
+	return (unsigned short)(sign | half);
+}
+
+static float HalfToFloat(unsigned short half)
+{
+	unsigned int sign = (half & 0x8000) << 16;
+	unsigned int exponent = (half >> 10) & 0x1f;
+	unsigned int mantissa = half & 0x3ff;
+	unsigned int bits;
+
+	if (exponent == 0x1f)
+	{
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else if (exponent == 0)
+	{
+		float value = (float)mantissa * (1.0f / 16777216.0f);		//2^-24
+		return sign ? -value : value;
+	}
+	else
+	{
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+
+	float value;
+	memcpy(&value, &bits, 4);
+	return value;
+}
+#endif
+
+//Largest value RGB9E5 can hold, (2^9 - 1)/2^9 * 2^(31 - 15)
+static const float s_maxRGB9E5 = 65408.0f;
+
+static inline unsigned int EncodeRGB9E5(Vec4 colour)
+{
+	//clamp to the representable range, _mm_max_ps returns the second operand for NaNs so they become 0
+	Vec4 c = _mm_min_ps(_mm_max_ps(colour, _mm_setzero_ps()), _mm_set1_ps(s_maxRGB9E5));
+
+	Vec4 maxc = _mm_max_ps(c, _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+	maxc = _mm_max_ps(maxc, _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 1, 0, 2)));
+	float maxvalue = _mm_cvtss_f32(maxc);
+
+	//the shared exponent is chosen so the largest channel fits 9 bits, read floor(log2) from the float bits
+	int maxbits = _mm_cvtsi128_si32(_mm_castps_si128(maxc));
+	int exponent = ((maxbits >> 23) & 0xff) - 127;
+	exponent = (exponent < -16 ? -16 : exponent) + 16;
+
+	//2^(9 - exponent + 15) built from its bits, so the scale is exact
+	Vec4 scale = _mm_castsi128_ps(_mm_set1_epi32((127 + 24 - exponent) << 23));
+
+	if ((int)(maxvalue * _mm_cvtss_f32(scale) + 0.5f) == 512)
+	{
+		exponent++;
+		scale = _mm_castsi128_ps(_mm_set1_epi32((127 + 24 - exponent) << 23));
+	}
+
+	__m128i mantissas = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c, scale), _mm_set1_ps(0.5f)));
+
+	unsigned int r = (unsigned int)_mm_cvtsi128_si32(mantissas);
+	unsigned int g = (unsigned int)_mm_cvtsi128_si32(_mm_shuffle_epi32(mantissas, _MM_SHUFFLE(1, 1, 1, 1)));
+	unsigned int b = (unsigned int)_mm_cvtsi128_si32(_mm_shuffle_epi32(mantissas, _MM_SHUFFLE(2, 2, 2, 2)));
+
+	return r | (g << 9) | (b << 18) | ((unsigned int)exponent << 27);
+}
+
+static inline Vec4 DecodeRGB9E5(unsigned int packed)
+{
+	__m128i mantissas = _mm_and_si128(
+		_mm_set_epi32(0, (int)(packed >> 18), (int)(packed >> 9), (int)packed), _mm_set1_epi32(0x1ff));
+
+	int exponent = (int)(packed >> 27);
+	Vec4 scale = _mm_castsi128_ps(_mm_set1_epi32((127 + exponent - 24) << 23));
+
+	return _mm_mul_ps(_mm_cvtepi32_ps(mantissas), scale);
+}
+
+static inline void EncodePixel(Framebuffer::FORMAT format, Vec4 colour, unsigned char* dst)
+{
+	switch (format)
+	{
+	case Framebuffer::FORMAT_RGBA32F:
+		_mm_storeu_ps((float*)dst, colour);
+		break;
+	case Framebuffer::FORMAT_RGB32F:
+		_mm_storel_pi((__m64*)dst, colour);
+		_mm_store_ss((float*)dst + 2, _mm_movehl_ps(colour, colour));
+		break;
+	case Framebuffer::FORMAT_RGBA16F:
+#if defined(FRAMEBUFFER_F16C)
+		_mm_storel_epi64((__m128i*)dst, _mm_cvtps_ph(colour, 0));
+#else
+		{
+			const float* c = (const float*)&colour;
+			unsigned short* half = (unsigned short*)dst;
+
+			for (int i = 0; i < 4; i++)
+			{
+				half[i] = FloatToHalf(c[i]);
+			}
+		}
+#endif
+		break;
+	case Framebuffer::FORMAT_RGB9E5:
+		*(unsigned int*)dst = EncodeRGB9E5(colour);
+		break;
+	default:
+		break;
+	}
+}
+
+static inline Vec4 DecodePixel(Framebuffer::FORMAT format, const unsigned char* src)
+{
+	switch (format)
+	{
+	case Framebuffer::FORMAT_RGBA32F:
+		return _mm_loadu_ps((const float*)src);
+	case Framebuffer::FORMAT_RGB32F:
+		{
+			Vec4 xy = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)src);
+			return _mm_movelh_ps(xy, _mm_load_ss((const float*)src + 2));
+		}
+	case Framebuffer::FORMAT_RGBA16F:
+#if defined(FRAMEBUFFER_F16C)
+		return _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)src));
+#else
+		{
+			const unsigned short* half = (const unsigned short*)src;
+			return _mm_set_ps(HalfToFloat(half[3]), HalfToFloat(half[2]), HalfToFloat(half[1]), HalfToFloat(half[0]));
+		}
+#endif
+	case Framebuffer::FORMAT_RGB9E5:
+		return DecodeRGB9E5(*(const unsigned int*)src);
+	default:
+		return _mm_setzero_ps();
+	}
+}
+
+static const char* s_beautyLayer = "beauty";
+
 Framebuffer::Framebuffer()
 {
 	mWidth = 0;
 	mHeight = 0;
+	mFormat = FORMAT_RGBA32F;
+	mData = NULL;
 	mColourBuffer = NULL;
 }
 
-Framebuffer::Framebuffer(int width, int height)
+Framebuffer::Framebuffer(int width, int height, FORMAT format)
 {
-	InitFramebuffer(width, height);
+	InitFramebuffer(width, height, format);
 }
 
 Framebuffer::~Framebuffer()
 {
-	delete[] mColourBuffer;
+	if (mFormat == FORMAT_RGBA32F)
+	{
+		delete[] mColourBuffer;
+	}
+	else
+	{
+		delete[] mData;
+		delete[] mColourBuffer;
+	}
 }
 
 void Framebuffer::WriteRGBToFramebuffer(const Colour & colour, int x, int y)
 {
 	int offset = y*mWidth + x;
 
-	*(mColourBuffer + offset) = colour;
+	EncodePixel(mFormat, colour.GetVec4(), mData + (size_t)offset*s_pixelSizes[mFormat]);
+}
+
+Colour Framebuffer::ReadRGBFromFramebuffer(int x, int y) const
+{
+	int offset = y*mWidth + x;
+
+	return Colour(DecodePixel(mFormat, mData + (size_t)offset*s_pixelSizes[mFormat]));
+}
+
+int Framebuffer::AddLayer(const char *name, FORMAT format)
+{
+	int existing = FindLayer(name);
+
+	if (existing >= 0)
+		return existing;
+
+	Layer layer;
+	layer.name = name;
+	layer.format = format;
+	layer.data.resize((size_t)mWidth*mHeight*s_pixelSizes[format], 0);
+	mLayers.push_back(layer);
+
+	return (int)mLayers.size();
+}
+
+int Framebuffer::FindLayer(const char *name) const
+{
+	if (strcmp(name, s_beautyLayer) == 0)
+		return 0;
+
+	for (size_t i = 0; i < mLayers.size(); i++)
+	{
+		if (mLayers[i].name == name)
+			return (int)i + 1;
+	}
+
+	return -1;
+}
+
+const char *Framebuffer::GetLayerName(int layer) const
+{
+	return layer == 0 ? s_beautyLayer : mLayers[layer - 1].name.c_str();
+}
+
+Framebuffer::FORMAT Framebuffer::GetLayerFormat(int layer) const
+{
+	return layer == 0 ? mFormat : mLayers[layer - 1].format;
+}
+
+const unsigned char *Framebuffer::GetLayerData(int layer) const
+{
+	return layer == 0 ? mData : &mLayers[layer - 1].data[0];
+}
+
+size_t Framebuffer::GetLayerDataSize(int layer) const
+{
+	return (size_t)mWidth*mHeight*s_pixelSizes[GetLayerFormat(layer)];
+}
+
+void Framebuffer::WriteLayer(int layer, const Colour &value, int x, int y)
+{
+	FORMAT format = GetLayerFormat(layer);
+	unsigned char* data = layer == 0 ? mData : &mLayers[layer - 1].data[0];
+
+	EncodePixel(format, value.GetVec4(), data + ((size_t)y*mWidth + x)*s_pixelSizes[format]);
+}
+
+Colour Framebuffer::ReadLayer(int layer, int x, int y) const
+{
+	FORMAT format = GetLayerFormat(layer);
+
+	return Colour(DecodePixel(format, GetLayerData(layer) + ((size_t)y*mWidth + x)*s_pixelSizes[format]));
+}
+
+Colour *Framebuffer::GetBuffer()
+{
+	if (mFormat != FORMAT_RGBA32F)
+	{
+		if (!mColourBuffer)
+			mColourBuffer = new Colour[mWidth*mHeight];
+
+		DecodePixels(mFormat, mData, mColourBuffer, mWidth*mHeight);
+	}
+
+	return mColourBuffer;
+}
+
+void Framebuffer::EncodePixels(FORMAT format, const Colour *src, void *dst, int count)
+{
+	unsigned char* out = (unsigned char*)dst;
+	int size = s_pixelSizes[format];
+
+	for (int i = 0; i < count; i++)
+	{
+		EncodePixel(format, src[i].GetVec4(), out + (size_t)i*size);
+	}
+}
+
+void Framebuffer::DecodePixels(FORMAT format, const void *src, Colour *dst, int count)
+{
+	const unsigned char* in = (const unsigned char*)src;
+	int size = s_pixelSizes[format];
+
+	for (int i = 0; i < count; i++)
+	{
+		dst[i] = Colour(DecodePixel(format, in + (size_t)i*size));
+	}
+}
+
+int Framebuffer::GetPixelSize(FORMAT format)
+{
+	return s_pixelSizes[format];
+}
+
+bool Framebuffer::ParseFormat(const char *name, FORMAT &format)
+{
+	for (int i = 0; i < FORMAT_COUNT; i++)
+	{
+		if (strcmp(name, s_formatNames[i]) == 0)
+		{
+			format = (FORMAT)i;
+			return true;
+		}
+	}
+
+	return false;
 }
 
-void Framebuffer::InitFramebuffer(int width, int height)
+void Framebuffer::InitFramebuffer(int width, int height, FORMAT format)
 {
 	int size = width*height;
 	mWidth = width;
 	mHeight = height;
+	mFormat = format;
 
-	mColourBuffer = new Colour[size];
+	//RGBA32F pixels are Colours already, so GetBuffer hands out the storage itself
+	if (format == FORMAT_RGBA32F)
+	{
+		mColourBuffer = new Colour[size];
+		mData = (unsigned char*)mColourBuffer;
+	}
+	else
+	{
+		mData = new unsigned char[(size_t)size*s_pixelSizes[format]];
+		memset(mData, 0, (size_t)size*s_pixelSizes[format]);
+		mColourBuffer = NULL;
+	}
 
 	//memset(mColourBuffer, 0, size*sizeof(PixelRGBA));
 }
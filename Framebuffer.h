@@ -9,36 +9,101 @@
 ---------------------------------------------------------------------*/
 #pragma once
 
+#include <string>
+#include <vector>
 #include "Material.h"
 
 
-//This class represent a RGBA colour framebuffer
+//This class represent a RGB colour framebuffer. Pixels are kept in one of several
+//storage formats and converted from and to Colour as they are written and read.
+//Besides the colour, or beauty, layer a framebuffer can hold named layers of the
+//same size, e.g. the AOVs a renderer fills in alongside the colour
 class Framebuffer
 {
+public:
+	enum FORMAT
+	{
+		FORMAT_RGBA32F = 0,		//one Colour per pixel, 16 bytes
+		FORMAT_RGB32F,			//three floats, 12 bytes, for accumulation
+		FORMAT_RGBA16F,			//four half floats, 8 bytes
+		FORMAT_RGB9E5,			//three 9 bit mantissas sharing a 5 bit exponent, 4 bytes, for display and AOVs
+		FORMAT_COUNT
+	};
+
 private:
 	int	mWidth;					//the width of framebuffer
 	int mHeight;				//the height of framebuffer
-	Colour *mColourBuffer;	//Storage for RGBA pixels as a linear array
+	FORMAT mFormat;				//storage format of the pixels
+	unsigned char *mData;		//Storage for the pixels as a linear array
+	Colour *mColourBuffer;		//the pixels converted by GetBuffer for formats other than RGBA32F
+
+	struct Layer
+	{
+		std::string					name;
+		FORMAT						format;
+		std::vector<unsigned char>	data;
+	};
+
+	std::vector<Layer> mLayers;	//layers after the beauty layer, which is layer 0
 
 	//Method for initialise the framebuffer
 	//input:	int width --- width of the buffer to be created
 	//			int height --- height of the buffer to be created
-	void InitFramebuffer(int width, int height);
+	//			FORMAT format --- storage format of the pixels
+	void InitFramebuffer(int width, int height, FORMAT format);
 
 	Framebuffer();
 
 public:
-	Framebuffer(int width, int height);
+	Framebuffer(int width, int height, FORMAT format = FORMAT_RGBA32F);
 	~Framebuffer();
 
 	inline int GetWidth() { return mWidth; }
 	inline int GetHeight() { return mHeight; }
+	inline FORMAT GetFormat() const { return mFormat; }
 
-	inline Colour *GetBuffer() const 
-	{ 
-		return mColourBuffer; 
+	//The pixels in their storage format
+	inline const unsigned char *GetData() const
+	{
+		return mData;
 	}
 
+	inline size_t GetDataSize() const
+	{
+		return (size_t)mWidth*mHeight*GetPixelSize(mFormat);
+	}
+
+	//The pixels as Colour. Formats other than RGBA32F are converted into a
+	//separate buffer on every call, so call this once the frame is done
+	Colour *GetBuffer();
+
 	void WriteRGBToFramebuffer(const Colour &colour, int x, int y);
+	Colour ReadRGBFromFramebuffer(int x, int y) const;
+
+	//Add a named layer cleared to 0, returns its index. Adding a name twice returns the existing layer
+	int AddLayer(const char *name, FORMAT format);
+	int FindLayer(const char *name) const;
+
+	inline int GetNumLayers() const
+	{
+		return (int)mLayers.size() + 1;
+	}
+
+	const char *GetLayerName(int layer) const;
+	FORMAT GetLayerFormat(int layer) const;
+	const unsigned char *GetLayerData(int layer) const;
+	size_t GetLayerDataSize(int layer) const;
+
+	void WriteLayer(int layer, const Colour &value, int x, int y);
+	Colour ReadLayer(int layer, int x, int y) const;
+
+	//Convert count pixels from Colour to a storage format and back
+	static void EncodePixels(FORMAT format, const Colour *src, void *dst, int count);
+	static void DecodePixels(FORMAT format, const void *src, Colour *dst, int count);
+
+	static int GetPixelSize(FORMAT format);
+
+	//Format from its name, e.g. "rgb9e5", returns false for an unknown name
+	static bool ParseFormat(const char *name, FORMAT &format);
 };
 
@@ -1,47 +1,173 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <vector>
 #include "ImageIO.h"
 
-EImageIOStatus ImageIO::LoadUncompressedTGA(unsigned char** buffer, int* sizeX, int* sizeY, int* bpp, int* nChannels, FILE* pf)
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define IMAGEIO_SSSE3
+#endif
+
+//Swap the first and third byte of every pixel, turning BGR(A) into RGB(A) and back
+static void SwizzleBGR(unsigned char* buffer, int numPixels, int nChannels)
+{
+	int dataSize = numPixels*nChannels;
+	int i = 0;
+
+#if defined(IMAGEIO_SSSE3)
+	if (nChannels == 3)
+	{
+		//16 BGR pixels span three registers, pixels 5 and 10 straddle two of them so their
+		//bytes are gathered from both, -1 in a mask zeroes the byte
+		const __m128i maskAa = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, -1);
+		const __m128i maskAb = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1);
+		const __m128i maskBa = _mm_setr_epi8(-1, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i maskBb = _mm_setr_epi8(0, -1, 4, 3, 2, 7, 6, 5, 10, 9, 8, 13, 12, 11, -1, 15);
+		const __m128i maskBc = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, -1);
+		const __m128i maskCb = _mm_setr_epi8(14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i maskCc = _mm_setr_epi8(-1, 3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13);
+
+		for (; i + 48 <= dataSize; i += 48)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(buffer + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(buffer + i + 16));
+			__m128i c = _mm_loadu_si128((const __m128i*)(buffer + i + 32));
+
+			__m128i outa = _mm_or_si128(_mm_shuffle_epi8(a, maskAa), _mm_shuffle_epi8(b, maskAb));
+			__m128i outb = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, maskBa), _mm_shuffle_epi8(b, maskBb)), _mm_shuffle_epi8(c, maskBc));
+			__m128i outc = _mm_or_si128(_mm_shuffle_epi8(b, maskCb), _mm_shuffle_epi8(c, maskCc));
+
+			_mm_storeu_si128((__m128i*)(buffer + i), outa);
+			_mm_storeu_si128((__m128i*)(buffer + i + 16), outb);
+			_mm_storeu_si128((__m128i*)(buffer + i + 32), outc);
+		}
+	}
+	else
+	{
+		const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+		for (; i + 16 <= dataSize; i += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(buffer + i));
+			_mm_storeu_si128((__m128i*)(buffer + i), _mm_shuffle_epi8(v, mask));
+		}
+	}
+#endif
+
+	for (; i < dataSize; i += nChannels)
+	{
+		unsigned char b = buffer[i];
+		buffer[i] = buffer[i+2];
+		buffer[i+2] = b;
+	}
+}
+
+static void FlipRows(unsigned char* buffer, int sizeX, int sizeY, int nChannels)
 {
-	unsigned char header[6];
+	int rowSize = sizeX*nChannels;
+	std::vector<unsigned char> row(rowSize);
 
-	if(fread(header, sizeof(header), 1, pf) == 0)
+	for (int y = 0; y < sizeY/2; y++)
+	{
+		unsigned char* top = buffer + y*rowSize;
+		unsigned char* bottom = buffer + (sizeY - 1 - y)*rowSize;
+
+		memcpy(&row[0], top, rowSize);
+		memcpy(top, bottom, rowSize);
+		memcpy(bottom, &row[0], rowSize);
+	}
+}
+
+EImageIOStatus ImageIO::LoadUncompressedTGA(unsigned char* buffer, int numPixels, int nChannels, FILE* pf)
+{
+	size_t dataSize = (size_t)numPixels*nChannels;
+
+	if(fread(buffer, 1, dataSize, pf) != dataSize)
 	{
 		return E_IMAGEIO_ERROR;
 	}
-	
-	*sizeX = ((int)header[1]<<8) | header[0];
-	*sizeY = ((int)header[3]<<8) | header[2];
-	*bpp = header[4];
-	
-	if( (*sizeX <= 0) || (*sizeY <= 0) || ((*bpp != 24) && (*bpp != 32)))
+
+	return E_IMAGEIO_SUCCESS;
+}
+
+EImageIOStatus ImageIO::LoadCompressedTGA(unsigned char* buffer, int numPixels, int nChannels, FILE* pf)
+{
+	//read the rest of the file in one go rather than a packet at a time
+	long start = ftell(pf);
+
+	if (start < 0 || fseek(pf, 0, SEEK_END) != 0)
 	{
 		return E_IMAGEIO_ERROR;
 	}
 
-	//NOW WE ARE PRETTY SURE the file contains proper image data.
-	//Allocate some memory for the buffer
-	*nChannels = (*bpp)>>3;
-	int dataSize = (*sizeX)*(*sizeY)*(*nChannels);
-	*buffer = new unsigned char[dataSize];
+	long end = ftell(pf);
 
-	if(buffer == NULL)
+	if (end <= start || fseek(pf, start, SEEK_SET) != 0)
 	{
 		return E_IMAGEIO_ERROR;
 	}
 
-	if(fread(*buffer, 1, dataSize, pf) != dataSize)
+	std::vector<unsigned char> data(end - start);
+
+	if (fread(&data[0], 1, data.size(), pf) != data.size())
 	{
-		delete [] (*buffer);
-		*buffer = NULL;
 		return E_IMAGEIO_ERROR;
 	}
-	
-	for(int cswap = 0; cswap < dataSize; cswap += (*nChannels))
+
+	const unsigned char* src = &data[0];
+	const unsigned char* srcEnd = src + data.size();
+	unsigned char* dst = buffer;
+	int pixel = 0;
+
+	//each packet starts with a byte holding the pixel count less one in the low 7 bits,
+	//the top bit set means one pixel repeated count times, clear means count literal pixels.
+	//Packets may run over the end of a row but never over the end of the image
+	while (pixel < numPixels)
 	{
-		(*buffer)[cswap] ^= (*buffer)[cswap+2]^=(*buffer)[cswap] ^= (*buffer)[cswap+2];
+		if (src >= srcEnd)
+		{
+			return E_IMAGEIO_ERROR;
+		}
+
+		int packet = *src++;
+		int count = (packet & 0x7f) + 1;
+
+		if (pixel + count > numPixels)
+		{
+			return E_IMAGEIO_ERROR;
+		}
+
+		if (packet & 0x80)
+		{
+			if (srcEnd - src < nChannels)
+			{
+				return E_IMAGEIO_ERROR;
+			}
+
+			for (int i = 0; i < count; i++)
+			{
+				memcpy(dst, src, nChannels);
+				dst += nChannels;
+			}
+
+			src += nChannels;
+		}
+		else
+		{
+			int bytes = count*nChannels;
+
+			if (srcEnd - src < bytes)
+			{
+				return E_IMAGEIO_ERROR;
+			}
+
+			memcpy(dst, src, bytes);
+			dst += bytes;
+			src += bytes;
+		}
+
+		pixel += count;
 	}
 
 	return E_IMAGEIO_SUCCESS;
@@ -51,51 +177,234 @@ EImageIOStatus ImageIO::LoadTGA(const char* filename, unsigned char** buffer, in
 {
 	FILE* pfile = NULL;
 	EImageIOStatus result = E_IMAGEIO_SUCCESS;
-	errno_t err = 0;
-	unsigned char header[12];
-	unsigned char UncompressedTGASigniture[12] = {0,0,2,0,0,0,0,0,0,0,0,0}; 
-	unsigned char CompressedTGASigniture[12] = {0,0,10,0,0,0,0,0,0,0,0,0}; 
+	unsigned char header[18];
 
 	*buffer = NULL;
 
 #if defined(WINDOWS) || defined(WIN32)
-	err = fopen_s(&pfile, filename, "rb");
+	if (fopen_s(&pfile, filename, "rb"))
+		pfile = NULL;
 #else
 	pfile = fopen(filename, "rb");
 #endif
-	if (err)
+	if(!pfile)
+	{
+		return E_IMAGEIO_FILENOTFOUND;
+	}
+
+	if(fread(header, sizeof(header), 1, pfile) != 1)
+	{
+		fclose(pfile);
+		return E_IMAGEIO_ERROR;
+	}
+
+	int imageType = header[2];
+	*sizeX = ((int)header[13]<<8) | header[12];
+	*sizeY = ((int)header[15]<<8) | header[14];
+	*bpp = header[16];
+
+	//only true colour images without a colour map are supported, uncompressed (type 2) or RLE (type 10)
+	if( (header[1] != 0) || ((imageType != 2) && (imageType != 10)) ||
+		(*sizeX <= 0) || (*sizeY <= 0) || ((*bpp != 24) && (*bpp != 32)))
+	{
+		fclose(pfile);
+		return E_IMAGEIO_ERROR;
+	}
+
+	//skip the image ID field
+	if((header[0] > 0) && (fseek(pfile, header[0], SEEK_CUR) != 0))
+	{
+		fclose(pfile);
+		return E_IMAGEIO_ERROR;
+	}
+
+	*nChannels = (*bpp)>>3;
+	int numPixels = (*sizeX)*(*sizeY);
+	*buffer = new unsigned char[numPixels*(*nChannels)];
+
+	if (imageType == 2)
+		result = LoadUncompressedTGA(*buffer, numPixels, *nChannels, pfile);
+	else
+		result = LoadCompressedTGA(*buffer, numPixels, *nChannels, pfile);
+
+	fclose(pfile);
+
+	if (result != E_IMAGEIO_SUCCESS)
+	{
+		delete [] (*buffer);
+		*buffer = NULL;
+		return result;
+	}
+
+	SwizzleBGR(*buffer, numPixels, *nChannels);
+
+	//bit 5 of the image descriptor marks a top-left origin, buffers are returned bottom row first
+	if (header[17] & 0x20)
+		FlipRows(*buffer, *sizeX, *sizeY, *nChannels);
+
+	return E_IMAGEIO_SUCCESS;
+}
+
+EImageIOStatus ImageIO::SaveTGA(const char* filename, const unsigned char* buffer, int sizeX, int sizeY, int nChannels)
+{
+	FILE* pfile = NULL;
+	unsigned char header[18] = {0,0,2,0,0,0,0,0,0,0,0,0};
+
+	if ((nChannels != 3) && (nChannels != 4))
+	{
+		return E_IMAGEIO_ERROR;
+	}
+
+#if defined(WINDOWS) || defined(WIN32)
+	if (fopen_s(&pfile, filename, "wb"))
+		pfile = NULL;
+#else
+	pfile = fopen(filename, "wb");
+#endif
+	if (!pfile)
 	{
 		printf("Error opening image file: %s\n", filename);
 		return E_IMAGEIO_ERROR;
 	}
 
-	if(!pfile)
+	header[12] = sizeX & 0xff;
+	header[13] = (sizeX >> 8) & 0xff;
+	header[14] = sizeY & 0xff;
+	header[15] = (sizeY >> 8) & 0xff;
+	header[16] = nChannels << 3;
+	header[17] = nChannels == 4 ? 8 : 0;		//alpha bits, bottom-left origin
+
+	int rowSize = sizeX*nChannels;
+	unsigned char* row = new unsigned char[rowSize];
+	EImageIOStatus result = E_IMAGEIO_SUCCESS;
+
+	if (fwrite(header, sizeof(header), 1, pfile) != 1)
 	{
-		return E_IMAGEIO_FILENOTFOUND;
+		result = E_IMAGEIO_ERROR;
 	}
 
-	if(fread(header, sizeof(header), 1, pfile) == 0)
+	//TGA stores BGR(A)
+	for (int y = 0; y < sizeY && result == E_IMAGEIO_SUCCESS; y++)
 	{
+		memcpy(row, buffer + y*rowSize, rowSize);
+		SwizzleBGR(row, sizeX, nChannels);
+
+		if (fwrite(row, 1, rowSize, pfile) != (size_t)rowSize)
+		{
+			result = E_IMAGEIO_ERROR;
+		}
+	}
+
+	delete [] row;
+	fclose(pfile);
+
+	return result;
+}
+
+EImageIOStatus ImageIO::SavePFM(const char* filename, const float* buffer, int sizeX, int sizeY)
+{
+	FILE* pfile = NULL;
+
+#if defined(WINDOWS) || defined(WIN32)
+	if (fopen_s(&pfile, filename, "wb"))
+		pfile = NULL;
+#else
+	pfile = fopen(filename, "wb");
+#endif
+	if (!pfile)
+	{
+		printf("Error opening image file: %s\n", filename);
 		return E_IMAGEIO_ERROR;
 	}
-	
-	if(memcmp(UncompressedTGASigniture, header, sizeof(header))==0)
+
+	//a negative scale marks little endian floats, rows are stored bottom to top like the buffer
+	EImageIOStatus result = E_IMAGEIO_SUCCESS;
+	size_t dataSize = (size_t)sizeX*sizeY*3;
+
+	if (fprintf(pfile, "PF\n%d %d\n-1.0\n", sizeX, sizeY) < 0 ||
+		fwrite(buffer, sizeof(float), dataSize, pfile) != dataSize)
+	{
+		result = E_IMAGEIO_ERROR;
+	}
+
+	fclose(pfile);
+
+	return result;
+}
+
+EImageIOStatus ImageIO::LoadPFM(const char* filename, float** buffer, int* sizeX, int* sizeY)
+{
+	FILE* pfile = NULL;
+
+	*buffer = NULL;
+
+#if defined(WINDOWS) || defined(WIN32)
+	if (fopen_s(&pfile, filename, "rb"))
+		pfile = NULL;
+#else
+	pfile = fopen(filename, "rb");
+#endif
+	if (!pfile)
 	{
-		//TODO: load uncompressed tga
-		result = LoadUncompressedTGA(buffer, sizeX, sizeY, bpp, nChannels, pfile);
+		return E_IMAGEIO_FILENOTFOUND;
 	}
-	else if(memcmp(UncompressedTGASigniture, header, sizeof(header))==0)
+
+	//"PF" is colour and "Pf" greyscale, the sign of the scale gives the byte order
+	char type[3] = { 0 };
+	int width = 0, height = 0;
+	float scale = 0.0f;
+
+	if (fscanf(pfile, "%2s %d %d %f", type, &width, &height, &scale) != 4 || fgetc(pfile) == EOF ||
+		type[0] != 'P' || (type[1] != 'F' && type[1] != 'f') || width <= 0 || height <= 0 || scale == 0.0f)
 	{
-		//TODO: load compressed tga
+		fclose(pfile);
+		return E_IMAGEIO_ERROR;
 	}
-	else
+
+	int nChannels = type[1] == 'F' ? 3 : 1;
+	size_t numValues = (size_t)width*height*nChannels;
+	float* data = new float[numValues];
+
+	if (fread(data, sizeof(float), numValues, pfile) != numValues)
 	{
-		//unrecognised header signiture.
+		delete[] data;
 		fclose(pfile);
 		return E_IMAGEIO_ERROR;
 	}
-	
+
 	fclose(pfile);
 
-	return result;	
+	unsigned int test = 1;
+	bool littleEndian = *(unsigned char*)&test == 1;
+
+	if ((scale < 0.0f) != littleEndian)
+	{
+		unsigned char* bytes = (unsigned char*)data;
+
+		for (size_t i = 0; i < numValues; i++)
+		{
+			unsigned char* b = bytes + i*4;
+			unsigned char t0 = b[0], t1 = b[1];
+			b[0] = b[3]; b[1] = b[2]; b[2] = t1; b[3] = t0;
+		}
+	}
+
+	if (nChannels == 1)
+	{
+		float* rgb = new float[numValues*3];
+
+		for (size_t i = 0; i < numValues; i++)
+		{
+			rgb[i*3] = rgb[i*3 + 1] = rgb[i*3 + 2] = data[i];
+		}
+
+		delete[] data;
+		data = rgb;
+	}
+
+	*buffer = data;
+	*sizeX = width;
+	*sizeY = height;
+
+	return E_IMAGEIO_SUCCESS;
 }
@@ -13,9 +13,21 @@ enum EImageIOStatus
 class ImageIO
 {
 	private:
-		static EImageIOStatus LoadUncompressedTGA(unsigned char** buffer, int* sizeX, int* sizeY, int* bpp, int* nChannels, FILE* pf); 
+		//Read numPixels pixels of BGR(A) data that follows the header into the buffer
+		static EImageIOStatus LoadUncompressedTGA(unsigned char* buffer, int numPixels, int nChannels, FILE* pf);
+		static EImageIOStatus LoadCompressedTGA(unsigned char* buffer, int numPixels, int nChannels, FILE* pf);
 	public:
+		//Load an uncompressed or RLE compressed 24 or 32 bit TGA as RGB(A) rows, bottom row first
 		static EImageIOStatus LoadTGA(const char* filename, unsigned char** buffer, int* sizeX, int* sizeY, int* bpp, int* nChannels);
+
+		//Write an uncompressed TGA from RGB or RGBA rows, bottom row first
+		static EImageIOStatus SaveTGA(const char* filename, const unsigned char* buffer, int sizeX, int sizeY, int nChannels);
+
+		//Write a colour PFM from RGB float rows, bottom row first
+		static EImageIOStatus SavePFM(const char* filename, const float* buffer, int sizeX, int sizeY);
+
+		//Load a colour or greyscale PFM as RGB float rows, bottom row first. The buffer is allocated with new[]
+		static EImageIOStatus LoadPFM(const char* filename, float** buffer, int* sizeX, int* sizeY);
 };
 
 #endif
@@ -0,0 +1,182 @@
+#include <math.h>
+#include "IrradianceCache.h"
+
+IrradianceCache::IrradianceCache()
+{
+	m_root = -1;
+	m_accuracy = 0.25f;
+	m_gatherSamples = 256;
+	m_minSpacing = 0.5f;
+	m_maxSpacing = 20.0f;
+}
+
+IrradianceCache::~IrradianceCache()
+{
+}
+
+void IrradianceCache::Clear()
+{
+	m_records.clear();
+	m_nodes.clear();
+	m_root = -1;
+}
+
+int IrradianceCache::AddNode(const Vector3& centre, float halfSize)
+{
+	Node node;
+	node.centre = centre;
+	node.halfSize = halfSize;
+
+	for (int i = 0; i < 8; i++)
+	{
+		node.children[i] = -1;
+	}
+
+	m_nodes.push_back(node);
+
+	return (int)m_nodes.size() - 1;
+}
+
+static inline bool Contains(const Vector3& centre, float halfSize, const Vector3& point)
+{
+	Vec4 d = _mm_sub_ps(point.GetVec4(), centre.GetVec4());
+	Vec4 absd = _mm_andnot_ps(_mm_set1_ps(-0.0f), d);
+
+	return (_mm_movemask_ps(_mm_cmple_ps(absd, _mm_set1_ps(halfSize))) & 0x7) == 0x7;
+}
+
+static inline int GetOctant(const Vector3& centre, const Vector3& point)
+{
+	return (point[0] >= centre[0] ? 1 : 0) | (point[1] >= centre[1] ? 2 : 0) | (point[2] >= centre[2] ? 4 : 0);
+}
+
+void IrradianceCache::GrowRoot(const Vector3& point, float validity)
+{
+	//double the root towards the point until it fits, the old root becomes one of the new root's children
+	while (!Contains(m_nodes[m_root].centre, m_nodes[m_root].halfSize, point) || m_nodes[m_root].halfSize < validity)
+	{
+		Vector3 centre = m_nodes[m_root].centre;
+		float halfsize = m_nodes[m_root].halfSize;
+
+		Vector3 newcentre(point[0] >= centre[0] ? centre[0] + halfsize : centre[0] - halfsize,
+			point[1] >= centre[1] ? centre[1] + halfsize : centre[1] - halfsize,
+			point[2] >= centre[2] ? centre[2] + halfsize : centre[2] - halfsize);
+
+		int oldroot = m_root;
+		m_root = AddNode(newcentre, halfsize * 2.0f);
+		m_nodes[m_root].children[GetOctant(newcentre, centre)] = oldroot;
+		m_nodes[m_root].bounds = m_nodes[oldroot].bounds;
+	}
+}
+
+void IrradianceCache::AddRecord(const Record& record)
+{
+	int index = (int)m_records.size();
+	m_records.push_back(record);
+
+	float validity = m_accuracy * record.radius;
+
+	if (m_root < 0)
+		m_root = AddNode(record.position, validity > 0.0f ? validity : 1.0f);
+
+	GrowRoot(record.position, validity);
+
+	Vector3 reach(validity, validity, validity);
+	BoundingBox sphere(record.position - reach, record.position + reach);
+
+	int node = m_root;
+	m_nodes[node].bounds.Expand(sphere);
+
+	for (int depth = 0; depth < MAX_DEPTH; depth++)
+	{
+		//children are half the size, go down while one would still cover the record
+		float childhalf = m_nodes[node].halfSize * 0.5f;
+
+		if (childhalf < validity)
+			break;
+
+		Vector3 centre = m_nodes[node].centre;
+		int octant = GetOctant(centre, record.position);
+		int child = m_nodes[node].children[octant];
+
+		if (child < 0)
+		{
+			Vector3 childcentre(centre[0] + ((octant & 1) ? childhalf : -childhalf),
+				centre[1] + ((octant & 2) ? childhalf : -childhalf),
+				centre[2] + ((octant & 4) ? childhalf : -childhalf));
+
+			child = AddNode(childcentre, childhalf);
+			m_nodes[node].children[octant] = child;
+		}
+
+		node = child;
+		m_nodes[node].bounds.Expand(sphere);
+	}
+
+	m_nodes[node].records.push_back(index);
+}
+
+float IrradianceCache::GetWeight(const Record& record, const Vector3& position, const Vector3& normal) const
+{
+	//most records reached in the octree are too far away, reject those before anything else
+	Vec4 offset = _mm_sub_ps(position.GetVec4(), record.position.GetVec4());
+	float distancesqr = Dot3(offset, offset);
+	float validity = m_accuracy * record.radius;
+
+	if (distancesqr >= validity * validity)
+		return 0.0f;
+
+	//records in front of the point see light the point can't, e.g. in a corner
+	Vec4 normalsum = _mm_add_ps(normal.GetVec4(), record.normal.GetVec4());
+	if (Dot3(offset, normalsum) < -0.1f * record.radius)
+		return 0.0f;
+
+	float ndotn = Dot3(normal.GetVec4(), record.normal.GetVec4());
+	float error = sqrtf(distancesqr) / record.radius + sqrtf(fmaxf(0.0f, 1.0f - ndotn));
+
+	return error < m_accuracy ? 1.0f / fmaxf(error, 1e-6f) : 0.0f;
+}
+
+void IrradianceCache::LookupNode(int nodeindex, const Vector3& position, const Vector3& normal, Colour& sum, float& weightsum) const
+{
+	const Node& node = m_nodes[nodeindex];
+
+	if (!node.bounds.Contains(position))
+		return;
+
+	for (size_t i = 0; i < node.records.size(); i++)
+	{
+		const Record& record = m_records[node.records[i]];
+		float weight = GetWeight(record, position, normal);
+
+		if (weight > 0.0f)
+		{
+			sum = sum + record.irradiance * weight;
+			weightsum += weight;
+		}
+	}
+
+	for (int i = 0; i < 8; i++)
+	{
+		if (node.children[i] >= 0)
+			LookupNode(node.children[i], position, normal, sum, weightsum);
+	}
+}
+
+bool IrradianceCache::Lookup(const Vector3& position, const Vector3& normal, Colour& irradiance) const
+{
+	if (m_root < 0)
+		return false;
+
+	Colour sum(0.0f, 0.0f, 0.0f);
+	float weightsum = 0.0f;
+
+	LookupNode(m_root, position, normal, sum, weightsum);
+
+	if (weightsum <= 0.0f)
+		return false;
+
+	irradiance = sum * (1.0f / weightsum);
+
+	return true;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include "Material.h"
+#include "BoundingBox.h"
+
+//Irradiance computed at scattered points on diffuse surfaces and interpolated in
+//between (Ward et al. 1988), so smooth indirect lighting is gathered once rather than
+//on every path. Records live in world space and stay valid as the camera moves, the
+//cache needs clearing if objects or lights change.
+//
+//Records are added between renders, Lookup may be called from any number of threads
+//as long as nothing is being added at the same time
+class IrradianceCache
+{
+	public:
+		struct Record
+		{
+			Vector3		position;
+			Vector3		normal;
+			Colour		irradiance;			//cosine weighted incoming radiance over pi, what a white diffuse surface reflects
+			float		radius;				//harmonic mean distance to the surfaces around the record
+		};
+
+	private:
+		//a loose octree, each record sits in the deepest node whose half size still
+		//covers the record's radius of validity around its position
+		struct Node
+		{
+			Vector3				centre;
+			float				halfSize;
+			int					children[8];		//-1 where there is no child
+			BoundingBox			bounds;				//the spheres of validity of every record under the node
+			std::vector<int>	records;
+		};
+
+		enum
+		{
+			MAX_DEPTH = 24
+		};
+
+		std::vector<Record>		m_records;
+		std::vector<Node>		m_nodes;
+		int						m_root;
+
+		float					m_accuracy;
+		int						m_gatherSamples;
+		float					m_minSpacing;
+		float					m_maxSpacing;
+
+		int		AddNode(const Vector3& centre, float halfSize);
+		void	GrowRoot(const Vector3& point, float validity);
+		float	GetWeight(const Record& record, const Vector3& position, const Vector3& normal) const;
+		void	LookupNode(int nodeindex, const Vector3& position, const Vector3& normal, Colour& sum, float& weightsum) const;
+
+	public:
+		IrradianceCache();
+		~IrradianceCache();
+
+		void	Clear();
+
+		//Larger values allow records to be used further from where they were gathered,
+		//fewer records are needed at the cost of smoother lighting. The default is 0.25
+		inline void SetAccuracy(float accuracy)
+		{
+			m_accuracy = accuracy;
+		}
+
+		//Paths traced over the hemisphere of each new record, default 256
+		inline void SetGatherSamples(int samples)
+		{
+			m_gatherSamples = samples;
+		}
+
+		inline int GetGatherSamples() const
+		{
+			return m_gatherSamples;
+		}
+
+		//Limits on the record radius in world units, default 0.5 and 20
+		inline void SetSpacing(float minSpacing, float maxSpacing)
+		{
+			m_minSpacing = minSpacing;
+			m_maxSpacing = maxSpacing;
+		}
+
+		inline float ClampRadius(float radius) const
+		{
+			return radius < m_minSpacing ? m_minSpacing : radius > m_maxSpacing ? m_maxSpacing : radius;
+		}
+
+		inline int GetNumRecords() const
+		{
+			return (int)m_records.size();
+		}
+
+		//Add a record, its radius should already be clamped
+		void	AddRecord(const Record& record);
+
+		//Irradiance interpolated from the records near a surface point, normal being the
+		//side of the surface that is lit. Returns false if no record is close enough
+		bool	Lookup(const Vector3& position, const Vector3& normal, Colour& irradiance) const;
+};
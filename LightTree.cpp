@@ -0,0 +1,154 @@
+#include <math.h>
+#include <algorithm>
+#include "LightTree.h"
+
+//share of its power a node keeps when all of its lights are behind the surface
+static const float s_backfacingShare = 0.05f;
+
+LightTree::LightTree()
+{
+}
+
+LightTree::~LightTree()
+{
+}
+
+void LightTree::Clear()
+{
+	m_nodes.clear();
+}
+
+void LightTree::Build(const std::vector<Light*>& lights)
+{
+	Clear();
+
+	int numlights = (int)lights.size();
+
+	if (numlights == 0)
+		return;
+
+	std::vector<Vector3> positions(numlights);
+	std::vector<int> order(numlights);
+
+	for (int i = 0; i < numlights; i++)
+	{
+		positions[i] = lights[i]->GetLightPosition();
+		order[i] = i;
+	}
+
+	m_nodes.reserve(numlights * 2);
+	BuildRecursive(positions, order, 0, numlights);
+}
+
+int LightTree::BuildRecursive(const std::vector<Vector3>& positions, std::vector<int>& order, int first, int count)
+{
+	int nodeindex = (int)m_nodes.size();
+	m_nodes.push_back(Node());
+
+	BoundingBox bounds;
+
+	for (int i = first; i < first + count; i++)
+	{
+		bounds.Expand(positions[order[i]]);
+	}
+
+	m_nodes[nodeindex].bounds = bounds;
+	m_nodes[nodeindex].radius = 0.5f * bounds.GetExtent().Norm();
+	m_nodes[nodeindex].power = (float)count;
+
+	if (count == 1)
+	{
+		m_nodes[nodeindex].left = order[first];
+		m_nodes[nodeindex].right = -1;
+		return nodeindex;
+	}
+
+	//median split along the longest axis keeps the tree balanced, so picking a light
+	//takes log2(lights) steps
+	Vector3 extent = bounds.GetExtent();
+	int axis = 0;
+	if (extent[1] > extent[axis]) axis = 1;
+	if (extent[2] > extent[axis]) axis = 2;
+
+	int mid = first + count / 2;
+	std::nth_element(&order[first], &order[mid], &order[first] + count,
+		[&](int a, int b) { return positions[a][axis] < positions[b][axis]; });
+
+	int left = BuildRecursive(positions, order, first, mid - first);
+	int right = BuildRecursive(positions, order, mid, first + count - mid);
+
+	m_nodes[nodeindex].left = left;
+	m_nodes[nodeindex].right = right;
+
+	return nodeindex;
+}
+
+inline float LightTree::GetImportance(const Node& node, const Vector3& point, const Vector3& normal) const
+{
+	Vector3 tocentre = node.bounds.GetCentre() - point;
+	float distsqr = tocentre.Norm_Sqr();
+
+	if (distsqr <= node.radius*node.radius)
+		return node.power;
+
+	//the lights lie in a cone of half angle alpha around the direction to the centre,
+	//the smallest angle theta - alpha from the normal to that cone bounds the cosine
+	float dist = sqrtf(distsqr);
+	float costheta = normal.DotProduct(tocentre) / dist;
+	float sinalpha = node.radius / dist;
+	float cosalpha = sqrtf(1.0f - sinalpha*sinalpha);
+
+	if (costheta >= cosalpha)
+		return node.power;
+
+	float sintheta = sqrtf(std::max(0.0f, 1.0f - costheta*costheta));
+	float bound = costheta*cosalpha + sintheta*sinalpha;
+
+	return node.power * std::max(bound, s_backfacingShare);
+}
+
+int LightTree::Sample(const Vector3& point, const Vector3& normal, float u, float& probability) const
+{
+	probability = 0.0f;
+
+	if (m_nodes.empty() || GetImportance(m_nodes[0], point, normal) <= 0.0f)
+		return -1;
+
+	const Node* node = &m_nodes[0];
+	float p = 1.0f;
+
+	while (node->right >= 0)
+	{
+		const Node& left = m_nodes[node->left];
+		const Node& right = m_nodes[node->right];
+
+		float importanceleft = GetImportance(left, point, normal);
+		float importanceright = GetImportance(right, point, normal);
+		float total = importanceleft + importanceright;
+
+		if (total <= 0.0f)
+			return -1;
+
+		//u picks a child and is rescaled to [0, 1) to be used again further down
+		float pleft = importanceleft / total;
+
+		if (u < pleft)
+		{
+			u = u / pleft;
+			p *= pleft;
+			node = &left;
+		}
+		else
+		{
+			u = (u - pleft) / (1.0f - pleft);
+			p *= 1.0f - pleft;
+			node = &right;
+		}
+
+		u = u < 0.99999994f ? u : 0.99999994f;
+	}
+
+	probability = p;
+
+	return node->left;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include "BoundingBox.h"
+#include "Light.h"
+
+//A binary hierarchy over the point lights of a scene for picking a few lights per
+//shading point instead of shading with all of them. Each node bounds the cosine
+//between the surface normal and the direction to any light below it, and a light
+//is picked by walking down from the root choosing children in proportion to that
+//bound (after Conty and Kulla 2018). Picking costs O(log lights). Lights behind the
+//surface keep a small share of their importance, they add no diffuse light but the
+//ray tracer still gives them a specular highlight. Lights are weighted equally since
+//the ray tracer's diffuse term doesn't depend on the light colour
+class LightTree
+{
+	private:
+		struct Node
+		{
+			BoundingBox		bounds;
+			float			radius;		//of the sphere around the bounds
+			float			power;		//number of lights below the node
+			int				left;		//left child, or the index of the light for a leaf
+			int				right;		//right child, -1 for a leaf
+		};
+
+		std::vector<Node>	m_nodes;
+
+		int		BuildRecursive(const std::vector<Vector3>& positions, std::vector<int>& order, int first, int count);
+
+		inline float GetImportance(const Node& node, const Vector3& point, const Vector3& normal) const;
+
+	public:
+		LightTree();
+		~LightTree();
+
+		void	Build(const std::vector<Light*>& lights);
+		void	Clear();
+
+		inline int GetNumLights() const
+		{
+			return m_nodes.empty() ? 0 : (int)m_nodes[0].power;
+		}
+
+		//Pick a light for a surface at point facing along normal using u uniform in [0, 1).
+		//Returns the index of the light in the list given to Build and the probability of
+		//picking it, or -1 if there are no lights
+		int		Sample(const Vector3& point, const Vector3& normal, float u, float& probability) const;
+};
@@ -8,18 +8,28 @@
 * however the author does not guarantee its performance.
 ---------------------------------------------------------------------*/
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <emmintrin.h>
 #include "Material.h"
 #include "ImageIO.h"
 
-Material::Material()
+Material::Material(Arena* arena)
 {
+	mArena = arena;
 	SetDefaultMaterial();
 }
 
 
 Material::~Material()
 {
+	//textures in the arena are freed with it
+	if (mArena)
+		return;
+
 	if (mDiffuse_texture) delete mDiffuse_texture;
+	if (mNormal_texture) delete mNormal_texture;
 }
 
 void Material::SetDefaultMaterial()
@@ -63,47 +73,293 @@ void Material::SetSpecPower(double spow)
 	mSpecpower = spow;
 }
 
-void Material::SetTextureFromFile(Texture::TEXUNIT unit, const char* filename)
+bool Texture::LoadFromFile(const char* filename)
 {
-#if 1
 	int texwidth, texheight, nchannels, bpp;
 
-	
-	switch (unit)
+	if (mImage) delete[] mImage;
+	mImage = NULL;
+
+	size_t length = strlen(filename);
+	if (length > 5 && strcmp(filename + length - 5, ".trtx") == 0)
+		return LoadTiledFile(filename);
+
+	if (ImageIO::LoadTGA(filename, &mImage, &texwidth, &texheight, &bpp, &nchannels) != E_IMAGEIO_SUCCESS)
 	{
-	case Texture::TEXUNIT_DIFFUSE:
-		if (mDiffuse_texture) delete mDiffuse_texture;
+		printf("Error loading texture: %s\n", filename);
+		return false;
+	}
 
-		mDiffuse_texture = new Texture();
+	mChannels = nchannels;
+	mHeight = texheight;
+	mWidth = texwidth;
 
-		ImageIO::LoadTGA(filename, &(mDiffuse_texture->mImage), &texwidth, &texheight, &bpp, &nchannels);
+	BuildMipLevels();
 
-		mDiffuse_texture->mChannels = nchannels;
-		mDiffuse_texture->mHeight = texheight;
-		mDiffuse_texture->mWidth = texwidth;
-		break;
-	case Texture::TEXUNIT_NORMAL:
-		if (mNormal_texture) delete mNormal_texture;
+	return true;
+}
+
+bool Texture::LoadTiledFile(const char* filename)
+{
+	mLevels.clear();
+	mTexels.clear();
+
+	mCacheFile = TextureCache::GetInstance().OpenFile(filename, mCacheLevels);
+
+	if (mCacheFile < 0)
+	{
+		printf("Error loading texture: %s\n", filename);
+		return false;
+	}
+
+	//the levels only carry the sizes, texels are addressed through mCacheLevels
+	for (size_t i = 0; i < mCacheLevels.size(); i++)
+	{
+		MipLevel level = { mCacheLevels[i].width, mCacheLevels[i].height, mCacheLevels[i].pagesX, 0 };
+		mLevels.push_back(level);
+	}
+
+	mWidth = mCacheLevels[0].width;
+	mHeight = mCacheLevels[0].height;
+	mChannels = 4;
+
+	return true;
+}
+
+bool Texture::SaveTiledFile(const char* filename)
+{
+	Load();
+
+	if (mLevels.empty() || mCacheFile >= 0)
+		return false;
+
+	std::vector<TextureCache::LevelInfo> levels(mLevels.size());
+	std::vector<std::vector<unsigned int> > images(mLevels.size());
+	std::vector<const unsigned int*> rows(mLevels.size());
+
+	for (size_t i = 0; i < mLevels.size(); i++)
+	{
+		int width = mLevels[i].width;
+		int height = mLevels[i].height;
+
+		levels[i].width = width;
+		levels[i].height = height;
+		images[i].resize(width*height);
+
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				images[i][y*width + x] = FetchTexel((int)i, x, y);
+			}
+		}
+
+		rows[i] = &images[i][0];
+	}
+
+	return TextureCache::WriteFile(filename, levels, rows);
+}
+
+void Texture::BuildMipLevels()
+{
+	mLevels.clear();
+	mTexels.clear();
+	mCacheFile = -1;
+
+	if (!mImage || mWidth == 0 || mHeight == 0)
+		return;
+
+	int width = mWidth;
+	int height = mHeight;
+
+	//pack the loaded image as RGBA8, images without alpha are opaque
+	std::vector<unsigned int> image(width*height);
+
+	for (int i = 0; i < width*height; i++)
+	{
+		const unsigned char* comp = mImage + i*mChannels;
+		unsigned int alpha = mChannels == 4 ? comp[3] : 255;
+		image[i] = comp[0] | (comp[1] << 8) | (comp[2] << 16) | (alpha << 24);
+	}
+
+	for (;;)
+	{
+		MipLevel level;
+		level.width = width;
+		level.height = height;
+		level.tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		level.offset = (int)mTexels.size();
+
+		int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+		mTexels.resize(level.offset + level.tilesX*tilesY*TILE_SIZE*TILE_SIZE, 0);
+
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				int tile = (y / TILE_SIZE) * level.tilesX + (x / TILE_SIZE);
+				mTexels[level.offset + tile*TILE_SIZE*TILE_SIZE + (y % TILE_SIZE)*TILE_SIZE + (x % TILE_SIZE)] = image[y*width + x];
+			}
+		}
+
+		mLevels.push_back(level);
 
-		mNormal_texture = new Texture();
+		if (width == 1 && height == 1)
+			break;
 
-		ImageIO::LoadTGA(filename, &(mNormal_texture->mImage), &texwidth, &texheight, &bpp, &nchannels);
+		//2x2 box filter, the last row or column of an odd sized level is reused
+		int nextwidth = width > 1 ? width / 2 : 1;
+		int nextheight = height > 1 ? height / 2 : 1;
+		std::vector<unsigned int> next(nextwidth*nextheight);
 
-		mNormal_texture->mChannels = nchannels;
-		mNormal_texture->mHeight = texheight;
-		mNormal_texture->mWidth = texwidth;
+		for (int y = 0; y < nextheight; y++)
+		{
+			int y0 = 2*y;
+			int y1 = 2*y + 1 < height ? 2*y + 1 : height - 1;
+
+			for (int x = 0; x < nextwidth; x++)
+			{
+				int x0 = 2*x;
+				int x1 = 2*x + 1 < width ? 2*x + 1 : width - 1;
+
+				unsigned int texels[4] = { image[y0*width + x0], image[y0*width + x1], image[y1*width + x0], image[y1*width + x1] };
+				unsigned int result = 0;
+
+				for (int c = 0; c < 32; c += 8)
+				{
+					unsigned int sum = 2;
+					for (int i = 0; i < 4; i++)
+					{
+						sum += (texels[i] >> c) & 0xff;
+					}
+					result |= (sum >> 2) << c;
+				}
+
+				next[y*nextwidth + x] = result;
+			}
+		}
+
+		image.swap(next);
+		width = nextwidth;
+		height = nextheight;
+	}
+
+	delete[] mImage;
+	mImage = NULL;
+}
+
+static inline Vec4 UnpackTexel(unsigned int texel)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_cvtsi32_si128((int)texel);
+	v = _mm_unpacklo_epi8(v, zero);
+	v = _mm_unpacklo_epi16(v, zero);
+	return _mm_cvtepi32_ps(v);
+}
+
+Vec4 Texture::SampleBilinear(int index, float u, float v) const
+{
+	const MipLevel& level = mLevels[index];
+
+	//u and v are in [0, 1), texel centres are at half texel offsets
+	float x = u*level.width - 0.5f;
+	float y = v*level.height - 0.5f;
+	float fx = floorf(x);
+	float fy = floorf(y);
+
+	int x0 = fx < 0.0f ? level.width - 1 : (int)fx;
+	int y0 = fy < 0.0f ? level.height - 1 : (int)fy;
+	int x1 = x0 + 1 < level.width ? x0 + 1 : 0;
+	int y1 = y0 + 1 < level.height ? y0 + 1 : 0;
+
+	Vec4 ax = _mm_set1_ps(x - fx);
+	Vec4 ay = _mm_set1_ps(y - fy);
+
+	Vec4 c00 = UnpackTexel(FetchTexel(index, x0, y0));
+	Vec4 c10 = UnpackTexel(FetchTexel(index, x1, y0));
+	Vec4 c01 = UnpackTexel(FetchTexel(index, x0, y1));
+	Vec4 c11 = UnpackTexel(FetchTexel(index, x1, y1));
+
+	Vec4 bottom = _mm_add_ps(c00, _mm_mul_ps(_mm_sub_ps(c10, c00), ax));
+	Vec4 top = _mm_add_ps(c01, _mm_mul_ps(_mm_sub_ps(c11, c01), ax));
+
+	return _mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(top, bottom), ay));
+}
+
+Colour Texture::GetTexelColour(double u, double v)
+{
+	return Sample(u, v, 0.0f);
+}
+
+Colour Texture::Sample(double u, double v, float footprint)
+{
+	Load();
+
+	//textures that failed to load sample as black
+	if (mLevels.empty())
+		return Colour();
+
+	float s = (float)(u - floor(u));
+	float t = (float)(v - floor(v));
+
+	//the level where one texel covers the footprint
+	int maxlevel = (int)mLevels.size() - 1;
+	float size = (float)(mWidth > mHeight ? mWidth : mHeight);
+	float lod = footprint > 0.0f ? log2f(footprint*size) : 0.0f;
+
+	Vec4 colour;
+
+	if (lod <= 0.0f)
+	{
+		colour = SampleBilinear(0, s, t);
+	}
+	else if (lod >= (float)maxlevel)
+	{
+		colour = SampleBilinear(maxlevel, s, t);
+	}
+	else
+	{
+		int level = (int)lod;
+		Vec4 fraction = _mm_set1_ps(lod - (float)level);
+		Vec4 fine = SampleBilinear(level, s, t);
+		Vec4 coarse = SampleBilinear(level + 1, s, t);
+		colour = _mm_add_ps(fine, _mm_mul_ps(_mm_sub_ps(coarse, fine), fraction));
+	}
+
+	//scale to [0, 1] and drop the alpha
+	const float scale = 1.0f / 255.0f;
+	return Colour(_mm_mul_ps(colour, _mm_set_ps(0.0f, scale, scale, scale)));
+}
+
+void Material::SetTextureFromFile(Texture::TEXUNIT unit, const char* filename, bool deferred)
+{
+	Texture* texture = mArena ? mArena->New<Texture>() : new Texture();
+
+	if (deferred)
+		texture->SetFile(filename);
+	else
+		texture->LoadFromFile(filename);
+
+	switch (unit)
+	{
+	case Texture::TEXUNIT_DIFFUSE:
+		if (mDiffuse_texture && !mArena) delete mDiffuse_texture;
+		mDiffuse_texture = texture;
+		break;
+	case Texture::TEXUNIT_NORMAL:
+		if (mNormal_texture && !mArena) delete mNormal_texture;
+		mNormal_texture = texture;
 		break;
 	}
-#endif
 }
 
-Colour Material::SampleColour(Texture::TEXUNIT unit, double u, double v)
+Colour Material::SampleColour(Texture::TEXUNIT unit, double u, double v, float footprint)
 {
 	Colour colour;
 	
 	colour = unit == Texture::TEXUNIT_DIFFUSE ?
-		mDiffuse_texture->GetTexelColour(u, v) :
-		mNormal_texture->GetTexelColour(u, v);
+		mDiffuse_texture->Sample(u, v, footprint) :
+		mNormal_texture->Sample(u, v, footprint);
 
 	return colour;
 }
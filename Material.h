@@ -10,8 +10,13 @@
 #pragma once
 
 #include <stdlib.h>
+#include <string>
+#include <vector>
+#include <mutex>
 
 #include "Vector3.h"
+#include "TextureCache.h"
+#include "Arena.h"
 
 typedef Vector3 Colour;
 
@@ -27,11 +32,21 @@ public:
 	unsigned int	mWidth;
 	unsigned int    mHeight;
 	unsigned int    mChannels;
-	unsigned char*	mImage;
+	unsigned char*	mImage;			//the image as loaded, freed once converted to mip levels
+
+	std::string		mFilename;		//image read on first use, see SetFile
+	std::once_flag	mLoadOnce;
+
+	enum
+	{
+		TILE_SIZE = 8				//texels are stored in 8x8 tiles, 256 bytes each
+	};
 
 	Texture()
 	{
 		mImage = NULL;
+		mWidth = mHeight = mChannels = 0;
+		mCacheFile = -1;
 	}
 
 	~Texture()
@@ -39,24 +54,75 @@ public:
 		if (mImage) delete[] mImage;
 	}
 
-	Colour GetTexelColour(double u, double v)
+	//Load the image from a TGA file now. A tiled texture file (.trtx) is opened instead,
+	//its pages are read through the TextureCache as they are sampled
+	bool LoadFromFile(const char* filename);
+
+	//Write the mip chain of a loaded image as a tiled texture file for the TextureCache
+	bool SaveTiledFile(const char* filename);
+
+	inline bool IsOutOfCore() const
 	{
-		Colour colour;
+		return mCacheFile >= 0;
+	}
 
-		int dx = u*mWidth;
-		int dy = v*mHeight;
-		int texel_stride = mChannels;
-		int row_stride = mWidth;
-		int texel_loc = (dx*texel_stride) + dy*row_stride*texel_stride;
+	//Take the image in mImage and build the tiled mip chain from it
+	void BuildMipLevels();
 
-		unsigned char* comp = mImage + texel_loc;
+	//Defer loading the image until the texture is first sampled or Load is called
+	inline void SetFile(const char* filename)
+	{
+		mFilename = filename;
+	}
 
-		colour[0] = *(comp) / 255.0f;
-		colour[1] = *(comp + 1) / 255.0f;
-		colour[2] = *(comp + 2) / 255.0f;
+	//Load a deferred image, safe to call from several threads at once
+	inline void Load()
+	{
+		if (!mFilename.empty())
+			std::call_once(mLoadOnce, [this]() { LoadFromFile(mFilename.c_str()); });
+	}
 
-		return colour;
+	inline int GetNumLevels() const
+	{
+		return (int)mLevels.size();
 	}
+
+	//Bilinearly filtered colour of the full resolution image, coordinates wrap
+	Colour GetTexelColour(double u, double v);
+
+	//Trilinearly filtered colour, footprint is the width of the area to filter over in
+	//texture coordinates and picks the mip level. A footprint of 0 samples the full resolution image
+	Colour Sample(double u, double v, float footprint);
+
+private:
+	struct MipLevel
+	{
+		int		width;
+		int		height;
+		int		tilesX;				//tiles in a row of the level
+		int		offset;				//index of the level's first texel in mTexels
+	};
+
+	std::vector<MipLevel>		mLevels;
+	std::vector<unsigned int>	mTexels;		//RGBA8 texels of every level, tile by tile
+
+	//out-of-core textures keep no texels, they are fetched from the TextureCache
+	int									mCacheFile;
+	std::vector<TextureCache::LevelInfo>	mCacheLevels;
+
+	bool LoadTiledFile(const char* filename);
+
+	inline unsigned int FetchTexel(int index, int x, int y) const
+	{
+		if (mCacheFile >= 0)
+			return TextureCache::GetInstance().FetchTexel(mCacheFile, index, mCacheLevels[index], x, y);
+
+		const MipLevel& level = mLevels[index];
+		int tile = (y / TILE_SIZE) * level.tilesX + (x / TILE_SIZE);
+		return mTexels[level.offset + tile*TILE_SIZE*TILE_SIZE + (y % TILE_SIZE)*TILE_SIZE + (x % TILE_SIZE)];
+	}
+
+	Vec4 SampleBilinear(int level, float u, float v) const;
 };
 
 class Material
@@ -70,10 +136,11 @@ class Material
 		Texture* mDiffuse_texture;
 		Texture* mNormal_texture;
 		bool mCastShadow;
+		Arena* mArena;						//textures go here when set, and are freed with it
 
 	public:
 		
-		Material();
+		Material(Arena* arena = NULL);
 		~Material();
 
 		void SetDefaultMaterial();
@@ -128,8 +195,18 @@ class Material
 			return mNormal_texture != NULL;
 		}
 
-		Colour SampleColour(Texture::TEXUNIT unit, double u, double v);
-		void SetTextureFromFile(Texture::TEXUNIT unit, const char* filename);
+		//Sample a texture unit, footprint is the filter width in texture coordinates,
+		//see RayHitResult::footprint
+		Colour SampleColour(Texture::TEXUNIT unit, double u, double v, float footprint = 0.0f);
+
+		//Set a texture unit from a TGA or tiled texture file. A deferred texture is read the first time it is
+		//sampled unless it is loaded earlier, e.g. on an AssetLoader thread
+		void SetTextureFromFile(Texture::TEXUNIT unit, const char* filename, bool deferred = false);
+
+		inline Texture* GetTexture(Texture::TEXUNIT unit)
+		{
+			return unit == Texture::TEXUNIT_DIFFUSE ? mDiffuse_texture : mNormal_texture;
+		}
 
 };
 
@@ -0,0 +1,152 @@
+//Merges path traced checkpoints of one frame, rendered with different sample seeds or sample
+//ranges on different machines or processes, into an image and optionally a checkpoint to carry on from
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "Checkpoint.h"
+#include "ImageIO.h"
+
+static void PrintUsage()
+{
+	printf("Usage: tinyray-merge [options] checkpoint...\n");
+	printf("  -out file         merged image, PFM if the name ends in .pfm, TGA otherwise (default merged.tga)\n");
+	printf("  -checkpoint file  also write the merged checkpoint\n");
+}
+
+static bool EndsWith(const std::string& name, const char* suffix)
+{
+	size_t length = strlen(suffix);
+	return name.size() >= length && name.compare(name.size() - length, length, suffix) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	std::string output = "merged.tga";
+	const char* checkpointfile = NULL;
+	std::vector<const char*> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-out") == 0 && i + 1 < argc)
+		{
+			output = argv[++i];
+		}
+		else if (strcmp(argv[i], "-checkpoint") == 0 && i + 1 < argc)
+		{
+			checkpointfile = argv[++i];
+		}
+		else if (argv[i][0] == '-')
+		{
+			PrintUsage();
+			return 1;
+		}
+		else
+		{
+			inputs.push_back(argv[i]);
+		}
+	}
+
+	if (inputs.empty())
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	Checkpoint merged;
+
+	if (!merged.Load(inputs[0]))
+	{
+		printf("Error reading checkpoint %s\n", inputs[0]);
+		return 1;
+	}
+
+	std::vector<Checkpoint::Settings> mergedsettings(1, merged.m_settings);
+
+	for (size_t i = 1; i < inputs.size(); i++)
+	{
+		Checkpoint checkpoint;
+
+		if (!checkpoint.Load(inputs[i]))
+		{
+			printf("Error reading checkpoint %s\n", inputs[i]);
+			return 1;
+		}
+
+		//samples of the same seed and index are the same samples
+		const Checkpoint::Settings& settings = checkpoint.m_settings;
+
+		for (size_t s = 0; s < mergedsettings.size(); s++)
+		{
+			const Checkpoint::Settings& earlier = mergedsettings[s];
+
+			if (earlier.seed == settings.seed && earlier.firstSample < settings.firstSample + settings.samples &&
+				settings.firstSample < earlier.firstSample + earlier.samples)
+			{
+				printf("Warning: %s has samples of an earlier checkpoint, use another seed or sample range\n", inputs[i]);
+				break;
+			}
+		}
+
+		mergedsettings.push_back(settings);
+
+		if (!merged.Merge(checkpoint))
+		{
+			printf("Error: %s is a checkpoint of another frame\n", inputs[i]);
+			return 1;
+		}
+	}
+
+	int width = merged.m_settings.width;
+	int height = merged.m_settings.height;
+	int numpixels = merged.GetNumPixels();
+
+	std::vector<float> colours((size_t)numpixels * 3);
+
+	for (int i = 0; i < numpixels; i++)
+	{
+		Vector3 colour = merged.GetColour(i);
+
+		colours[i*3] = colour[0];
+		colours[i*3 + 1] = colour[1];
+		colours[i*3 + 2] = colour[2];
+	}
+
+	bool ok;
+
+	if (EndsWith(output, ".pfm"))
+	{
+		ok = ImageIO::SavePFM(output.c_str(), &colours[0], width, height) == E_IMAGEIO_SUCCESS;
+	}
+	else
+	{
+		//quantised as the frames of tinyray-batch are
+		std::vector<unsigned char> pixels(colours.size());
+
+		for (size_t i = 0; i < colours.size(); i++)
+		{
+			float value = colours[i] < 0.0f ? 0.0f : colours[i] > 1.0f ? 1.0f : colours[i];
+			pixels[i] = (unsigned char)(value*255.0f + 0.5f);
+		}
+
+		ok = ImageIO::SaveTGA(output.c_str(), &pixels[0], width, height, 3) == E_IMAGEIO_SUCCESS;
+	}
+
+	if (!ok)
+	{
+		printf("Error writing %s\n", output.c_str());
+		return 1;
+	}
+
+	if (checkpointfile && !merged.Save(checkpointfile))
+	{
+		printf("Error writing checkpoint %s\n", checkpointfile);
+		return 1;
+	}
+
+	printf("Merged %d checkpoints into %s\n", (int)inputs.size(), output.c_str());
+
+	return 0;
+}
@@ -0,0 +1,49 @@
+#include "MeshInstance.h"
+
+MeshInstance::MeshInstance(const TriMesh* mesh, const Transform& toWorld, Material* material)
+{
+	m_mesh = mesh;
+	m_primtype = PRIMTYPE_Instance;
+	SetTransform(toWorld);
+	SetMaterial(material ? material : mesh->GetMaterial());
+}
+
+MeshInstance::~MeshInstance()
+{
+}
+
+void MeshInstance::SetTransform(const Transform& toWorld)
+{
+	m_toWorld = toWorld;
+	m_toObject = toWorld.GetInverse();
+}
+
+BoundingBox MeshInstance::GetBounds() const
+{
+	if (m_mesh->GetNumTriangles() == 0)
+		return BoundingBox();
+
+	return m_toWorld.TransformBounds(m_mesh->GetBounds());
+}
+
+RayHitResult MeshInstance::IntersectByRay(Ray& ray)
+{
+	RayHitResult result = Ray::s_defaultHitResult;
+
+	Ray localray;
+	localray.SetRay(m_toObject.TransformPoint(ray.GetRayStart()), m_toObject.TransformVector(ray.GetRay()));
+
+	PrimHit hit;
+	hit.t = FARFAR_AWAY;
+
+	if (m_mesh->IntersectMesh(localray, hit))
+	{
+		m_mesh->ResolveHit(localray, hit, result);
+
+		result.point = ray.GetRayStart() + ray.GetRay()*hit.t;
+		result.normal = m_toObject.TransformNormalByInverse(result.normal);
+		result.data = this;
+	}
+
+	return result;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Primitive.h"
+#include "TriMesh.h"
+#include "Transform.h"
+
+//A placement of a shared TriMesh. The mesh, its triangles and its BVH are not
+//owned or copied so any number of instances cost a transform each
+class MeshInstance : public Primitive
+{
+	private:
+		const TriMesh*		m_mesh;
+		Transform			m_toWorld;
+		Transform			m_toObject;
+
+	public:
+		//A NULL material uses the mesh's own material
+		MeshInstance(const TriMesh* mesh, const Transform& toWorld, Material* material = NULL);
+		~MeshInstance();
+
+		void SetTransform(const Transform& toWorld);
+
+		inline const TriMesh* GetMesh() const
+		{
+			return m_mesh;
+		}
+
+		inline const Transform& GetWorldToObject() const
+		{
+			return m_toObject;
+		}
+
+		inline const Transform& GetObjectToWorld() const
+		{
+			return m_toWorld;
+		}
+
+		BoundingBox GetBounds() const;
+
+		RayHitResult IntersectByRay(Ray& ray);
+};
@@ -178,7 +178,7 @@ static int secondPassOBJRead(const char* filename, int nVerts, int nNormals, int
 	return 0;
 }
 
-int importOBJMesh(const char* filename, Triangle** triangles)
+int importOBJMesh(const char* filename, Triangle** triangles, Arena* arena)
 {
 	int num_triangles = 0;
 	int num_vertices = 0;
@@ -187,7 +187,7 @@ int importOBJMesh(const char* filename, Triangle** triangles)
 
 	firstPassOBJRead(filename, &num_vertices, &num_normals, &num_texcoords, &num_triangles);
 
-	*triangles = new Triangle[num_triangles];
+	*triangles = arena ? arena->NewArray<Triangle>(num_triangles) : new Triangle[num_triangles];
 
 	secondPassOBJRead(filename, num_vertices, num_normals, num_texcoords, *triangles);
 
@@ -1,5 +1,7 @@
 #pragma once
 
 #include "Triangle.h"
+#include "Arena.h"
 
-int importOBJMesh(const char* filename, Triangle** triangles);
\ No newline at end of file
+//The triangles are placed in the arena if there is one, otherwise allocated with new[]
+int importOBJMesh(const char* filename, Triangle** triangles, Arena* arena = NULL);
\ No newline at end of file
@@ -9,31 +9,76 @@
 #include <math.h>  
 #include <stdlib.h>
 #include <stdio.h>
+#include <float.h>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <memory>
+#include <string>
 
 #define M_PI 3.14159265358979323846
 
-#if defined(WIN32) || defined(_WINDOWS)
-#include <Windows.h>
-#include <gl/GL.h>
-#endif
-
 #include "PathTracer.h"
 #include "Scene.h"
+#include "EnvironmentMap.h"
+#include "Random.h"
+#include "RayStats.h"
+#include "Profiler.h"
+#include "RenderControl.h"
+#include "ThreadPool.h"
 #include "Camera.h"
 #include "perlin.h"
 #include "time.h"
 
 inline double getUniformDouble()
 {
-	return (double)rand() / (double)RAND_MAX;
+	return Random::Uniform();
+}
+
+Colour PathTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int multiRay, bool shadowray, RayHitResult* primaryhit)
+{
+	return TracePath(pScene, ray, incolour, multiRay, 1, 0.0f, primaryhit);
 }
 
-Colour PathTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int multiRay, bool shadowray)
+Colour PathTracer::SampleEnvironment(Scene* pScene, EnvironmentMap* environment, const Vector3& point, const Vector3& normal)
+{
+	Vector3 direction;
+	float pdf;
+	Colour radiance = environment->Sample((float)getUniformDouble(), (float)getUniformDouble(), direction, pdf);
+
+	float cosine = direction.DotProduct(normal);
+
+	if (pdf <= 0.0f || cosine <= 0.0f)
+		return Colour(0.0, 0.0, 0.0);
+
+	Ray shadowRay; shadowRay.SetRay(point + (direction * 0.01), direction);
+	RAYSTATS_ADD(STAT_SHADOW, 1);
+
+	if (pScene->IntersectByRay(shadowRay).data)
+		return Colour(0.0, 0.0, 0.0);
+
+	// Power heuristic against the cosine weighted bounce, which can find the same light
+	float bouncePdf = cosine / (float)M_PI;
+	float weight = pdf*pdf / (pdf*pdf + bouncePdf*bouncePdf);
+
+	// the diffuse colour is applied by the caller
+	return radiance * (cosine / ((float)M_PI * pdf) * weight);
+}
+
+Colour PathTracer::TracePath(Scene* pScene, Ray& ray, Colour incolour, int multiRay, int segment, float bouncePdf, RayHitResult* primaryhit)
 {
 	//Intersect the ray with the scene
 	RayHitResult result = pScene->IntersectByRay(ray);
 
+	if (primaryhit)
+		*primaryhit = result;
+
 	Colour outcolour = incolour; //the output colour based on the ray-primitive intersection
+	EnvironmentMap* environment = pScene->GetEnvironmentMap();
+
+	if (!result.data)
+		RAYSTATS_PATH(segment);
 
 	if (result.data) //the ray has hit something
 	{
@@ -43,6 +88,14 @@ Colour PathTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int mult
 		Vector3 normal = result.normal.DotProduct(ray.GetRay()) < 0 ? result.normal : result.normal * -1;
 		Vector3 f = mat->GetDiffuseColour();
 
+		// surfaces reached by a diffuse bounce take their light from the cache where it has a record close by
+		Colour cached;
+		if (bouncePdf > 0.0f && m_irradianceCache && m_irradianceCache->Lookup(result.point, normal, cached))
+		{
+			RAYSTATS_PATH(segment);
+			return mat->GetEmissiveColour() + (f * cached);
+		}
+
 		double p = f[0] > f[1] && f[0] > f[2] ? f[0] : f[1] > f[2] ? f[1] : f[2]; // max reflectance 
 
 		if (--multiRay<0)
@@ -53,6 +106,8 @@ Colour PathTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int mult
 			}
 			else
 			{
+				RAYSTATS_ADD(STAT_ROULETTE, 1);
+				RAYSTATS_PATH(segment);
 				return (mat->GetEmissiveColour()); // R.R
 			}
 		}
@@ -65,31 +120,261 @@ Colour PathTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int mult
 		Vector3 direction = (u*cos(r1)*r2s + v*sin(r1)*r2s + w*sqrt(1 - r2));
 
 		Ray setRay; setRay.SetRay(result.point + (direction * 0.01), direction);
-		
-		outcolour = mat->GetEmissiveColour() + (f * TraceScene(pScene, setRay, incolour, multiRay));
+
+		Colour direct(0.0, 0.0, 0.0);
+
+		if (environment)
+			direct = SampleEnvironment(pScene, environment, result.point, normal);
+
+		RAYSTATS_ADD(STAT_DIFFUSE, 1);
+		Colour indirect = TracePath(pScene, setRay, incolour, multiRay, segment + 1, (float)(sqrt(1 - r2) / M_PI), NULL);
+
+		outcolour = mat->GetEmissiveColour() + (f * (direct + indirect));
+	}
+	else if (environment)
+	{
+		outcolour = environment->Lookup(ray.GetRay());
+
+		// a diffuse bounce shares the environment with the sample taken from the map at that surface
+		if (bouncePdf > 0.0f)
+		{
+			float lightPdf = environment->GetPdf(ray.GetRay());
+			outcolour = outcolour * (bouncePdf*bouncePdf / (bouncePdf*bouncePdf + lightPdf*lightPdf));
+		}
 	}
 	return outcolour;
 }
 
+void PathTracer::GatherIrradiance(Scene* pScene, const Vector3& point, const Vector3& normal, Colour incolour, IrradianceCache::Record& record)
+{
+	EnvironmentMap* environment = pScene->GetEnvironmentMap();
+
+	// the same estimate as a diffuse bounce without the surface colour, stratified over the hemisphere
+	int strata = (int)sqrt((double)m_irradianceCache->GetGatherSamples());
+	strata = strata > 0 ? strata : 1;
+
+	Vector3 w = normal;
+	Vector3 u = (fabs(w[0]) > .1 ? Vector3(0, 1, 0) : Vector3(1, 0, 0)).CrossProduct(w).Normalise();
+	Vector3 v = w.CrossProduct(u);
+
+	Colour sum(0.0, 0.0, 0.0);
+	double inversedistance = 0.0;
+
+	for (int sy = 0; sy < strata; sy++)
+	{
+		for (int sx = 0; sx < strata; sx++)
+		{
+			double r1 = 2 * M_PI*(sx + getUniformDouble()) / strata, r2 = (sy + getUniformDouble()) / strata, r2s = sqrt(r2);
+			Vector3 direction = (u*cos(r1)*r2s + v*sin(r1)*r2s + w*sqrt(1 - r2));
+
+			Ray gatherRay; gatherRay.SetRay(point + (direction * 0.01), direction);
+
+			if (environment)
+				sum = sum + SampleEnvironment(pScene, environment, point, normal);
+
+			// paths are as deep as those bouncing off a primary hit, and are counted as paths of their own
+			RAYSTATS_ADD(STAT_DIFFUSE, 1);
+			RayHitResult hit = Ray::s_defaultHitResult;
+			sum = sum + TracePath(pScene, gatherRay, incolour, 4, 1, (float)(sqrt(1 - r2) / M_PI), &hit);
+
+			if (hit.data)
+				inversedistance += 1.0 / (hit.t > 1e-3 ? hit.t : 1e-3);
+		}
+	}
+
+	int count = strata * strata;
+
+	record.position = point;
+	record.normal = normal;
+	record.irradiance = sum * (1.0f / count);
+	record.radius = m_irradianceCache->ClampRadius(inversedistance > 0.0 ? (float)(count / inversedistance) : FLT_MAX);
+}
+
+void PathTracer::UpdateIrradianceCache(Scene* pScene, const Vector3& start, const Vector3& stepX, const Vector3& stepY, const Vector3& camPosition)
+{
+	IrradianceCache* cache = m_irradianceCache;
+	Colour scenebg = pScene->GetBackgroundColour();
+	int before = cache->GetNumRecords();
+
+	PROFILE_SCOPE("IrradianceCache");
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	const int batchsize = 256;
+
+	// coarse to fine over the image, so the first records spread out and the later passes fill the gaps
+	for (int stride = 16; stride >= 2 && !(m_control && m_control->ShouldStop()); stride /= 2)
+	{
+		int columns = (m_buffWidth + stride - 1) / stride;
+		int rows = (m_buffHeight + stride - 1) / stride;
+
+		std::vector<Vector3> points(columns * rows);
+		std::vector<Vector3> normals(columns * rows);
+		std::vector<char> found(columns * rows, 0);
+
+		// where one diffuse bounce from the primary hit of the pixel lands
+#pragma omp parallel for schedule (dynamic, 1)
+		for (int row = 0; row < rows; row++)
+		{
+			for (int column = 0; column < columns; column++)
+			{
+				int i = row * stride;
+				int j = column * stride;
+
+				Random::SeedPixel(j, i ^ (stride << 16));
+
+				Vector3 pixel = start + stepY * (float)(i + 0.5) + stepX * (float)(j + 0.5);
+				Ray viewray; viewray.SetRay(camPosition, (pixel - camPosition).Normalise());
+				RAYSTATS_ADD(STAT_PRIMARY, 1);
+
+				RayHitResult result = pScene->IntersectByRay(viewray);
+
+				if (!result.data)
+					continue;
+
+				Vector3 w = result.normal.DotProduct(viewray.GetRay()) < 0 ? result.normal : result.normal * -1;
+				Vector3 u = (fabs(w[0]) > .1 ? Vector3(0, 1, 0) : Vector3(1, 0, 0)).CrossProduct(w).Normalise();
+				Vector3 v = w.CrossProduct(u);
+
+				double r1 = 2 * M_PI*getUniformDouble(), r2 = getUniformDouble(), r2s = sqrt(r2);
+				Vector3 direction = (u*cos(r1)*r2s + v*sin(r1)*r2s + w*sqrt(1 - r2));
+
+				Ray bounceRay; bounceRay.SetRay(result.point + (direction * 0.01), direction);
+				RAYSTATS_ADD(STAT_DIFFUSE, 1);
+				RayHitResult bounce = pScene->IntersectByRay(bounceRay);
+
+				if (!bounce.data)
+					continue;
+
+				int index = row * columns + column;
+				points[index] = bounce.point;
+				normals[index] = bounce.normal.DotProduct(direction) < 0 ? bounce.normal : bounce.normal * -1;
+				found[index] = 1;
+			}
+		}
+
+		// visit the candidates in a shuffled order so those in one batch are spread over the image
+		std::vector<int> order;
+		for (int k = 0; k < columns * rows; k++)
+		{
+			if (found[k])
+				order.push_back(k);
+		}
+
+		std::shuffle(order.begin(), order.end(), std::minstd_rand(stride));
+
+		// records are gathered in parallel and added between batches, where nothing reads the cache
+		for (int first = 0; first < (int)order.size(); first += batchsize)
+		{
+			int count = std::min(batchsize, (int)order.size() - first);
+
+			std::vector<IrradianceCache::Record> records(count);
+			std::vector<char> gathered(count, 0);
+
+#pragma omp parallel for schedule (dynamic, 1)
+			for (int k = 0; k < count; k++)
+			{
+				int index = order[first + k];
+				Colour irradiance;
+
+				if (cache->Lookup(points[index], normals[index], irradiance))
+					continue;
+
+				Random::SeedPixel(index, -stride);
+				GatherIrradiance(pScene, points[index], normals[index], scenebg, records[k]);
+				gathered[k] = 1;
+			}
+
+			for (int k = 0; k < count; k++)
+			{
+				if (gathered[k])
+					cache->AddRecord(records[k]);
+			}
+		}
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	fprintf(stdout, "\rIrradiance cache: %d records, %d new (%.2fs)\n", cache->GetNumRecords(), cache->GetNumRecords() - before, seconds);
+}
+
+bool PathTracer::ResumeCheckpoint(const char* filename, const Checkpoint::Settings& settings, Checkpoint& progress)
+{
+	Checkpoint saved;
+
+	if (!saved.Load(filename))
+		return false;
+
+	if (!saved.IsSameFrame(settings) || saved.m_settings.seed != settings.seed ||
+		saved.m_settings.firstSample != settings.firstSample || saved.m_settings.initialPaths != settings.initialPaths)
+	{
+		fprintf(stdout, "\rCheckpoint %s is of another frame, seed or sample range, starting afresh\n", filename);
+		return false;
+	}
+
+	// carry on towards the samples asked for now, which may be more or fewer than before
+	saved.SetSamples(settings.samples);
+	progress = saved;
+
+	fprintf(stdout, "\rResuming from checkpoint %s\n", filename);
+
+	return true;
+}
+
+void PathTracer::WriteCheckpoint(ThreadPool& writer, const char* filename, const Checkpoint& progress)
+{
+	// one write at a time, the last has had a whole pass to finish
+	writer.Wait();
+
+	std::shared_ptr<Checkpoint> snapshot = std::make_shared<Checkpoint>(progress);
+	std::string name = filename;
+
+	writer.Submit([snapshot, name]()
+	{
+		PROFILE_SCOPE("WriteCheckpoint");
+
+		if (!snapshot->Save(name.c_str()))
+			fprintf(stdout, "\rError writing checkpoint %s\n", name.c_str());
+	});
+}
+
+Colour PathTracer::GetAlbedo(const RayHitResult& hit)
+{
+	//the path tracer shades with the plain diffuse colour
+	return ((Primitive*)hit.data)->GetMaterial()->GetDiffuseColour();
+}
+
 Colour PathTracer::TraceReflection(Scene* pScene, Ray ray, Colour scenebg, int multiRay) 
 {
 	Colour colour = scenebg;
 
+	RAYSTATS_ADD(STAT_PRIMARY, 1);
 	RayHitResult result = pScene->IntersectByRay(ray);
 	Ray newRay = ray;
 
+#if defined(TINYRAY_STATS)
+	//the rays traced below are camera rays unless the ray was redirected
+	RayStats::COUNTER traced = RayStats::STAT_PRIMARY;
+#endif
+
 	//Check tracefag 
 	if (m_traceflag & TRACE_REFLECTION)
 	{
-		//If the m_primtype is PRIMTYPE_Sphere or PRIMTYPE_Box enter into the statement
-		if (((Primitive*)result.data)->m_primtype == Primitive::PRIMTYPE_Sphere
-			|| ((Primitive*)result.data)->m_primtype == Primitive::PRIMTYPE_Box)
+		//If the m_primtype is PRIMTYPE_Sphere or PRIMTYPE_Box enter into the statement, rays into an open sky hit nothing
+		if (result.data && (((Primitive*)result.data)->m_primtype == Primitive::PRIMTYPE_Sphere
+			|| ((Primitive*)result.data)->m_primtype == Primitive::PRIMTYPE_Box))
 		{
 			//Set the direction and the origin of the ray
 			Vector3 reflectionDiretion = ray.GetRay().Reflect(result.normal);
 			newRay.SetRay(result.point + (reflectionDiretion * 0.01), reflectionDiretion.Normalise());
+#if defined(TINYRAY_STATS)
+			traced = RayStats::STAT_REFLECTION;
+#endif
 		}
 	}
+
+#if defined(TINYRAY_STATS)
+	RayStats::Local().counts[traced] += multiRay + 1;
+#endif
 		colour = TraceScene(pScene, newRay, scenebg, multiRay) * (1. / multiRay);
 
 		for (int i = 0; i < multiRay; i++)
@@ -105,22 +390,35 @@ Colour PathTracer::TraceRefraction(Scene* pScene, Ray ray, Colour scenebg, int m
 {
 	Colour colour = scenebg;
 
+	RAYSTATS_ADD(STAT_PRIMARY, 1);
 	RayHitResult result = pScene->IntersectByRay(ray);
 	Ray newRay = ray;
 
+#if defined(TINYRAY_STATS)
+	//the rays traced below are camera rays unless the ray was redirected
+	RayStats::COUNTER traced = RayStats::STAT_PRIMARY;
+#endif
+
 	//Check tracefag 
 	if (m_traceflag & TRACE_REFRACTION)
 	{
-		//If the m_primtype is PRIMTYPE_Sphere or PRIMTYPE_Box enter into the statement
-		if (((Primitive*)result.data)->m_primtype == Primitive::PRIMTYPE_Sphere
-			|| ((Primitive*)result.data)->m_primtype == Primitive::PRIMTYPE_Box)
+		//If the m_primtype is PRIMTYPE_Sphere or PRIMTYPE_Box enter into the statement, rays into an open sky hit nothing
+		if (result.data && (((Primitive*)result.data)->m_primtype == Primitive::PRIMTYPE_Sphere
+			|| ((Primitive*)result.data)->m_primtype == Primitive::PRIMTYPE_Box))
 		{
 			//Set the direction and the origin of the ray
 			Vector3 refractDiretion = ray.GetRay().Refract(result.normal, 0.99);
 			newRay.SetRay(result.point + (refractDiretion * 0.01), refractDiretion.Normalise());
+#if defined(TINYRAY_STATS)
+			traced = RayStats::STAT_REFRACTION;
+#endif
 		}
 	}
 
+#if defined(TINYRAY_STATS)
+	RayStats::Local().counts[traced] += multiRay + 1;
+#endif
+
 	colour = TraceScene(pScene, newRay, scenebg, multiRay) * (1. / multiRay);
 
 	//Loop until all of the primary rays have been accumulated
@@ -162,90 +460,259 @@ void PathTracer::DoTrace(Scene* pScene)
 	Colour scenebg = pScene->GetBackgroundColour();
 
 	// Statement to decide what type of traceflag and the amount of samples to render
-	int samples = m_traceflag & TRACE_AMBIENT ? 50 : m_traceflag & TRACE_DIFFUSE_AND_SPEC ? 100 : m_traceflag & TRACE_SHADOW ? 500 : m_traceflag & TRACE_REFLECTION ? 250 : m_traceflag & TRACE_REFRACTION ? 250 : 250;
+	int samples = m_samplesPerPixel > 0 ? m_samplesPerPixel : m_traceflag & TRACE_AMBIENT ? 50 : m_traceflag & TRACE_DIFFUSE_AND_SPEC ? 100 : m_traceflag & TRACE_SHADOW ? 500 : m_traceflag & TRACE_REFLECTION ? 250 : m_traceflag & TRACE_REFRACTION ? 250 : 250;
 
-	clock_t time = clock();
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 
 	if (m_renderCount == 0)
 	{
+		if (m_control)
+		{
+			m_control->Start();
+			samples = m_control->ClampSamples(samples);
+		}
+
+		if (m_irradianceCache)
+			UpdateIrradianceCache(pScene, start, camRightVector * (float)pixelDX, camUpVector * (float)pixelDY, camPosition);
+
 		fprintf(stdout, "\rTrace start.\n");
 
+#if defined(TINYRAY_STATS)
+		BeginRayStats();
+#endif
+
+		// samples are traced in passes over the image, every pixel carrying its colour on to the next pass and
+		// every sample seeded by its index so the image comes out the same however it is split. Under a render control the
+		// passes double from one sample so a frame stopped early still has every pixel, otherwise there is one.
+		// Checkpoints are written between passes, which are kept short enough to write them every so often
+		int numpixels = m_buffWidth * m_buffHeight;
+		std::vector<double> costs(m_heatmap == HEATMAP_PATH ? numpixels : 0, 0.0);
+
+		// a sample range is traced as a render of its own samples, seeded as they are in the whole render
+		int firstSample = std::min(m_firstSample, samples);
+		samples = m_numSamples > 0 ? std::min(m_numSamples, samples - firstSample) : samples - firstSample;
+
+		if (samples <= 0)
+			fprintf(stdout, "\rThe sample range starts past the last sample, nothing is traced\n");
+
+		// the first pass of a pixel adds the primary, reflection and refraction paths on top of its samples,
+		// in the range from sample 0
+		int initialPaths = firstSample == 0 ? 3 : 0;
+		Checkpoint::Settings settings = { m_buffWidth, m_buffHeight, samples, firstSample, initialPaths, m_sampleSeed, (int)m_traceflag,
+			{ camPosition[0], camPosition[1], camPosition[2], camViewVector[0], camViewVector[1], camViewVector[2],
+			camUpVector[0], camUpVector[1], camUpVector[2], (float)sceneWidth, (float)sceneHeight } };
+
+		Checkpoint progress;
+		progress.Init(settings);
+
+		bool checkpointing = !m_checkpointFile.empty() && m_heatmap == HEATMAP_NONE;
+		bool resumed = checkpointing && ResumeCheckpoint(m_checkpointFile.c_str(), settings, progress);
+
+		// pixels carried over from the checkpoint have their AOVs filled here, the rest in their first pass
+		if (resumed && m_aovFlags)
+		{
+#pragma omp parallel for schedule (dynamic, 1)
+			for (int i = m_firstRow; i < m_endRow; i++)
+			{
+				for (int j = 0; j < m_buffWidth; j++)
+				{
+					if (progress.m_counts[i * m_buffWidth + j] < 0)
+						continue;
+
+					Vector3 pixel = start + camUpVector * (float)((i + 0.5) * pixelDY) + camRightVector * (float)((j + 0.5) * pixelDX);
+					Ray viewray; viewray.SetRay(camPosition, (pixel - camPosition).Normalise());
+
+					WriteAOVs(pScene, pScene->IntersectByRay(viewray), j, i);
+				}
+			}
+		}
+
+		int firstpass = samples;
+
+		for (int index = m_firstRow * m_buffWidth; index < m_endRow * m_buffWidth; index++)
+		{
+			firstpass = std::min(firstpass, std::max(progress.m_counts[index], 0));
+		}
+
+		int passsamples = (m_control || checkpointing) && m_heatmap != HEATMAP_PRIMARY ? 1 : samples;
+		int maxpasssamples = checkpointing ? 16 : samples;
+
+		std::unique_ptr<ThreadPool> writer(checkpointing ? new ThreadPool(1) : NULL);
+		std::chrono::steady_clock::time_point written = std::chrono::steady_clock::now();
+
 		Colour colour;
-		//TinyRay on multiprocessors using OpenMP!!!
+		for (int first = firstpass; first < samples && !(m_control && m_control->WasStopped());
+			first += passsamples, passsamples = std::min(passsamples * 2, maxpasssamples))
+		{
+			int last = std::min(samples, first + passsamples);
+
+			//TinyRay on multiprocessors using OpenMP!!!
 #pragma omp parallel for schedule (dynamic, 1) private(colour)
-		for (int i = 0; i < m_buffHeight; i += 1) {
-			fprintf(stdout, "\rRendering (%d spp) %5.2f%% (%.2fs Time taken)", samples, 100.* i / (m_buffHeight - 1), (double)(clock() - time) / CLOCKS_PER_SEC);
-			for (int j = 0; j < m_buffWidth; j += 1) {
-
-				//calculate the metric size of a pixel in the view plane (e.g. framebuffer)
-				Vector3 pixel;
-
-				// Anti-Aliasing
-				//for (float x = 0.25f; x <= 1.f; x += 0.25f)
-				//{
-				//	for (float y = 0.25f; y <= 1.f; y += 0.25f)
-				//	{
-						pixel[0] = start[0] + (i + 0.5) * camUpVector[0] * pixelDY
-							+ (j + 0.5) * camRightVector[0] * pixelDX;
-						pixel[1] = start[1] + (i + 0.5) * camUpVector[1] * pixelDY
-							+ (j + 0.5) * camRightVector[1] * pixelDX;
-						pixel[2] = start[2] + (i + 0.5) * camUpVector[2] * pixelDY
-							+ (j + 0.5) * camRightVector[2] * pixelDX;
-
-						/*
-						* setup first generation view ray
-						* In perspective projection, each view ray originates from the eye (camera) position
-						* and pierces through a pixel in the view plane
-						*/
-
-						Ray viewray;
-						viewray.SetRay(camPosition, (pixel - camPosition).Normalise());
-
-						double u = (double)j / (double)m_buffWidth;
-						double v = (double)i / (double)m_buffHeight;
-
-						//trace the scene using the view ray
-						//default colour is the background colour, unless something is hit along the way
-						scenebg = pScene->GetBackgroundColour();
-
-						int multiRay = 5;
-
-						/// Very inefficient way of getting a Reflection and Refraction ray.
-						/// I would suggest commenting out both TraceReflection and TraceRefraction to increase
-						/// render rate.
-						// loop until the primary rays have been accumulated
-						colour = TraceScene(pScene, viewray, scenebg, multiRay) * (1. / samples);
-						colour = colour + TraceReflection(pScene, viewray, scenebg, multiRay) * (1. / samples);
-						colour = colour + TraceRefraction(pScene, viewray, scenebg, multiRay) * (1. / samples);
-						for (int i = 0; i < samples; i++)
-						{
-							//change
-							if (TRACE_REFLECTION)
+			for (int i = m_firstRow; i < m_endRow; i += 1) {
+				if (m_control && m_control->ShouldStop())
+					continue;
+
+				PROFILE_SCOPE_ARG("TraceRow", i);
+				fprintf(stdout, "\rRendering (%d/%d spp) %5.2f%% (%.2fs Time taken)", last, samples, 100.* i / (m_buffHeight - 1),
+					std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+				for (int j = 0; j < m_buffWidth; j += 1) {
+
+					//calculate the metric size of a pixel in the view plane (e.g. framebuffer)
+					Vector3 pixel;
+
+					// Anti-Aliasing
+					//for (float x = 0.25f; x <= 1.f; x += 0.25f)
+					//{
+					//	for (float y = 0.25f; y <= 1.f; y += 0.25f)
+					//	{
+							pixel[0] = start[0] + (i + 0.5) * camUpVector[0] * pixelDY
+								+ (j + 0.5) * camRightVector[0] * pixelDX;
+							pixel[1] = start[1] + (i + 0.5) * camUpVector[1] * pixelDY
+								+ (j + 0.5) * camRightVector[1] * pixelDX;
+							pixel[2] = start[2] + (i + 0.5) * camUpVector[2] * pixelDY
+								+ (j + 0.5) * camRightVector[2] * pixelDX;
+
+							/*
+							* setup first generation view ray
+							* In perspective projection, each view ray originates from the eye (camera) position
+							* and pierces through a pixel in the view plane
+							*/
+
+							Ray viewray;
+							viewray.SetRay(camPosition, (pixel - camPosition).Normalise());
+
+							int index = i * m_buffWidth + j;
+							int done = progress.m_counts[index];
+
+							if (done >= last)
+								continue;
+
+							//trace the scene using the view ray
+							//default colour is the background colour, unless something is hit along the way
+							scenebg = pScene->GetBackgroundColour();
+
+							int multiRay = 5;
+
+							unsigned long long cost = m_heatmap == HEATMAP_PATH ? RayStats::GetTraversalCost() : 0;
+
+							/// Very inefficient way of getting a Reflection and Refraction ray.
+							/// I would suggest commenting out both TraceReflection and TraceRefraction to increase
+							/// render rate.
+							// loop until the primary rays have been accumulated
+							if (done < 0)
 							{
-								colour = colour + TraceReflection(pScene, viewray, scenebg, multiRay) * (1. / samples);
+								Random::SeedPixel(j, i + m_sampleSeed * m_buffHeight);
+
+								RayHitResult primaryhit = Ray::s_defaultHitResult;
+								if (m_heatmap == HEATMAP_PRIMARY)
+								{
+									colour = TraceHeatmap(pScene, viewray, m_aovFlags ? &primaryhit : NULL);
+								}
+								else if (initialPaths == 0)
+								{
+									colour = Colour(0.0f, 0.0f, 0.0f);
+
+									if (m_aovFlags)
+										primaryhit = pScene->IntersectByRay(viewray);
+								}
+								else
+								{
+									RAYSTATS_ADD(STAT_PRIMARY, 1);
+									colour = TraceScene(pScene, viewray, scenebg, multiRay, false, m_aovFlags ? &primaryhit : NULL) * (1. / samples);
+									colour = colour + TraceReflection(pScene, viewray, scenebg, multiRay) * (1. / samples);
+									colour = colour + TraceRefraction(pScene, viewray, scenebg, multiRay) * (1. / samples);
+								}
+
+								if (m_aovFlags)
+									WriteAOVs(pScene, primaryhit, j, i);
 							}
-							else if (TRACE_REFRACTION)
+							else
 							{
-								colour = colour + TraceRefraction(pScene, viewray, scenebg, multiRay) * (1. / samples);
+								colour = Colour(progress.m_colours[index * 3], progress.m_colours[index * 3 + 1], progress.m_colours[index * 3 + 2]);
 							}
-							else
+
+							for (int s = done > 0 ? done : 0; s < last && m_heatmap != HEATMAP_PRIMARY; s++)
 							{
-								colour = colour + TraceScene(pScene, viewray, scenebg, multiRay) * (1. / samples);
+								Random::SeedSample(j, i + m_sampleSeed * m_buffHeight, firstSample + s);
+
+								//change
+								if (TRACE_REFLECTION)
+								{
+									colour = colour + TraceReflection(pScene, viewray, scenebg, multiRay) * (1. / samples);
+								}
+								else if (TRACE_REFRACTION)
+								{
+									colour = colour + TraceRefraction(pScene, viewray, scenebg, multiRay) * (1. / samples);
+								}
+								else
+								{
+									RAYSTATS_ADD(STAT_PRIMARY, 1);
+									colour = colour + TraceScene(pScene, viewray, scenebg, multiRay) * (1. / samples);
+								}
 							}
-						}
-	/*				}
-				}*/
-				/*
-				* Draw the pixel as a coloured rectangle
-				*/
+		/*				}
+					}*/
+
+					progress.m_colours[index * 3] = colour[0];
+					progress.m_colours[index * 3 + 1] = colour[1];
+					progress.m_colours[index * 3 + 2] = colour[2];
+					progress.m_counts[index] = last;
+
+					if (m_heatmap == HEATMAP_PATH)
+						costs[index] += (double)(RayStats::GetTraversalCost() - cost);
+				}
+			}
+
+			bool finished = last >= samples || (m_control && m_control->WasStopped());
+
+			if (checkpointing && (finished ||
+				std::chrono::duration<double>(std::chrono::steady_clock::now() - written).count() >= m_checkpointInterval))
+			{
+				WriteCheckpoint(*writer, m_checkpointFile.c_str(), progress);
+				written = std::chrono::steady_clock::now();
+			}
+		}
+
+		// a frame with nothing left to trace still leaves its checkpoint behind
+		if (checkpointing && firstpass >= samples)
+			WriteCheckpoint(*writer, m_checkpointFile.c_str(), progress);
+
+		if (writer)
+			writer->Wait();
+
+		/*
+		* Draw the pixels as coloured rectangles, scaled up to the full count where a row was stopped short
+		*/
+		int leastSamples = samples;
+
+		for (int i = m_firstRow; i < m_endRow; i++)
+		{
+			for (int j = 0; j < m_buffWidth; j++)
+			{
+				int index = i * m_buffWidth + j;
+				int count = progress.m_counts[index];
+
+				leastSamples = std::min(leastSamples, std::max(count, 0));
+
+				//the cost of a camera sample, each of the calls above traces one
+				if (m_heatmap == HEATMAP_PATH && count > 0)
+					colour = GetHeatmapColour(costs[index] / (count + initialPaths));
+				else
+					colour = progress.GetColour(index);
+
 				m_framebuffer->WriteRGBToFramebuffer(colour, j, i);
 			}
-			//Draw each pixel to the frame buffer, commected out due to it increasing the render time
-			glFlush();
 		}
-		//glDrawPixels(m_buffWidth, m_buffHeight, GL_RGBA, GL_FLOAT, m_framebuffer->GetBuffer());
 
-		fprintf(stdout, "\r\nDone!!!", ((float)time / CLOCKS_PER_SEC));
+		if (m_control && m_control->WasStopped())
+			fprintf(stdout, "\rStopped with %d of %d samples per pixel traced in every row\n", leastSamples, samples);
+
+		fprintf(stdout, "\r\nDone!!!");
+
+#if defined(TINYRAY_STATS)
+		fprintf(stdout, "\n");
+		EndRayStats();
+#endif
 		m_renderCount++;
 	}
 }
\ No newline at end of file
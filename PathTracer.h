@@ -10,6 +10,11 @@
 #pragma once
 
 #include "Renderer.h"
+#include "IrradianceCache.h"
+#include "Checkpoint.h"
+
+class EnvironmentMap;
+class ThreadPool;
 
 class PathTracer : public Renderer
 {
@@ -19,8 +24,30 @@ public:
 
 	// Virtual methods with overrides to override the parent class 
 	virtual void DoTrace(Scene* pScene) override;
-	virtual Colour TraceScene(Scene* pScene, Ray& ray, Colour incolour, int multiRay, bool shadowray = false) override;
+	virtual Colour TraceScene(Scene* pScene, Ray& ray, Colour incolour, int multiRay, bool shadowray = false, RayHitResult* primaryhit = NULL) override;
+	virtual Colour GetAlbedo(const RayHitResult& hit) override;
 	Colour TraceReflection(Scene* pScene, Ray ray, Colour incolour, int multiRay);
 	Colour TraceRefraction(Scene* pScene, Ray ray, Colour incolour, int multiRay);
+
+private:
+	// TraceScene for a ray leaving a diffuse surface with the given density per steradian, 0 for any other ray.
+	// An environment map hit by the ray is weighted against the light sampled from it at that surface.
+	// segment counts the rays of the path so far, this one included, for the path length statistics
+	Colour TracePath(Scene* pScene, Ray& ray, Colour incolour, int multiRay, int segment, float bouncePdf, RayHitResult* primaryhit);
+
+	// Light from the environment map reaching a diffuse surface, by sampling the bright parts of the map
+	Colour SampleEnvironment(Scene* pScene, EnvironmentMap* environment, const Vector3& point, const Vector3& normal);
+
+	// Add cache records where the diffuse bounces from the pixels of this frame land and no record is close enough
+	void UpdateIrradianceCache(Scene* pScene, const Vector3& start, const Vector3& stepX, const Vector3& stepY, const Vector3& camPosition);
+
+	// A new cache record from paths traced over the hemisphere above a surface point
+	void GatherIrradiance(Scene* pScene, const Vector3& point, const Vector3& normal, Colour incolour, IrradianceCache::Record& record);
+
+	// Load the progress of this frame from a checkpoint file, false if there is none of this frame and seed
+	bool ResumeCheckpoint(const char* filename, const Checkpoint::Settings& settings, Checkpoint& progress);
+
+	// Copy the progress and write it on the writer's thread once the previous write has finished
+	void WriteCheckpoint(ThreadPool& writer, const char* filename, const Checkpoint& progress);
 };
 
@@ -25,5 +25,15 @@ class Plane : public Primitive
 		RayHitResult	IntersectByRay(Ray& ray);
 
 		void SetPlane(const Vector3& normal, double offset);
+
+		inline Vector3& GetNormal()
+		{
+			return m_normal;
+		}
+
+		inline double GetOffset()
+		{
+			return m_offset;
+		}
 };
 
@@ -13,6 +13,14 @@
 
 class Material;
 
+//A reference to a primitive stored in the scene's per-type primitive arrays,
+//this is what the leaves of an acceleration structure point at
+struct PrimRef
+{
+	int		type;			//one of Primitive::PRIMTYPE
+	int		index;			//index into the array of that type
+};
+
 class Primitive
 {
 	private:
@@ -25,7 +33,9 @@ class Primitive
 			PRIMTYPE_Sphere,
 			PRIMTYPE_Triangle,
 			PRIMTYPE_Box,
-			PRIMTYPE_TRIMESH
+			PRIMTYPE_TRIMESH,
+			PRIMTYPE_Instance,
+			PRIMTYPE_COUNT
 		};
 
 		PRIMTYPE				m_primtype;
@@ -41,7 +51,7 @@ class Primitive
 			m_pMaterial = pMat;
 		}
 
-		inline Material*		GetMaterial()
+		inline Material*		GetMaterial() const
 		{
 			return m_pMaterial;
 		}
@@ -0,0 +1,489 @@
+#include <math.h>
+#include "PrimitiveArrays.h"
+#include "RayStats.h"
+#include "Material.h"
+#include "Sphere.h"
+#include "Plane.h"
+#include "Box.h"
+#include "Triangle.h"
+#include "TriMesh.h"
+#include "MeshInstance.h"
+
+PrimitiveArrays::PrimitiveArrays()
+{
+}
+
+PrimitiveArrays::~PrimitiveArrays()
+{
+}
+
+void PrimitiveArrays::Clear()
+{
+	m_spheres.clear();
+	m_planes.clear();
+	m_boxes.clear();
+	m_boxTransforms.clear();
+	m_triangles.clear();
+	m_triangleSource.clear();
+	m_instances.clear();
+
+	for (int i = 0; i < Primitive::PRIMTYPE_COUNT; i++)
+	{
+		m_owners[i].clear();
+		m_flags[i].clear();
+	}
+}
+
+int PrimitiveArrays::AddOwner(int type, Primitive* owner, unsigned char flags)
+{
+	Material* mat = owner->GetMaterial();
+
+	if (!mat || mat->CastShadow())
+		flags |= PRIMFLAG_CASTSHADOW;
+
+	m_owners[type].push_back(owner);
+	m_flags[type].push_back(flags);
+
+	return (int)m_owners[type].size() - 1;
+}
+
+int PrimitiveArrays::AddSphere(Sphere* sphere)
+{
+	SphereData data;
+	data.centre = sphere->GetCentre();
+	data.radius = (float)sphere->GetRadius();
+	data.radiusSqr = data.radius*data.radius;
+	m_spheres.push_back(data);
+
+	return AddOwner(Primitive::PRIMTYPE_Sphere, sphere, 0);
+}
+
+int PrimitiveArrays::AddPlane(Plane* plane)
+{
+	PlaneData data;
+	data.normal = plane->GetNormal();
+	data.offset = (float)plane->GetOffset();
+	m_planes.push_back(data);
+
+	return AddOwner(Primitive::PRIMTYPE_Plane, plane, 0);
+}
+
+int PrimitiveArrays::AddBox(Box* box)
+{
+	BoxData data;
+	data.bounds = box->GetObjectBounds();
+	data.transform = -1;
+
+	if (box->HasTransform())
+	{
+		data.transform = (int)m_boxTransforms.size();
+		m_boxTransforms.push_back(box->GetWorldToObject());
+	}
+
+	m_boxes.push_back(data);
+
+	return AddOwner(Primitive::PRIMTYPE_Box, box, 0);
+}
+
+int PrimitiveArrays::AddTriangle(const Triangle* triangle, Primitive* owner, bool cullBackface)
+{
+	TriangleData data;
+	data.v0 = triangle->m_vertices[0].m_position;
+	data.e1 = triangle->m_vertices[1].m_position - triangle->m_vertices[0].m_position;
+	data.e2 = triangle->m_vertices[2].m_position - triangle->m_vertices[0].m_position;
+	m_triangles.push_back(data);
+	m_triangleSource.push_back(triangle);
+
+	return AddOwner(Primitive::PRIMTYPE_Triangle, owner, cullBackface ? PRIMFLAG_CULLBACKFACE : 0);
+}
+
+int PrimitiveArrays::AddInstance(MeshInstance* instance)
+{
+	InstanceData data;
+	data.toObject = instance->GetWorldToObject();
+	data.mesh = instance->GetMesh();
+	m_instances.push_back(data);
+
+	return AddOwner(Primitive::PRIMTYPE_Instance, instance, 0);
+}
+
+void PrimitiveArrays::UpdatePrimitive(const PrimRef& ref)
+{
+	Primitive* owner = m_owners[ref.type][ref.index];
+
+	switch (ref.type)
+	{
+	case Primitive::PRIMTYPE_Sphere:
+		{
+			Sphere* sphere = static_cast<Sphere*>(owner);
+			SphereData& data = m_spheres[ref.index];
+			data.centre = sphere->GetCentre();
+			data.radius = (float)sphere->GetRadius();
+			data.radiusSqr = data.radius*data.radius;
+		}
+		break;
+	case Primitive::PRIMTYPE_Plane:
+		{
+			Plane* plane = static_cast<Plane*>(owner);
+			m_planes[ref.index].normal = plane->GetNormal();
+			m_planes[ref.index].offset = (float)plane->GetOffset();
+		}
+		break;
+	case Primitive::PRIMTYPE_Box:
+		{
+			Box* box = static_cast<Box*>(owner);
+			BoxData& data = m_boxes[ref.index];
+			data.bounds = box->GetObjectBounds();
+
+			if (!box->HasTransform())
+			{
+				//a dropped transform slot is left unused until the next full rebuild
+				data.transform = -1;
+			}
+			else if (data.transform < 0)
+			{
+				data.transform = (int)m_boxTransforms.size();
+				m_boxTransforms.push_back(box->GetWorldToObject());
+			}
+			else
+			{
+				m_boxTransforms[data.transform] = box->GetWorldToObject();
+			}
+		}
+		break;
+	case Primitive::PRIMTYPE_Triangle:
+		{
+			const Triangle* triangle = m_triangleSource[ref.index];
+			TriangleData& data = m_triangles[ref.index];
+			data.v0 = triangle->m_vertices[0].m_position;
+			data.e1 = triangle->m_vertices[1].m_position - triangle->m_vertices[0].m_position;
+			data.e2 = triangle->m_vertices[2].m_position - triangle->m_vertices[0].m_position;
+		}
+		break;
+	case Primitive::PRIMTYPE_Instance:
+		{
+			MeshInstance* instance = static_cast<MeshInstance*>(owner);
+			m_instances[ref.index].toObject = instance->GetWorldToObject();
+			m_instances[ref.index].mesh = instance->GetMesh();
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+BoundingBox PrimitiveArrays::GetBounds(const PrimRef& ref) const
+{
+	BoundingBox bounds;
+
+	switch (ref.type)
+	{
+	case Primitive::PRIMTYPE_Sphere:
+		{
+			const SphereData& s = m_spheres[ref.index];
+			Vector3 r(s.radius, s.radius, s.radius);
+			bounds = BoundingBox(s.centre - r, s.centre + r);
+		}
+		break;
+	case Primitive::PRIMTYPE_Box:
+		bounds = static_cast<Box*>(m_owners[ref.type][ref.index])->GetBounds();
+		break;
+	case Primitive::PRIMTYPE_Triangle:
+		{
+			const TriangleData& tri = m_triangles[ref.index];
+			bounds.Expand(tri.v0);
+			bounds.Expand(tri.v0 + tri.e1);
+			bounds.Expand(tri.v0 + tri.e2);
+		}
+		break;
+	case Primitive::PRIMTYPE_Instance:
+		bounds = static_cast<MeshInstance*>(m_owners[ref.type][ref.index])->GetBounds();
+		break;
+	default:
+		//planes are unbounded and are never put into a BVH
+		break;
+	}
+
+	return bounds;
+}
+
+bool PrimitiveArrays::IntersectSphere(int index, Ray& ray, PrimHit& hit) const
+{
+	const SphereData& s = m_spheres[index];
+	const Vec4& dir = ray.GetRay().GetVec4();
+	Vec4 oc = _mm_sub_ps(ray.GetRayStart().GetVec4(), s.centre.GetVec4());
+
+	float a = Dot3(dir, dir);
+	float b = Dot3(oc, dir);
+	float c = Dot3(oc, oc) - s.radiusSqr;
+	float disc = b*b - a*c;
+
+	if (disc < 0.0f)
+		return false;
+
+	disc = sqrtf(disc);
+
+	//the far root is the exit point when the ray starts inside the sphere
+	float t = (-b - disc) / a;
+	if (t <= 0.0f)
+		t = (-b + disc) / a;
+
+	if (t <= 0.0f || t >= hit.t)
+		return false;
+
+	hit.t = t;
+	return true;
+}
+
+bool PrimitiveArrays::IntersectPlane(int index, Ray& ray, PrimHit& hit) const
+{
+	const PlaneData& p = m_planes[index];
+	float ndotr = Dot3(p.normal.GetVec4(), ray.GetRay().GetVec4());
+
+	if (fabsf(ndotr) < 1e-5f)
+		return false;
+
+	float t = -(Dot3(ray.GetRayStart().GetVec4(), p.normal.GetVec4()) + p.offset) / ndotr;
+
+	if (t <= 0.0f || t >= hit.t)
+		return false;
+
+	hit.t = t;
+	return true;
+}
+
+bool PrimitiveArrays::IntersectBox(int index, Ray& ray, PrimHit& hit) const
+{
+	const BoxData& box = m_boxes[index];
+	Vec4 origin = ray.GetRayStart().GetVec4();
+	Vec4 dir = ray.GetRay().GetVec4();
+
+	if (box.transform >= 0)
+	{
+		const Transform& toObject = m_boxTransforms[box.transform];
+		origin = toObject.TransformPoint(origin);
+		dir = toObject.TransformVector(dir);
+	}
+
+	Vec4 invdir = _mm_div_ps(_mm_set1_ps(1.0f), dir);
+	float t;
+	int face;
+
+	if (!box.bounds.IntersectFaces(origin, dir, invdir, hit.t, t, face))
+		return false;
+
+	hit.t = t;
+	hit.face = face;
+	return true;
+}
+
+bool PrimitiveArrays::IntersectTriangle(int index, Ray& ray, PrimHit& hit) const
+{
+	//Moller-Trumbore with the edges precomputed
+	const TriangleData& tri = m_triangles[index];
+	const Vec4& dir = ray.GetRay().GetVec4();
+
+	Vec4 P = Cross3(dir, tri.e2.GetVec4());
+	float det = Dot3(tri.e1.GetVec4(), P);
+
+	//det is positive for front facing triangles
+	if (m_flags[Primitive::PRIMTYPE_Triangle][index] & PRIMFLAG_CULLBACKFACE)
+	{
+		if (det <= 1e-12f)
+			return false;
+	}
+	else if (fabsf(det) <= 1e-12f)
+	{
+		return false;
+	}
+
+	float inv_det = 1.0f / det;
+	Vec4 T = _mm_sub_ps(ray.GetRayStart().GetVec4(), tri.v0.GetVec4());
+
+	float u = Dot3(T, P) * inv_det;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+
+	Vec4 Q = Cross3(T, tri.e1.GetVec4());
+
+	float v = Dot3(dir, Q) * inv_det;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	float t = Dot3(tri.e2.GetVec4(), Q) * inv_det;
+	if (t <= 0.0f || t >= hit.t)
+		return false;
+
+	hit.t = t;
+	hit.u = u;
+	hit.v = v;
+	return true;
+}
+
+bool PrimitiveArrays::IntersectInstance(int index, Ray& ray, PrimHit& hit) const
+{
+	//the ray direction is not renormalised in mesh space so distances carry over unchanged
+	const InstanceData& instance = m_instances[index];
+	Ray localray;
+	localray.SetRay(Vector3(instance.toObject.TransformPoint(ray.GetRayStart().GetVec4())),
+		Vector3(instance.toObject.TransformVector(ray.GetRay().GetVec4())));
+
+	PrimHit localhit = hit;
+
+	if (!instance.mesh->IntersectMesh(localray, localhit))
+		return false;
+
+	hit.t = localhit.t;
+	hit.u = localhit.u;
+	hit.v = localhit.v;
+	hit.triangle = localhit.ref.index;
+	return true;
+}
+
+bool PrimitiveArrays::IntersectPlanes(Ray& ray, PrimHit& hit, bool shadowray) const
+{
+	bool found = false;
+	const unsigned char* flags = m_flags[Primitive::PRIMTYPE_Plane].data();
+	int count = (int)m_planes.size();
+
+	for (int i = 0; i < count; i++)
+	{
+		if (shadowray && !(flags[i] & PRIMFLAG_CASTSHADOW))
+			continue;
+
+		RAYSTATS_ADD(STAT_PRIMITIVES, 1);
+
+		if (IntersectPlane(i, ray, hit))
+		{
+			hit.ref.type = Primitive::PRIMTYPE_Plane;
+			hit.ref.index = i;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+bool PrimitiveArrays::IntersectLeaf(const PrimRef* refs, int count, Ray& ray, PrimHit& hit, bool shadowray) const
+{
+	bool found = false;
+
+	for (int i = 0; i < count; i++)
+	{
+		const PrimRef& ref = refs[i];
+
+		if (shadowray && !(m_flags[ref.type][ref.index] & PRIMFLAG_CASTSHADOW))
+			continue;
+
+		RAYSTATS_ADD(STAT_PRIMITIVES, 1);
+
+		bool hitprim = false;
+
+		switch (ref.type)
+		{
+		case Primitive::PRIMTYPE_Triangle:
+			hitprim = IntersectTriangle(ref.index, ray, hit);
+			break;
+		case Primitive::PRIMTYPE_Sphere:
+			hitprim = IntersectSphere(ref.index, ray, hit);
+			break;
+		case Primitive::PRIMTYPE_Box:
+			hitprim = IntersectBox(ref.index, ray, hit);
+			break;
+		case Primitive::PRIMTYPE_Instance:
+			hitprim = IntersectInstance(ref.index, ray, hit);
+			break;
+		case Primitive::PRIMTYPE_Plane:
+			hitprim = IntersectPlane(ref.index, ray, hit);
+			break;
+		}
+
+		if (hitprim)
+		{
+			hit.ref = ref;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+void PrimitiveArrays::ResolveHit(Ray& ray, const PrimHit& hit, RayHitResult& result) const
+{
+	result.t = hit.t;
+	result.point = ray.GetRayStart() + ray.GetRay()*hit.t;
+	result.data = m_owners[hit.ref.type][hit.ref.index];
+	result.footprint = 0.0f;
+
+	switch (hit.ref.type)
+	{
+	case Primitive::PRIMTYPE_Sphere:
+		{
+			const SphereData& s = m_spheres[hit.ref.index];
+			result.normal = (result.point - s.centre) * (1.0f / s.radius);
+		}
+		break;
+	case Primitive::PRIMTYPE_Plane:
+		result.normal = m_planes[hit.ref.index].normal;
+		break;
+	case Primitive::PRIMTYPE_Box:
+		{
+			const BoxData& box = m_boxes[hit.ref.index];
+			result.normal = BoundingBox::GetFaceNormal(hit.face);
+
+			if (box.transform >= 0)
+				result.normal = m_boxTransforms[box.transform].TransformNormalByInverse(result.normal);
+		}
+		break;
+	case Primitive::PRIMTYPE_Triangle:
+		{
+			const Triangle* tri = m_triangleSource[hit.ref.index];
+			float w = 1.0f - hit.u - hit.v;
+
+			Vector3 normal =
+				tri->m_vertices[0].m_normal*w +
+				tri->m_vertices[1].m_normal*hit.u +
+				tri->m_vertices[2].m_normal*hit.v;
+
+			result.normal = normal.Normalise();
+			result.texcoord =
+				tri->m_vertices[0].m_texcoords*w +
+				tri->m_vertices[1].m_texcoords*hit.u +
+				tri->m_vertices[2].m_texcoords*hit.v;
+
+			//texture coordinates per unit length from the ratio of the triangle's areas in both spaces
+			const TriangleData& data = m_triangles[hit.ref.index];
+			Vector3 uv1 = tri->m_vertices[1].m_texcoords - tri->m_vertices[0].m_texcoords;
+			Vector3 uv2 = tri->m_vertices[2].m_texcoords - tri->m_vertices[0].m_texcoords;
+			float uvarea = fabsf(uv1[0]*uv2[1] - uv1[1]*uv2[0]);
+			float area = data.e1.CrossProduct(data.e2).Norm();
+
+			if (area > 0.0f)
+				result.footprint = ray.GetConeWidth(hit.t) * sqrtf(uvarea / area);
+		}
+		break;
+	case Primitive::PRIMTYPE_Instance:
+		{
+			//resolve in mesh space then bring the normal back to world space
+			const InstanceData& instance = m_instances[hit.ref.index];
+			Ray localray;
+			localray.SetRay(Vector3(instance.toObject.TransformPoint(ray.GetRayStart().GetVec4())),
+				Vector3(instance.toObject.TransformVector(ray.GetRay().GetVec4())));
+
+			//the cone is scaled into mesh space by the average scale of the transform
+			float scale = cbrtf(fabsf(instance.toObject.GetDeterminant()));
+			localray.SetCone(ray.GetConeWidth(0.0) * scale, ray.GetConeSpread() * scale);
+
+			PrimHit localhit = hit;
+			localhit.ref.type = Primitive::PRIMTYPE_Triangle;
+			localhit.ref.index = hit.triangle;
+
+			instance.mesh->ResolveHit(localray, localhit, result);
+
+			result.point = ray.GetRayStart() + ray.GetRay()*hit.t;
+			result.normal = instance.toObject.TransformNormalByInverse(result.normal);
+			result.data = m_owners[hit.ref.type][hit.ref.index];
+		}
+		break;
+	}
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <vector>
+#include "Primitive.h"
+#include "BoundingBox.h"
+#include "Transform.h"
+#include "Ray.h"
+
+class Sphere;
+class Plane;
+class Box;
+class Triangle;
+class TriMesh;
+class MeshInstance;
+
+//The closest hit found so far while intersecting the primitive arrays.
+//Only t and enough to reconstruct the hit are kept, the full RayHitResult
+//is resolved once for the final hit rather than for every candidate
+struct PrimHit
+{
+	float		t;
+	float		u;			//barycentric coordinates for triangles
+	float		v;
+	int			face;		//face hit for boxes, see BoundingBox::IntersectFaces
+	int			triangle;	//triangle hit inside the mesh of an instance
+	PrimRef		ref;
+};
+
+//Scene primitives segregated by type into contiguous arrays. Each type has
+//its own non-virtual intersection routine so that the inner loops don't go
+//through Primitive::IntersectByRay
+class PrimitiveArrays
+{
+	public:
+		enum PRIMFLAGS
+		{
+			PRIMFLAG_CASTSHADOW = 0x1,		//the primitive occludes shadow rays
+			PRIMFLAG_CULLBACKFACE = 0x1 << 1	//back facing triangles are ignored
+		};
+
+	private:
+		struct SphereData
+		{
+			Vector3			centre;
+			float			radius;
+			float			radiusSqr;
+		};
+
+		struct PlaneData
+		{
+			Vector3			normal;
+			float			offset;
+		};
+
+		//boxes are stored as an AABB, oriented boxes as the slabs of their
+		//object space AABB plus the transform into that space
+		struct BoxData
+		{
+			BoundingBox		bounds;
+			int				transform;		//index into m_boxTransforms, -1 for an axis aligned box
+		};
+
+		//instances keep the transform into the space of their shared mesh
+		struct InstanceData
+		{
+			Transform		toObject;
+			const TriMesh*	mesh;
+		};
+
+		struct TriangleData
+		{
+			Vector3			v0;
+			Vector3			e1;
+			Vector3			e2;
+		};
+
+		std::vector<SphereData>			m_spheres;
+		std::vector<PlaneData>			m_planes;
+		std::vector<BoxData>			m_boxes;
+		std::vector<Transform>			m_boxTransforms;
+		std::vector<TriangleData>		m_triangles;
+		std::vector<InstanceData>		m_instances;
+
+		std::vector<unsigned char>		m_flags[Primitive::PRIMTYPE_COUNT];
+
+		//cold data, only touched once a hit is resolved
+		std::vector<Primitive*>			m_owners[Primitive::PRIMTYPE_COUNT];
+		std::vector<const Triangle*>	m_triangleSource;
+
+		int		AddOwner(int type, Primitive* owner, unsigned char flags);
+
+		bool	IntersectSphere(int index, Ray& ray, PrimHit& hit) const;
+		bool	IntersectPlane(int index, Ray& ray, PrimHit& hit) const;
+		bool	IntersectBox(int index, Ray& ray, PrimHit& hit) const;
+		bool	IntersectTriangle(int index, Ray& ray, PrimHit& hit) const;
+		bool	IntersectInstance(int index, Ray& ray, PrimHit& hit) const;
+
+	public:
+		PrimitiveArrays();
+		~PrimitiveArrays();
+
+		void	Clear();
+
+		//Add a primitive to the array of its type, returns its index in that array
+		int		AddSphere(Sphere* sphere);
+		int		AddPlane(Plane* plane);
+		int		AddBox(Box* box);
+		int		AddTriangle(const Triangle* triangle, Primitive* owner, bool cullBackface);
+		int		AddInstance(MeshInstance* instance);
+
+		//Re-read a primitive from its owner after the owner has been moved or reshaped
+		void	UpdatePrimitive(const PrimRef& ref);
+
+		inline int GetCount(int type) const
+		{
+			return (int)m_owners[type].size();
+		}
+
+		inline Primitive* GetOwner(const PrimRef& ref) const
+		{
+			return m_owners[ref.type][ref.index];
+		}
+
+		BoundingBox		GetBounds(const PrimRef& ref) const;
+
+		//Intersect every plane, planes are unbounded and live outside of the BVH
+		bool	IntersectPlanes(Ray& ray, PrimHit& hit, bool shadowray) const;
+
+		//Intersect the primitives referenced by a BVH leaf
+		bool	IntersectLeaf(const PrimRef* refs, int count, Ray& ray, PrimHit& hit, bool shadowray) const;
+
+		//Fill in the shading information for the closest hit
+		void	ResolveHit(Ray& ray, const PrimHit& hit, RayHitResult& result) const;
+};
+
+//Forwards the leaves reached during BVH traversal to a set of primitive arrays
+struct PrimitiveLeafIntersector
+{
+	const PrimitiveArrays*	primitives;
+	Ray*					ray;
+	PrimHit*				hit;
+	bool					shadowray;
+	bool					found;
+
+	inline float operator()(const PrimRef* refs, int count, float tmax)
+	{
+		found |= primitives->IntersectLeaf(refs, count, *ray, *hit, shadowray);
+		return hit->t;
+	}
+};
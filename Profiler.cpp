@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include "Profiler.h"
+
+//A thread's ring of events. Rings are never freed, the events of a thread that has
+//exited stay behind to be written rather than leaving a dangling pointer
+struct EventRing
+{
+	std::vector<Profiler::Event>	events;
+	unsigned long long				recorded;	//events ever recorded, the ring holds the last events.size()
+	int								tid;
+};
+
+std::atomic<bool> Profiler::s_enabled(false);
+
+static std::mutex s_mutex;
+static std::vector<EventRing*> s_rings;
+static thread_local EventRing* s_ring = NULL;
+static int s_capacity = 65536;
+static long long s_origin = 0;
+
+void Profiler::Enable(int eventsPerThread)
+{
+	{
+		std::unique_lock<std::mutex> lock(s_mutex);
+
+		//threads already recording keep the size of their ring
+		s_capacity = eventsPerThread > 0 ? eventsPerThread : 1;
+
+		if (!s_enabled)
+			s_origin = Now();
+	}
+
+	s_enabled = true;
+}
+
+long long Profiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::Record(const char* name, long long start, long long end, int arg)
+{
+	if (!s_ring)
+	{
+		std::unique_lock<std::mutex> lock(s_mutex);
+
+		s_ring = new EventRing;
+		s_ring->events.resize(s_capacity);
+		s_ring->recorded = 0;
+		s_ring->tid = (int)s_rings.size();
+		s_rings.push_back(s_ring);
+	}
+
+	Event& event = s_ring->events[s_ring->recorded % s_ring->events.size()];
+	event.name = name;
+	event.start = start;
+	event.duration = end - start;
+	event.arg = arg;
+
+	s_ring->recorded++;
+}
+
+bool Profiler::WriteTrace(const char* filename)
+{
+	FILE* file = fopen(filename, "w");
+
+	if (!file)
+		return false;
+
+	std::unique_lock<std::mutex> lock(s_mutex);
+
+	unsigned long long dropped = 0;
+	bool first = true;
+
+	fprintf(file, "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+	for (size_t r = 0; r < s_rings.size(); r++)
+	{
+		const EventRing* ring = s_rings[r];
+		unsigned long long size = ring->events.size();
+		unsigned long long count = ring->recorded < size ? ring->recorded : size;
+
+		dropped += ring->recorded - count;
+
+		fprintf(file, "%s{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": { \"name\": \"thread %d\" } }",
+			first ? "" : ",\n", ring->tid, ring->tid);
+		first = false;
+
+		//oldest first, Chrome sorts them anyway but the file reads better
+		for (unsigned long long i = ring->recorded - count; i < ring->recorded; i++)
+		{
+			const Event& event = ring->events[i % size];
+
+			fprintf(file, ",\n{ \"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+				event.name, ring->tid, (double)(event.start - s_origin) * 1e-3, (double)event.duration * 1e-3);
+
+			if (event.arg >= 0)
+				fprintf(file, ", \"args\": { \"n\": %d }", event.arg);
+
+			fprintf(file, " }");
+		}
+	}
+
+	fprintf(file, "\n] }\n");
+
+	if (dropped > 0)
+		printf("Profiler: %llu events were dropped from full rings\n", dropped);
+
+	return fclose(file) == 0;
+}
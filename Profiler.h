@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+
+//Timeline of the phases of a run, written as a Chrome trace (chrome://tracing or
+//ui.perfetto.dev). Markers are timed on a monotonic wall clock and kept in a ring
+//buffer per thread, a full buffer drops its oldest events. Nothing is recorded until
+//Enable is called, so the markers left in the code cost a flag test otherwise
+class Profiler
+{
+	public:
+		struct Event
+		{
+			const char*	name;					//a string literal, only the pointer is kept
+			long long	start;					//nanoseconds on the monotonic clock
+			long long	duration;
+			int			arg;					//shown as the event's argument, -1 for none
+		};
+
+		//Start recording, each thread keeps its last eventsPerThread events
+		static void Enable(int eventsPerThread = 65536);
+
+		static inline bool IsEnabled()
+		{
+			return s_enabled.load(std::memory_order_relaxed);
+		}
+
+		//Nanoseconds on the monotonic clock
+		static long long Now();
+
+		static void Record(const char* name, long long start, long long end, int arg);
+
+		//Write the events of every thread as Chrome trace JSON. Only call this while nothing is being recorded
+		static bool WriteTrace(const char* filename);
+
+	private:
+		static std::atomic<bool>	s_enabled;
+};
+
+//Records the time from its construction to the end of the enclosing scope
+class ProfileScope
+{
+	private:
+		const char*	m_name;
+		int			m_arg;
+		long long	m_start;
+
+	public:
+		ProfileScope(const char* name, int arg = -1)
+		{
+			m_name = name;
+			m_arg = arg;
+			m_start = Profiler::IsEnabled() ? Profiler::Now() : -1;
+		}
+
+		~ProfileScope()
+		{
+			if (m_start >= 0)
+				Profiler::Record(m_name, m_start, Profiler::Now(), m_arg);
+		}
+};
+
+#define PROFILE_SCOPE(name) ProfileScope profileScope(name)
+#define PROFILE_SCOPE_ARG(name, arg) ProfileScope profileScope(name, arg)
@@ -0,0 +1,3 @@
+#include "Random.h"
+
+thread_local unsigned int Random::s_state = 1;
@@ -0,0 +1,41 @@
+#pragma once
+
+//Random numbers for the renderers. Each thread has its own generator, reseeded for
+//every pixel so that an image comes out the same however its rows are shared
+//between threads. rand() is shared between threads and serialises them
+class Random
+{
+	private:
+		static thread_local unsigned int s_state;
+
+		static inline unsigned int Hash(unsigned int h)
+		{
+			h = (h ^ 61u) ^ (h >> 16);
+			h *= 9u;
+			h ^= h >> 4;
+			h *= 0x27d4eb2du;
+			return h ^ (h >> 15);
+		}
+
+	public:
+		static inline void SeedPixel(int x, int y)
+		{
+			s_state = Hash((unsigned int)x * 0x8da6b343u ^ (unsigned int)y * 0xd8163841u);
+		}
+
+		//Seed for one sample of a pixel, so the samples of a pixel can be traced in any
+		//order, or split between passes and processes, and still come out the same
+		static inline void SeedSample(int x, int y, int sample)
+		{
+			s_state = Hash(Hash((unsigned int)x * 0x8da6b343u ^ (unsigned int)y * 0xd8163841u) ^ (unsigned int)sample * 0xcb1ab31fu);
+		}
+
+		//Uniform in [0, 1), PCG-RXS-M-XS 32
+		static inline double Uniform()
+		{
+			s_state = s_state * 747796405u + 2891336453u;
+			unsigned int word = ((s_state >> ((s_state >> 28u) + 4u)) ^ s_state) * 277803737u;
+			word = (word >> 22u) ^ word;
+			return word * (1.0 / 4294967296.0);
+		}
+};
@@ -13,8 +13,11 @@ RayHitResult Ray::s_defaultHitResult;
 
 Ray::Ray()
 {
+	m_coneWidth = 0.0f;
+	m_coneSpread = 0.0f;
 	s_defaultHitResult.data = nullptr;
 	s_defaultHitResult.t = FARFAR_AWAY;
+	s_defaultHitResult.footprint = 0.0f;
 }
 
 
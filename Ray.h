@@ -21,6 +21,7 @@ struct RayHitResult
 	Vector3 texcoord;
 	double t;				//the parametric value of the resulting intersections
 	void* data;				//a pointer to misc. data, e.g. this could be material data for calculating lighting; or the hit object itself
+	float footprint;		//width of the ray cone at the hit in texture coordinates, 0 if unknown
 };
 
 class Ray
@@ -29,6 +30,8 @@ class Ray
 	private:
 		Vector3				m_start;   //origin of the ray
 		Vector3				m_ray;     //direct of the ray, this must be a unit vector
+		float				m_coneWidth;	//width of the ray's cone at its start, used to pick texture mip levels
+		float				m_coneSpread;	//growth of the cone width per unit distance
 
 	public:
 			static RayHitResult		s_defaultHitResult; //This is a constant for storing the default ray intersection result, i.e. nothing
@@ -50,5 +53,21 @@ class Ray
 			{
 				return m_start;
 			}
+
+			inline void SetCone(float width, float spread)
+			{
+				m_coneWidth = width;
+				m_coneSpread = spread;
+			}
+
+			inline float GetConeWidth(double t) const
+			{
+				return m_coneWidth + m_coneSpread*(float)t;
+			}
+
+			inline float GetConeSpread() const
+			{
+				return m_coneSpread;
+			}
 };
 
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <mutex>
+#include "RayStats.h"
+
+//Blocks are never freed, a thread that exits leaves its counts behind to be
+//gathered rather than a dangling pointer
+static std::mutex s_mutex;
+static std::vector<RayStats::Counters*> s_blocks;
+static thread_local RayStats::Counters* s_local = NULL;
+
+static const char* s_names[RayStats::STAT_COUNT] =
+{
+	"primary", "shadow", "reflection", "refraction", "diffuse", "bvh_nodes", "primitive_tests", "roulette"
+};
+
+RayStats::Counters& RayStats::Local()
+{
+	if (!s_local)
+	{
+		s_local = new Counters;
+		memset(s_local, 0, sizeof(Counters));
+
+		std::unique_lock<std::mutex> lock(s_mutex);
+		s_blocks.push_back(s_local);
+	}
+
+	return *s_local;
+}
+
+void RayStats::Reset()
+{
+	std::unique_lock<std::mutex> lock(s_mutex);
+
+	for (size_t i = 0; i < s_blocks.size(); i++)
+	{
+		memset(s_blocks[i], 0, sizeof(Counters));
+	}
+}
+
+void RayStats::Gather(Counters& total)
+{
+	memset(&total, 0, sizeof(Counters));
+
+	std::unique_lock<std::mutex> lock(s_mutex);
+
+	for (size_t i = 0; i < s_blocks.size(); i++)
+	{
+		for (int c = 0; c < STAT_COUNT; c++)
+		{
+			total.counts[c] += s_blocks[i]->counts[c];
+		}
+
+		for (int b = 0; b < PATH_BINS; b++)
+		{
+			total.pathLengths[b] += s_blocks[i]->pathLengths[b];
+		}
+	}
+}
+
+const char* RayStats::GetName(int counter)
+{
+	return counter >= 0 && counter < STAT_COUNT ? s_names[counter] : "";
+}
+
+void RayStats::PrintReport(const Counters& total, double seconds)
+{
+	unsigned long long rays = 0;
+
+	for (int c = STAT_PRIMARY; c <= STAT_DIFFUSE; c++)
+	{
+		rays += total.counts[c];
+	}
+
+	printf("Ray stats: %llu rays in %.2fs (%.2f Mrays/s)\n", rays, seconds, seconds > 0.0 ? (double)rays / seconds * 1e-6 : 0.0);
+
+	for (int c = STAT_PRIMARY; c <= STAT_DIFFUSE; c++)
+	{
+		printf("  %-16s %14llu  %5.1f%%\n", s_names[c], total.counts[c], rays > 0 ? 100.0 * (double)total.counts[c] / (double)rays : 0.0);
+	}
+
+	printf("  %-16s %14llu  %8.2f per ray\n", s_names[STAT_NODES], total.counts[STAT_NODES],
+		rays > 0 ? (double)total.counts[STAT_NODES] / (double)rays : 0.0);
+	printf("  %-16s %14llu  %8.2f per ray\n", s_names[STAT_PRIMITIVES], total.counts[STAT_PRIMITIVES],
+		rays > 0 ? (double)total.counts[STAT_PRIMITIVES] / (double)rays : 0.0);
+	printf("  %-16s %14llu\n", s_names[STAT_ROULETTE], total.counts[STAT_ROULETTE]);
+
+	unsigned long long paths = 0;
+	double segments = 0.0;
+
+	for (int b = 1; b < PATH_BINS; b++)
+	{
+		paths += total.pathLengths[b];
+		segments += (double)b * (double)total.pathLengths[b];
+	}
+
+	if (paths == 0)
+		return;
+
+	printf("  path lengths, %llu paths of %.2f segments on average\n", paths, segments / (double)paths);
+
+	for (int b = 1; b < PATH_BINS; b++)
+	{
+		if (total.pathLengths[b] > 0)
+			printf("    %2d%s %14llu  %5.1f%%\n", b, b == PATH_BINS - 1 ? "+" : " ", total.pathLengths[b],
+				100.0 * (double)total.pathLengths[b] / (double)paths);
+	}
+}
+
+bool RayStats::AppendJSON(const char* filename, const Counters& total, double seconds)
+{
+	FILE* file = fopen(filename, "a");
+
+	if (!file)
+		return false;
+
+	fprintf(file, "{ \"seconds\": %.4f", seconds);
+
+	for (int c = 0; c < STAT_COUNT; c++)
+	{
+		fprintf(file, ", \"%s\": %llu", s_names[c], total.counts[c]);
+	}
+
+	fprintf(file, ", \"path_lengths\": [");
+
+	for (int b = 1; b < PATH_BINS; b++)
+	{
+		fprintf(file, "%s%llu", b > 1 ? ", " : "", total.pathLengths[b]);
+	}
+
+	fprintf(file, "] }\n");
+
+	return fclose(file) == 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+//Counters of where the rays of a render go. Every thread counts into its own
+//block without locking, the blocks are summed once a render has finished.
+//Counting is compiled in with TINYRAY_STATS, otherwise the macros below are empty
+//and the renderers carry no overhead
+class RayStats
+{
+	public:
+		enum COUNTER
+		{
+			STAT_PRIMARY = 0,			//camera rays
+			STAT_SHADOW,				//rays towards a light or a sampled direction of the environment
+			STAT_REFLECTION,
+			STAT_REFRACTION,
+			STAT_DIFFUSE,				//bounces off diffuse surfaces, gather rays included
+			STAT_NODES,					//BVH nodes visited, mesh BVHs included
+			STAT_PRIMITIVES,			//primitives tested, planes and instances included
+			STAT_ROULETTE,				//paths ended by russian roulette
+			STAT_COUNT
+		};
+
+		enum
+		{
+			PATH_BINS = 32				//path lengths of 1 to PATH_BINS - 1 segments, the last bin holds longer paths
+		};
+
+		struct Counters
+		{
+			unsigned long long	counts[STAT_COUNT];
+			unsigned long long	pathLengths[PATH_BINS];
+		};
+
+		//The block of the calling thread
+		static Counters& Local();
+
+		//Zero, or sum, the blocks of every thread. Only call these while no rays are being traced
+		static void Reset();
+		static void Gather(Counters& total);
+
+		static void PrintReport(const Counters& total, double seconds);
+
+		//Append the counters as one line of JSON, so a file collects one line per render
+		static bool AppendJSON(const char* filename, const Counters& total, double seconds);
+
+		static const char* GetName(int counter);
+
+		//BVH nodes visited plus primitives tested by the calling thread so far, the
+		//traversal heatmaps colour a pixel by the difference across its rays
+		static inline unsigned long long GetTraversalCost()
+		{
+			Counters& local = Local();
+			return local.counts[STAT_NODES] + local.counts[STAT_PRIMITIVES];
+		}
+};
+
+#if defined(TINYRAY_STATS)
+#define RAYSTATS_ADD(counter, n) (RayStats::Local().counts[RayStats::counter] += (unsigned long long)(n))
+#define RAYSTATS_PATH(length) (RayStats::Local().pathLengths[(length) < 1 ? 1 : (length) < RayStats::PATH_BINS ? (length) : RayStats::PATH_BINS - 1]++)
+#else
+#define RAYSTATS_ADD(counter, n) ((void)0)
+#define RAYSTATS_PATH(length) ((void)0)
+#endif
@@ -11,21 +11,17 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
-
-#if defined(WIN32) || defined(_WINDOWS)
-#include <Windows.h>
-#include <gl/GL.h>
-#endif
-
-#ifdef __APPLE__
-#include <OpenGL/gl.h>
-#endif
+#include <chrono>
 
 #include "RayTracer.h"
 #include "Ray.h"
 #include "Scene.h"
 #include "Camera.h"
 #include "perlin.h"
+#include "Random.h"
+#include "RayStats.h"
+#include "Profiler.h"
+#include "RenderControl.h"
 
 void RayTracer::DoTrace( Scene* pScene )
 {
@@ -59,17 +55,40 @@ void RayTracer::DoTrace( Scene* pScene )
 
 	if (m_renderCount == 0)
 	{
+		if (m_control)
+			m_control->Start();
+
 		fprintf(stdout, "Trace start.\n");
 
-		clock_t time = clock();
+#if defined(TINYRAY_STATS)
+		BeginRayStats();
+#endif
+
+		//wall time, clock() sums the CPU time of every thread
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 #pragma omp parallel for schedule (dynamic, 1)
-		for (int i = 0; i < m_buffHeight; i+=1) {
-			fprintf(stdout, "\rRendering %5.2f%% (%.2fs Time taken)", 100.* i / (m_buffHeight - 1), (double)(clock() - time) / CLOCKS_PER_SEC);
+		for (int i = m_firstRow; i < m_endRow; i+=1) {
+			//rows left when a frame is stopped are black
+			if (m_control && m_control->ShouldStop())
+			{
+				for (int j = 0; j < m_buffWidth; j++)
+				{
+					m_framebuffer->WriteRGBToFramebuffer(Colour(0.0, 0.0, 0.0), j, i);
+				}
+
+				continue;
+			}
+
+			PROFILE_SCOPE_ARG("TraceRow", i);
+			fprintf(stdout, "\rRendering %5.2f%% (%.2fs Time taken)", 100.* i / (m_buffHeight - 1),
+				std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
 			for (int j = 0; j < m_buffWidth; j+=1) {
 
 				//calculate the metric size of a pixel in the view plane (e.g. framebuffer)
 				Vector3 pixel;
 
+				Random::SeedPixel(j, i);
+
 				// Anti-Aliasing
 				for (float x = 0.25f; x <= 1.f; x += 0.25f)
 				{
@@ -89,6 +108,7 @@ void RayTracer::DoTrace( Scene* pScene )
 						*/
 						Ray viewray;
 						viewray.SetRay(camPosition, (pixel - camPosition).Normalise());
+						viewray.SetCone(0.0f, (float)pixelDX);
 						//viewray.SetRay(pixel, Vector3(0.0, 0.0, -1.0));
 
 						double u = (double)j / (double)m_buffWidth;
@@ -99,25 +119,47 @@ void RayTracer::DoTrace( Scene* pScene )
 						//trace the scene using the view ray
 						//default colour is the background colour, unless something is hit along the way
 						Colour colour;
-						colour = TraceScene(pScene, viewray, scenebg, m_traceLevel);
+						RayHitResult primaryhit = Ray::s_defaultHitResult;
+						if (m_heatmap == HEATMAP_PRIMARY)
+						{
+							colour = TraceHeatmap(pScene, viewray, m_aovFlags ? &primaryhit : NULL);
+						}
+						else
+						{
+							unsigned long long cost = m_heatmap == HEATMAP_PATH ? RayStats::GetTraversalCost() : 0;
+
+							RAYSTATS_ADD(STAT_PRIMARY, 1);
+							colour = TraceScene(pScene, viewray, scenebg, m_traceLevel, false, m_aovFlags ? &primaryhit : NULL);
+
+							if (m_heatmap == HEATMAP_PATH)
+								colour = GetHeatmapColour((double)(RayStats::GetTraversalCost() - cost));
+						}
 
 						/*
 						* Draw the pixel as a coloured rectangle
 						*/
 						m_framebuffer->WriteRGBToFramebuffer(colour, j, i);
+
+						if (m_aovFlags)
+							WriteAOVs(pScene, primaryhit, j, i);
 					}
 				}
 			}
-			glDrawPixels(m_buffWidth, m_buffHeight, GL_RGBA, GL_FLOAT, m_framebuffer->GetBuffer());
-			glFlush();
 		}
 
+		if (m_control && m_control->WasStopped())
+			fprintf(stdout, "\rStopped before every row was traced\n");
+
 		fprintf(stdout, "\r\nDone!!!\n");
+
+#if defined(TINYRAY_STATS)
+		EndRayStats();
+#endif
 		m_renderCount++;
 	}
 }
 
-Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, bool shadowray)
+Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, bool shadowray, RayHitResult* primaryhit)
 {
 	RayHitResult result;
 	Colour outcolour = incolour;
@@ -126,6 +168,9 @@ Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int trace
 	if (tracelevel <= 0)
 	{
 		result = pScene->IntersectByRay(ray, shadowray);
+
+		if (primaryhit)
+			*primaryhit = result;
 		if (shadowray && result.data)
 		{
 			outcolour[0] = incolour[0]*0.3;
@@ -138,12 +183,27 @@ Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int trace
 
 	result = pScene->IntersectByRay(ray, shadowray);
 
+	if (primaryhit)
+		*primaryhit = result;
+
 	if (result.data) //the ray has hit something
 	{
 		Vector3 start = ray.GetRayStart();
-		outcolour = CalculateLighting(light_list,
-			&start,
-			&result);
+
+		//with more lights than m_lightSamples a few are picked at random, each casting its own shadow ray
+		bool sampled = m_lightSamples > 0 && (int)light_list->size() > m_lightSamples &&
+			pScene->GetLightTree().GetNumLights() == (int)light_list->size();
+
+		if (sampled)
+		{
+			outcolour = SampleLighting(pScene, &start, &result);
+		}
+		else
+		{
+			outcolour = CalculateLighting(light_list,
+				&start,
+				&result);
+		}
 		
 		if(m_traceflag & TRACE_REFLECTION)
 		{
@@ -156,8 +216,10 @@ Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int trace
 				Vector3 rayOrigin = result.point;
 				Ray reflectiveRay;
 				reflectiveRay.SetRay(rayOrigin + rayDirection, rayDirection);
+				reflectiveRay.SetCone(ray.GetConeWidth(result.t), ray.GetConeSpread());
 
 				//Set the new outcolour
+				RAYSTATS_ADD(STAT_REFLECTION, 1);
 				outcolour = TraceScene(pScene, reflectiveRay, incolour, --tracelevel, shadowray) * outcolour;
 			}
 		}
@@ -173,25 +235,25 @@ Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int trace
 				Vector3 rayDirection = ray.GetRay().Refract(result.normal, 0.9);
 				Ray refractionRay;
 				refractionRay.SetRay(result.point + rayDirection * 0.01, rayDirection);
+				refractionRay.SetCone(ray.GetConeWidth(result.t), ray.GetConeSpread());
 
 				//Set the new outcolour
+				RAYSTATS_ADD(STAT_REFRACTION, 1);
 				outcolour = (outcolour * 0.2) + (TraceScene(pScene, refractionRay, incolour, --tracelevel, shadowray) * 0.8);
 			}
 		}
 		
 		//////Check if this is in shadow
-		if ( m_traceflag & TRACE_SHADOW )
+		if ( m_traceflag & TRACE_SHADOW && !sampled )
 		{
 			
 			std::vector<Light*>::iterator lit_iter = light_list->begin();
 			while (lit_iter != light_list->end())
 			{
-
-				Vector3 lightdir = (*lit_iter)->GetLightPosition() - result.point;
-				lightdir.Normalise();
-				Ray shadowray;
-				shadowray.SetRay(result.point + lightdir*0.1, lightdir);
-				outcolour = TraceScene(pScene, shadowray, outcolour, 0, true);
+				if (IsShadowed(pScene, result.point, *lit_iter))
+				{
+					outcolour = outcolour * 0.3;
+				}
 
 				lit_iter++;
 			}
@@ -201,10 +263,41 @@ Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int trace
 	return outcolour;
 }
 
-Colour RayTracer::CalculateLighting(std::vector<Light*>* lights, Vector3* campos, RayHitResult* hitresult)
+Colour RayTracer::GetAlbedo(const RayHitResult& hit)
+{
+	//planes are chequered, see CalculateLighting
+	if (((Primitive*)hit.data)->m_primtype == Primitive::PRIMTYPE_Plane)
+	{
+		int dx = hit.point[0] / 2.0;
+		int dy = hit.point[1] / 2.0;
+		int dz = hit.point[2] / 2.0;
+
+		if (dx % 2 || dy % 2 || dz % 2)
+		{
+			return Vector3(0.1, .1, .1);
+		}
+	}
+
+	return Renderer::GetAlbedo(hit);
+}
+
+bool RayTracer::IsShadowed(Scene* pScene, const Vector3& point, Light* light)
+{
+	Vector3 lightdir = light->GetLightPosition() - point;
+	double distance = lightdir.Norm();
+	lightdir.Normalise();
+
+	//only casters between the point and this light count
+	Ray shadowray;
+	shadowray.SetRay(point + lightdir*0.1, lightdir);
+	RAYSTATS_ADD(STAT_SHADOW, 1);
+
+	return pScene->IntersectByRay(shadowray, true, distance - 0.1).data != NULL;
+}
+
+Colour RayTracer::GetBaseColour(RayHitResult* hitresult)
 {
 	Colour outcolour;
-	std::vector<Light*>::iterator lit_iter = lights->begin();
 
 	Primitive* prim = (Primitive*)hitresult->data;
 	Material* mat = prim->GetMaterial();
@@ -228,52 +321,86 @@ Colour RayTracer::CalculateLighting(std::vector<Light*>* lights, Vector3* campos
 
 	}
 
+	return outcolour;
+}
+
+Colour RayTracer::ShadeLight(Light* light, Vector3* campos, RayHitResult* hitresult)
+{
+	Material* mat = ((Primitive*)hitresult->data)->GetMaterial();
+
+	Vector3 normal = hitresult->normal;
+	Vector3 lightvec = light->GetLightPosition() - hitresult->point;
+
+	lightvec.Normalise();
+				
+	Colour diffusecolour = GetAlbedo(*hitresult);
+
+	//diffuse component;
+	double ndotl = normal.DotProduct(lightvec);
+	
+	ndotl = ndotl < 0.0 ? 0.0 : ndotl;
+	
+	////Specular Reflectance (Blinn-Phong Model)
+	Vector3 lightVector = (light->GetLightPosition() - hitresult->point).Normalise();
+	Vector3 viewDirectionVector = (*campos - hitresult->point).Normalise();
+	Vector3 lightPlusViewVector = (lightVector + viewDirectionVector);
+	Vector3 halfVector = lightPlusViewVector / lightPlusViewVector.Norm();
+	double ndoth = halfVector.DotProduct(hitresult->normal);
+	float halfAngle = (float)(ndoth < 0.0 ? 0.0 : ndoth > 1.0 ? 1.0 : ndoth);
+	Colour specular = mat->GetSpecularColour() * light->GetLightColour() * pow(halfAngle, mat->GetSpecPower());
+
+	return specular + diffusecolour*ndotl;
+}
+
+Colour RayTracer::CalculateLighting(std::vector<Light*>* lights, Vector3* campos, RayHitResult* hitresult)
+{
+	Colour outcolour = GetBaseColour(hitresult);
+	std::vector<Light*>::iterator lit_iter = lights->begin();
+
 	////Go through all lights in the scene
 	////Note the default scene only has one light source
 	if (m_traceflag & TRACE_DIFFUSE_AND_SPEC)
 	{
 		while (lit_iter != lights->end())
 		{
-			Vector3 normal = hitresult->normal;
-			Vector3 lightvec = (*lit_iter)->GetLightPosition() - hitresult->point;
+			outcolour = outcolour + ShadeLight(*lit_iter, campos, hitresult);
 
-			lightvec.Normalise();
-						
-			Colour diffusecolour = mat->HasDiffuseTexture()? 
-				mat->SampleColour(Texture::TEXUNIT_DIFFUSE, hitresult->texcoord[0], hitresult->texcoord[1]) : 
-				mat->GetDiffuseColour();
+			lit_iter++;
+		}
+	}
+	return outcolour;
+}
 
-			if (((Primitive*)hitresult->data)->m_primtype == Primitive::PRIMTYPE_Plane)
-			{
-				int dx = hitresult->point[0] / 2.0;
-				int dy = hitresult->point[1] / 2.0;
-				int dz = hitresult->point[2] / 2.0;
+Colour RayTracer::SampleLighting(Scene* pScene, Vector3* campos, RayHitResult* hitresult)
+{
+	Colour outcolour = GetBaseColour(hitresult);
 
-				if (dx % 2 || dy % 2 || dz % 2)
-				{
-					diffusecolour = Vector3(0.1, .1, .1);
-				}
-			}
+	if (!(m_traceflag & TRACE_DIFFUSE_AND_SPEC))
+		return outcolour;
 
-						
-			//diffuse component;
-			double ndotl = normal.DotProduct(lightvec);
-			
-			ndotl = ndotl < 0.0 ? 0.0 : ndotl;
-			
-			////Specular Reflectance (Blinn-Phong Model)
-			Vector3 lightVector = (lit_iter[0]->GetLightPosition() - hitresult->point).Normalise();
-			Vector3 viewDirectionVector = (*campos - hitresult->point).Normalise();
-			Vector3 lightPlusViewVector = (lightVector + viewDirectionVector);
-			Vector3 halfVector = lightPlusViewVector / lightPlusViewVector.Norm();
-			float halfAngle = (max(min(halfVector.DotProduct(hitresult->normal), 1), 0));
-			Colour specular = mat->GetSpecularColour() * lit_iter[0]->GetLightColour() * pow(halfAngle, mat->GetSpecPower());
+	std::vector<Light*>* lights = pScene->GetLightList();
+	const LightTree& tree = pScene->GetLightTree();
 
-			outcolour = outcolour + specular + diffusecolour*ndotl;
+	for (int i = 0; i < m_lightSamples; i++)
+	{
+		float probability;
+		int index = tree.Sample(hitresult->point, hitresult->normal, (float)Random::Uniform(), probability);
 
-			lit_iter++;
-		}
+		//the scene has no lights
+		if (index < 0)
+			continue;
+
+		Light* light = (*lights)[index];
+		Colour contribution = ShadeLight(light, campos, hitresult);
+
+		//a shadowed light is dimmed on its own, dimming everything per shadowed light
+		//would turn black with hundreds of lights
+		if ((m_traceflag & TRACE_SHADOW) && IsShadowed(pScene, hitresult->point, light))
+			contribution = contribution * 0.3;
+
+		outcolour = outcolour + contribution * (1.0 / (probability * m_lightSamples));
 	}
+
 	return outcolour;
 }
 
@@ -17,7 +17,22 @@ class RayTracer : public Renderer
 		using Renderer::Renderer;
 
 		virtual void DoTrace( Scene* pScene ) override;
-		virtual Colour TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, bool shadowray = false) override;
+		virtual Colour TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, bool shadowray = false, RayHitResult* primaryhit = NULL) override;
+		virtual Colour GetAlbedo(const RayHitResult& hit) override;
 		Colour CalculateLighting(std::vector<Light*>* lights, Vector3* campos, RayHitResult* hitresult);
+
+		//Lighting from m_lightSamples lights picked from the scene's light tree, each with its own shadow ray.
+		//An estimate of CalculateLighting for scenes with many lights
+		Colour SampleLighting(Scene* pScene, Vector3* campos, RayHitResult* hitresult);
+
+	private:
+		//Ambient, or the chequer of a plane, before any light is added
+		Colour GetBaseColour(RayHitResult* hitresult);
+
+		//Diffuse and specular lighting from one light
+		Colour ShadeLight(Light* light, Vector3* campos, RayHitResult* hitresult);
+
+		//True if a shadow caster lies between the point and the light
+		bool IsShadowed(Scene* pScene, const Vector3& point, Light* light);
 };
 
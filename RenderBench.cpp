@@ -0,0 +1,390 @@
+//End to end render benchmark, renders reference scenes at several sample budgets
+//and compares each frame with a high sample count reference of the same scene.
+//A faster renderer that leaves more noise is no better, so besides the time this
+//reports the error, the efficiency 1/(relMSE * time) and the time an unbiased
+//renderer would need to reach a target error. Only the path tracer is benchmarked, the
+//ray tracer takes one sample per pixel whatever the budget
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include "Scene.h"
+#include "Camera.h"
+#include "PathTracer.h"
+#include "Denoiser.h"
+#include "IrradianceCache.h"
+#include "ImageIO.h"
+
+//Samples are seeded by their index, so a reference traced with the seed of the renders it is
+//compared with would share their first samples and the error would come out too low
+static const int s_referenceSeed = 1;
+
+struct RenderResult
+{
+	std::string		scene;
+	int				samples;
+	double			seconds;
+	double			mse;
+	double			relMSE;
+};
+
+struct BenchScene
+{
+	std::string		name;
+	const char*		filename;		//NULL for the default scene
+	bool			sideView;		//look across the default scene from the other side
+};
+
+static void PrintUsage()
+{
+	printf("Usage: tinyray-renderbench [options]\n");
+	printf("  -size w h         frame size in pixels (default 96 72)\n");
+	printf("  -spp list         comma separated sample budgets (default 4,16,64)\n");
+	printf("  -refspp n         samples per pixel of the references (default 1024)\n");
+	printf("  -refdir dir       where references are kept between runs (default .)\n");
+	printf("  -target e         relMSE that time-to-error is reported for (default 0.01)\n");
+	printf("  -scene file       add a scene file to the default scenes, may be repeated\n");
+	printf("  -denoise          denoise each frame\n");
+	printf("  -irrcache         path trace through an irradiance cache, built afresh for each frame\n");
+	printf("  -json file        also write the results as JSON\n");
+}
+
+static Renderer* CreateRenderer(int width, int height)
+{
+	Renderer* renderer = new PathTracer(width, height);
+	renderer->m_traceflag = (Renderer::TraceFlags)(Renderer::TRACE_REFRACTION | Renderer::TRACE_REFLECTION);
+
+	return renderer;
+}
+
+static Scene* LoadScene(const BenchScene& bench, int width, int height)
+{
+	Scene* scene = new Scene();
+
+	if (bench.filename && !scene->LoadSceneFile(bench.filename))
+	{
+		delete scene;
+		return NULL;
+	}
+
+	if (bench.sideView)
+		scene->GetSceneCamera()->SetPositionAndLookAt(Vector3(18.0f, 12.0f, 30.0f), Vector3(0.0f, 4.0f, -10.0f));
+
+	scene->SetSceneWidth((float)width / (float)height);
+
+	return scene;
+}
+
+//Render a frame and copy it out as RGB floats, bottom row first as in PFM files
+static double RenderImage(Renderer* renderer, Scene* scene, int samples, std::vector<float>& image)
+{
+	renderer->SetSamplesPerPixel(samples);
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	renderer->RenderFrame(scene);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	int width = renderer->m_buffWidth;
+	int height = renderer->m_buffHeight;
+	image.resize((size_t)width*height*3);
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			Colour colour = renderer->GetFramebuffer()->ReadRGBFromFramebuffer(x, y);
+			float* dst = &image[((size_t)y*width + x)*3];
+
+			dst[0] = colour[0];
+			dst[1] = colour[1];
+			dst[2] = colour[2];
+		}
+	}
+
+	return seconds;
+}
+
+//Load the reference of a scene, or render and keep it if there is none at this size and sample count
+static bool GetReference(const BenchScene& bench, Scene* scene, int width, int height, int refsamples,
+	const char* refdir, std::vector<float>& reference)
+{
+	char filename[1024];
+	snprintf(filename, sizeof(filename), "%s/%s_pt_%dx%d_%d_seed%d.pfm", refdir, bench.name.c_str(), width, height,
+		refsamples, s_referenceSeed);
+
+	float* buffer = NULL;
+	int sizex = 0;
+	int sizey = 0;
+
+	if (ImageIO::LoadPFM(filename, &buffer, &sizex, &sizey) == E_IMAGEIO_SUCCESS)
+	{
+		if (sizex == width && sizey == height)
+			reference.assign(buffer, buffer + (size_t)width*height*3);
+
+		delete [] buffer;
+
+		if (!reference.empty())
+			return true;
+	}
+
+	printf("Rendering reference %s at %d spp\n", filename, refsamples);
+	fflush(stdout);
+
+	//references are plain renders, whatever is being benchmarked
+	Renderer* renderer = CreateRenderer(width, height);
+	renderer->SetSampleSeed(s_referenceSeed);
+	double seconds = RenderImage(renderer, scene, refsamples, reference);
+	delete renderer;
+
+	printf("\nReference took %.1fs\n", seconds);
+
+	if (ImageIO::SavePFM(filename, &reference[0], width, height) != E_IMAGEIO_SUCCESS)
+		printf("Warning: could not save %s, it will be rendered again next time\n", filename);
+
+	return true;
+}
+
+static void CompareImages(const std::vector<float>& image, const std::vector<float>& reference, double& mse, double& relmse)
+{
+	double sum = 0.0;
+	double relsum = 0.0;
+
+	for (size_t i = 0; i < image.size(); i++)
+	{
+		double d = (double)image[i] - (double)reference[i];
+		double r = (double)reference[i];
+
+		sum += d*d;
+		relsum += d*d / (r*r + 1e-2);
+	}
+
+	mse = image.empty() ? 0.0 : sum / (double)image.size();
+	relmse = image.empty() ? 0.0 : relsum / (double)image.size();
+}
+
+//Error falls as 1/time for an unbiased estimator, so the time to reach the target is extrapolated from the measured error
+static inline double TimeToError(const RenderResult& r, double target)
+{
+	return r.seconds * r.relMSE / target;
+}
+
+static void PrintResult(const RenderResult& r, double target)
+{
+	printf("%-20s %6d spp %9.2fs   MSE %10.4g   relMSE %10.4g   efficiency %10.4g   time to %g relMSE %9.2fs\n",
+		r.scene.c_str(), r.samples, r.seconds, r.mse, r.relMSE,
+		r.relMSE > 0.0 ? 1.0 / (r.relMSE * r.seconds) : 0.0, target, TimeToError(r, target));
+}
+
+static bool WriteJSON(const char* filename, int width, int height, int refsamples, double target, const char* renderer,
+	const std::vector<RenderResult>& results)
+{
+	FILE* file = fopen(filename, "w");
+
+	if (!file)
+		return false;
+
+	fprintf(file, "{\n\t\"benchmark\": \"tinyray-renderbench\",\n\t\"version\": 1,\n");
+	fprintf(file, "\t\"renderer\": \"%s\",\n\t\"width\": %d,\n\t\"height\": %d,\n", renderer, width, height);
+	fprintf(file, "\t\"reference_spp\": %d,\n\t\"target_relmse\": %g,\n", refsamples, target);
+	fprintf(file, "\t\"results\": [\n");
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const RenderResult& r = results[i];
+
+		fprintf(file, "\t\t{ \"scene\": \"%s\", \"spp\": %d, \"seconds\": %.4f, \"mse\": %.6g, \"relmse\": %.6g, \"efficiency\": %.6g, \"time_to_target\": %.4f }%s\n",
+			r.scene.c_str(), r.samples, r.seconds, r.mse, r.relMSE, r.relMSE > 0.0 ? 1.0 / (r.relMSE * r.seconds) : 0.0,
+			TimeToError(r, target), i + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(file, "\t]\n}\n");
+
+	return fclose(file) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	int width = 96;
+	int height = 72;
+	std::vector<int> budgets;
+	int refsamples = 1024;
+	const char* refdir = ".";
+	double target = 0.01;
+	bool denoise = false;
+	bool irradiancecache = false;
+	const char* jsonfile = NULL;
+
+	std::vector<BenchScene> scenes;
+	BenchScene front = { "default", NULL, false };
+	BenchScene side = { "default_side", NULL, true };
+	scenes.push_back(front);
+	scenes.push_back(side);
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-size") == 0 && i + 2 < argc)
+		{
+			width = atoi(argv[++i]);
+			height = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-spp") == 0 && i + 1 < argc)
+		{
+			std::string list = argv[++i];
+			size_t start = 0;
+
+			while (start <= list.size())
+			{
+				size_t end = list.find(',', start);
+				end = end == std::string::npos ? list.size() : end;
+
+				budgets.push_back(atoi(list.substr(start, end - start).c_str()));
+				start = end + 1;
+			}
+		}
+		else if (strcmp(argv[i], "-refspp") == 0 && i + 1 < argc)
+		{
+			refsamples = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-refdir") == 0 && i + 1 < argc)
+		{
+			refdir = argv[++i];
+		}
+		else if (strcmp(argv[i], "-target") == 0 && i + 1 < argc)
+		{
+			target = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-scene") == 0 && i + 1 < argc)
+		{
+			BenchScene bench;
+			bench.filename = argv[++i];
+			bench.sideView = false;
+
+			//named after the file without its directory or extension
+			std::string name = bench.filename;
+			size_t slash = name.find_last_of("/\\");
+			name = slash == std::string::npos ? name : name.substr(slash + 1);
+			bench.name = name.substr(0, name.find_last_of('.'));
+
+			//names pick the reference file, so they have to be unique
+			for (size_t j = 0; j < scenes.size(); j++)
+			{
+				if (scenes[j].name == bench.name)
+				{
+					bench.name += "_file";
+					j = (size_t)-1;
+				}
+			}
+
+			scenes.push_back(bench);
+		}
+		else if (strcmp(argv[i], "-denoise") == 0)
+		{
+			denoise = true;
+		}
+		else if (strcmp(argv[i], "-irrcache") == 0)
+		{
+			irradiancecache = true;
+		}
+		else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+		{
+			jsonfile = argv[++i];
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (budgets.empty())
+	{
+		budgets.push_back(4);
+		budgets.push_back(16);
+		budgets.push_back(64);
+	}
+
+	for (size_t i = 0; i < budgets.size(); i++)
+	{
+		if (budgets[i] <= 0)
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (width <= 0 || height <= 0 || refsamples <= 0 || target <= 0.0)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	Renderer* renderer = CreateRenderer(width, height);
+
+	Denoiser denoiser;
+	IrradianceCache cache;
+
+	if (denoise)
+		renderer->SetDenoiser(&denoiser);
+
+	if (irradiancecache)
+		renderer->SetIrradianceCache(&cache);
+
+	std::vector<RenderResult> results;
+	std::vector<float> reference;
+	std::vector<float> image;
+
+	for (size_t s = 0; s < scenes.size(); s++)
+	{
+		Scene* scene = LoadScene(scenes[s], width, height);
+
+		if (!scene)
+		{
+			printf("Error loading %s\n", scenes[s].filename);
+			delete renderer;
+			return 1;
+		}
+
+		reference.clear();
+		GetReference(scenes[s], scene, width, height, refsamples, refdir, reference);
+
+		for (size_t b = 0; b < budgets.size(); b++)
+		{
+			//the cache would otherwise carry work over from the previous budget
+			cache.Clear();
+
+			RenderResult result;
+			result.scene = scenes[s].name;
+			result.samples = budgets[b];
+			result.seconds = RenderImage(renderer, scene, budgets[b], image);
+			CompareImages(image, reference, result.mse, result.relMSE);
+
+			printf("\n");
+			PrintResult(result, target);
+			fflush(stdout);
+
+			results.push_back(result);
+		}
+
+		delete scene;
+	}
+
+	printf("\n");
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		PrintResult(results[i], target);
+	}
+
+	delete renderer;
+
+	if (jsonfile && !WriteJSON(jsonfile, width, height, refsamples, target, "pathtracer", results))
+	{
+		printf("Error writing %s\n", jsonfile);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+//Bounds a render from outside. The renderers start the clock as a frame starts and check
+//ShouldStop between rows and between sample passes, a frame that stops early keeps the
+//samples traced so far. Cancel may be called from any thread
+class RenderControl
+{
+	private:
+		double									m_timeBudget;		//seconds per frame, 0 for no limit
+		int										m_maxSamples;		//cap on the path tracer's samples per pixel, 0 for no cap
+		std::chrono::steady_clock::time_point	m_deadline;
+		std::atomic<bool>						m_cancelled;
+		std::atomic<bool>						m_stopped;
+
+	public:
+		RenderControl()
+		{
+			m_timeBudget = 0.0;
+			m_maxSamples = 0;
+			m_cancelled = false;
+			m_stopped = false;
+		}
+
+		inline void SetTimeBudget(double seconds)
+		{
+			m_timeBudget = seconds > 0.0 ? seconds : 0.0;
+		}
+
+		inline void SetMaxSamples(int samples)
+		{
+			m_maxSamples = samples > 0 ? samples : 0;
+		}
+
+		inline int GetMaxSamples() const
+		{
+			return m_maxSamples;
+		}
+
+		//Samples per pixel the renderer may trace out of those it wants
+		inline int ClampSamples(int samples) const
+		{
+			return m_maxSamples > 0 && samples > m_maxSamples ? m_maxSamples : samples;
+		}
+
+		//Stop the frame being rendered and every later one until Reset
+		inline void Cancel()
+		{
+			m_cancelled = true;
+		}
+
+		inline void Reset()
+		{
+			m_cancelled = false;
+		}
+
+		//Called by the renderers as a frame starts, the time budget runs from here
+		inline void Start()
+		{
+			m_stopped = false;
+			m_deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>(m_timeBudget));
+		}
+
+		inline bool ShouldStop()
+		{
+			if (m_stopped.load(std::memory_order_relaxed))
+				return true;
+
+			if (m_cancelled || (m_timeBudget > 0.0 && std::chrono::steady_clock::now() >= m_deadline))
+			{
+				m_stopped = true;
+				return true;
+			}
+
+			return false;
+		}
+
+		//The last frame was cut short by the time budget or by Cancel
+		inline bool WasStopped() const
+		{
+			return m_stopped;
+		}
+};
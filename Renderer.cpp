@@ -1,10 +1,40 @@
+#include <stdio.h>
+#include <string.h>
 #include "Renderer.h"
+#include "Denoiser.h"
+#include "RayStats.h"
+#include "Profiler.h"
+
+static const char* s_aovNames[Renderer::AOV_COUNT] = { "albedo", "normal", "depth", "primid", "matid" };
+
+//albedo never goes negative so it fits the shared exponent format, normals need a sign
+//and depth and ids need every bit of a float
+static const Framebuffer::FORMAT s_aovFormats[Renderer::AOV_COUNT] =
+{
+	Framebuffer::FORMAT_RGB9E5,
+	Framebuffer::FORMAT_RGBA16F,
+	Framebuffer::FORMAT_RGB32F,
+	Framebuffer::FORMAT_RGB32F,
+	Framebuffer::FORMAT_RGB32F
+};
 
 Renderer::Renderer()
 {
 	m_buffHeight = m_buffWidth = 0.0;
 	m_renderCount = 0;
 	SetTraceLevel(5);
+	EnableAOVs(0);
+	m_samplesPerPixel = 0;
+	SetSampleRange(0, 0);
+	m_lightSamples = 8;
+	m_denoiser = NULL;
+	m_irradianceCache = NULL;
+	m_heatmap = HEATMAP_NONE;
+	m_heatmapScale = 100.0f;
+	m_control = NULL;
+	m_sampleSeed = 0;
+	m_checkpointInterval = 60.0;
+	m_firstRow = m_endRow = 0;
 	m_traceflag = (TraceFlags)(TRACE_AMBIENT | TRACE_DIFFUSE_AND_SPEC |
 		TRACE_SHADOW | TRACE_REFLECTION | TRACE_REFRACTION);
 }
@@ -17,6 +47,19 @@ Renderer::Renderer(int Width, int Height)
 	SetTraceLevel(5);
 
 	m_framebuffer = new Framebuffer(Width, Height);
+	EnableAOVs(0);
+	m_samplesPerPixel = 0;
+	SetSampleRange(0, 0);
+	m_lightSamples = 8;
+	m_denoiser = NULL;
+	m_irradianceCache = NULL;
+	m_heatmap = HEATMAP_NONE;
+	m_heatmapScale = 100.0f;
+	m_control = NULL;
+	m_sampleSeed = 0;
+	m_checkpointInterval = 60.0;
+	m_firstRow = 0;
+	m_endRow = Height;
 
 	//default set default trace flag, i.e. no lighting, non-recursive
 	m_traceflag = (TraceFlags)(TRACE_AMBIENT);
@@ -26,3 +69,202 @@ Renderer::~Renderer()
 {
 	delete m_framebuffer;
 }
+
+void Renderer::SetFramebufferFormat(Framebuffer::FORMAT format)
+{
+	if (m_framebuffer->GetFormat() == format)
+		return;
+
+	delete m_framebuffer;
+	m_framebuffer = new Framebuffer(m_buffWidth, m_buffHeight, format);
+
+	//the layers went with the old framebuffer
+	EnableAOVs(m_aovFlags);
+}
+
+void Renderer::EnableAOVs(unsigned int flags)
+{
+	m_aovFlags = flags;
+
+	for (int i = 0; i < AOV_COUNT; i++)
+	{
+		m_aovLayers[i] = (flags & (0x1 << i)) ? m_framebuffer->AddLayer(s_aovNames[i], s_aovFormats[i]) : -1;
+	}
+}
+
+bool Renderer::ParseAOV(const char* name, unsigned int& flag)
+{
+	if (strcmp(name, "all") == 0)
+	{
+		flag = AOV_ALL;
+		return true;
+	}
+
+	for (int i = 0; i < AOV_COUNT; i++)
+	{
+		if (strcmp(name, s_aovNames[i]) == 0)
+		{
+			flag = 0x1 << i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Renderer::SetDenoiser(Denoiser* denoiser)
+{
+	m_denoiser = denoiser;
+
+	if (denoiser)
+		EnableAOVs(m_aovFlags | AOV_ALBEDO | AOV_NORMAL | AOV_DEPTH);
+}
+
+Colour Renderer::GetAlbedo(const RayHitResult& hit)
+{
+	Material* mat = ((Primitive*)hit.data)->GetMaterial();
+
+	return mat->HasDiffuseTexture() ?
+		mat->SampleColour(Texture::TEXUNIT_DIFFUSE, hit.texcoord[0], hit.texcoord[1], hit.footprint) :
+		mat->GetDiffuseColour();
+}
+
+void Renderer::WriteAOVs(Scene* pScene, const RayHitResult& hit, int x, int y)
+{
+	Primitive* prim = (Primitive*)hit.data;
+	Colour values[AOV_COUNT];
+
+	if (prim)
+	{
+		float depth = (float)hit.t;
+		float primid = (float)pScene->GetObjectId(prim);
+		float matid = (float)pScene->GetMaterialId(prim->GetMaterial());
+
+		values[0] = GetAlbedo(hit);
+		values[1] = hit.normal;
+		values[2] = Colour(depth, depth, depth);
+		values[3] = Colour(primid, primid, primid);
+		values[4] = Colour(matid, matid, matid);
+	}
+	else
+	{
+		values[3] = Colour(-1.0f, -1.0f, -1.0f);
+		values[4] = Colour(-1.0f, -1.0f, -1.0f);
+	}
+
+	for (int i = 0; i < AOV_COUNT; i++)
+	{
+		if (m_aovLayers[i] >= 0)
+			m_framebuffer->WriteLayer(m_aovLayers[i], values[i], x, y);
+	}
+}
+
+void Renderer::RenderFrame(Scene* pScene)
+{
+	PROFILE_SCOPE("RenderFrame");
+
+	ResetRenderCount();
+	DoTrace(pScene);
+	FinishFrame();
+}
+
+void Renderer::RenderRows(Scene* pScene, int first, int count)
+{
+	m_firstRow = first < 0 ? 0 : first;
+	m_endRow = first + count < m_buffHeight ? first + count : m_buffHeight;
+
+	ResetRenderCount();
+	DoTrace(pScene);
+
+	m_firstRow = 0;
+	m_endRow = m_buffHeight;
+}
+
+void Renderer::FinishFrame()
+{
+	//a heatmap is read value by value, smoothing it would hide the costly pixels
+	if (m_denoiser && m_heatmap == HEATMAP_NONE)
+		m_denoiser->Denoise(m_framebuffer);
+}
+
+void Renderer::BeginRayStats()
+{
+	RayStats::Reset();
+	m_statsStart = std::chrono::steady_clock::now();
+}
+
+void Renderer::EndRayStats()
+{
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_statsStart).count();
+
+	RayStats::Counters total;
+	RayStats::Gather(total);
+	RayStats::PrintReport(total, seconds);
+
+	if (!m_statsFile.empty() && !RayStats::AppendJSON(m_statsFile.c_str(), total, seconds))
+		printf("Error writing ray stats to %s\n", m_statsFile.c_str());
+}
+
+bool Renderer::SetHeatmap(HeatmapMode mode, float scale)
+{
+#if defined(TINYRAY_STATS)
+	m_heatmap = mode;
+	m_heatmapScale = scale > 0.0f ? scale : 1.0f;
+	return true;
+#else
+	m_heatmap = HEATMAP_NONE;
+	return mode == HEATMAP_NONE;
+#endif
+}
+
+bool Renderer::ParseHeatmap(const char* name, HeatmapMode& mode)
+{
+	static const char* names[] = { "none", "primary", "path" };
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (strcmp(name, names[i]) == 0)
+		{
+			mode = (HeatmapMode)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+Colour Renderer::GetHeatmapColour(double cost) const
+{
+	//blue, cyan, green, yellow then red at the scale, anything costlier stays red
+	static const float ramp[5][3] =
+	{
+		{ 0.0f, 0.0f, 1.0f },
+		{ 0.0f, 1.0f, 1.0f },
+		{ 0.0f, 1.0f, 0.0f },
+		{ 1.0f, 1.0f, 0.0f },
+		{ 1.0f, 0.0f, 0.0f }
+	};
+
+	float t = (float)(cost / m_heatmapScale) * 4.0f;
+	t = t < 0.0f ? 0.0f : t > 4.0f ? 4.0f : t;
+
+	int i = t < 4.0f ? (int)t : 3;
+	float f = t - (float)i;
+
+	return Colour(ramp[i][0] + (ramp[i + 1][0] - ramp[i][0]) * f,
+		ramp[i][1] + (ramp[i + 1][1] - ramp[i][1]) * f,
+		ramp[i][2] + (ramp[i + 1][2] - ramp[i][2]) * f);
+}
+
+Colour Renderer::TraceHeatmap(Scene* pScene, Ray& ray, RayHitResult* primaryhit)
+{
+	unsigned long long before = RayStats::GetTraversalCost();
+
+	RAYSTATS_ADD(STAT_PRIMARY, 1);
+	RayHitResult result = pScene->IntersectByRay(ray);
+
+	if (primaryhit)
+		*primaryhit = result;
+
+	return GetHeatmapColour((double)(RayStats::GetTraversalCost() - before));
+}
@@ -9,12 +9,18 @@
 ---------------------------------------------------------------------*/
 #pragma once
 
+#include <string>
+#include <chrono>
 #include "Material.h"
 #include "Ray.h"
 #include "Scene.h"
 #include "Vector3.h"
 #include "Framebuffer.h"
 
+class Denoiser;
+class IrradianceCache;
+class RenderControl;
+
 class Renderer
 {
 public:
@@ -34,6 +40,51 @@ public:
 		TRACE_REFRACTION = 0x1 << 4,			//trace refraction rays
 	};
 
+	//Arbitrary output variables, extra framebuffer layers filled from the primary hit of each pixel
+	enum AOVFlags
+	{
+		AOV_ALBEDO = 0x1,						//diffuse colour of the surface, textures included
+		AOV_NORMAL = 0x1 << 1,					//shading normal in world space
+		AOV_DEPTH = 0x1 << 2,					//distance along the primary ray
+		AOV_PRIMID = 0x1 << 3,					//index of the scene object, -1 for the background
+		AOV_MATID = 0x1 << 4,					//index of the object's material, -1 for the background
+		AOV_ALL = 0x1f
+	};
+
+	enum
+	{
+		AOV_COUNT = 5
+	};
+
+	//Debug modes writing the BVH nodes visited plus primitives tested to the framebuffer
+	//in place of shading, they need a build with TINYRAY_STATS
+	enum HeatmapMode
+	{
+		HEATMAP_NONE = 0,
+		HEATMAP_PRIMARY,						//cost of the primary ray alone, nothing is shaded
+		HEATMAP_PATH							//cost of every ray traced for a camera sample
+	};
+
+	unsigned int	m_aovFlags;					//AOVs being rendered, 0 for none
+	int				m_aovLayers[AOV_COUNT];		//framebuffer layer of each AOV, -1 if it is not rendered
+
+	int				m_samplesPerPixel;			//samples per pixel for renderers that take several, 0 for the renderer's default
+	int				m_firstSample;				//the range of those samples traced, see SetSampleRange
+	int				m_numSamples;
+	int				m_lightSamples;				//lights picked per shading point when a scene has more, 0 to shade with every light
+	Denoiser		*m_denoiser;				//filters each frame from RenderFrame, not owned, NULL for none
+	IrradianceCache	*m_irradianceCache;			//indirect diffuse lighting kept between frames, not owned, NULL for none
+	std::string		m_statsFile;				//ray stats are appended here after each render in TINYRAY_STATS builds, empty for none
+	std::chrono::steady_clock::time_point m_statsStart;
+	HeatmapMode		m_heatmap;					//traversal cost heatmap written instead of shading, HEATMAP_NONE to shade
+	float			m_heatmapScale;				//cost drawn in red, lower costs run through yellow and green to blue
+	RenderControl	*m_control;					//time budget, sample cap and cancellation of each frame, not owned, NULL for none
+	int				m_sampleSeed;				//picks the random sequences of the pixels, frames traced with different seeds share no samples
+	std::string		m_checkpointFile;			//path traced progress is kept here and resumed from, empty for none
+	double			m_checkpointInterval;		//seconds between checkpoint writes
+	int				m_firstRow;					//DoTrace traces rows m_firstRow up to m_endRow, the whole frame outside RenderRows
+	int				m_endRow;
+
 	inline void SetTraceLevel(int level)		//Set the level of recursion, default is 5
 	{
 		m_traceLevel = level;
@@ -49,11 +100,50 @@ public:
 		return m_framebuffer;
 	}
 
+	//Replace the framebuffer with one storing its pixels in the given format
+	void SetFramebufferFormat(Framebuffer::FORMAT format);
+
+	//Add a framebuffer layer for each AOV in flags, named as in ParseAOV
+	void EnableAOVs(unsigned int flags);
+
+	//AOV flag from its name: albedo, normal, depth, primid, matid or all
+	static bool ParseAOV(const char* name, unsigned int& flag);
+
+	inline void SetSamplesPerPixel(int samples)
+	{
+		m_samplesPerPixel = samples;
+	}
+
+	//Trace count of the samples per pixel from sample first on, 0 for all of them. Samples are
+	//seeded by their index, so renders of ranges that do not overlap hold different samples and
+	//their checkpoints merge into the render of all of them, see tinyray-merge
+	inline void SetSampleRange(int first, int count)
+	{
+		m_firstSample = first > 0 ? first : 0;
+		m_numSamples = count > 0 ? count : 0;
+	}
+
+	inline void SetLightSamples(int samples)
+	{
+		m_lightSamples = samples;
+	}
+
+	//Denoise every frame from RenderFrame, this enables the albedo, normal and depth AOVs
+	//the denoiser is guided by. Pass NULL to turn it off again
+	void SetDenoiser(Denoiser* denoiser);
+
+	//Interpolate indirect diffuse lighting from a cache that the path tracer fills before each
+	//frame. The cache is kept across frames, clear it when the scene changes
+	inline void SetIrradianceCache(IrradianceCache* cache)
+	{
+		m_irradianceCache = cache;
+	}
+
 	TraceFlags m_traceflag;						//current trace flags value default is TRACE_AMBIENT
 
 	Renderer();
 	Renderer(int Width, int Hight);
-	~Renderer();
+	virtual ~Renderer();
 
 	//Trace the scene from a given ray and scene
 	//Params:
@@ -62,9 +152,73 @@ public:
 	//  Colour incolour		default colour to use when the ray does not intersect with any objects
 	//  int tracelevel		the current recursion level of the TraceScene call
 	//  bool shadowray		true if the input ray is a shadow ray, could be useful when handling shadows
-	virtual Colour TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, bool shadowray) = 0;
+	//  RayHitResult* primaryhit	if not NULL receives the hit of the input ray, used to fill the AOVs
+	virtual Colour TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, bool shadowray, RayHitResult* primaryhit = NULL) = 0;
+
+	//The surface colour written to the albedo AOV
+	virtual Colour GetAlbedo(const RayHitResult& hit);
+
+	//Write the enabled AOVs of pixel (x, y) from the primary hit
+	void WriteAOVs(Scene* pScene, const RayHitResult& hit, int x, int y);
+
+	//Bound every frame by the time budget, sample cap and cancel flag of a control, NULL to render frames whole
+	inline void SetRenderControl(RenderControl* control)
+	{
+		m_control = control;
+	}
+
+	//Default 0, see m_sampleSeed
+	inline void SetSampleSeed(int seed)
+	{
+		m_sampleSeed = seed;
+	}
+
+	//Resume path traced frames from a checkpoint file and write their progress to it every interval
+	//seconds and as they finish. A checkpoint of another frame is replaced. NULL to stop checkpointing
+	inline void SetCheckpoint(const char* filename, double interval = 60.0)
+	{
+		m_checkpointFile = filename ? filename : "";
+		m_checkpointInterval = interval;
+	}
+
+	//Append the ray stats of each render to a file as a line of JSON, NULL to only print them
+	inline void SetStatsFile(const char* filename)
+	{
+		m_statsFile = filename ? filename : "";
+	}
+
+	//Called by DoTrace around a render in TINYRAY_STATS builds, the end prints the
+	//counters of every thread and appends them to the stats file
+	void BeginRayStats();
+	void EndRayStats();
+
+	//Render a traversal cost heatmap, scale is the cost shown in red. Returns false in builds
+	//without TINYRAY_STATS, which count nothing to draw
+	bool SetHeatmap(HeatmapMode mode, float scale);
+
+	//Heatmap mode from its name: primary, path or none
+	static bool ParseHeatmap(const char* name, HeatmapMode& mode);
+
+	//Colour of a cost on the heatmap ramp
+	Colour GetHeatmapColour(double cost) const;
+
+	//Heatmap colour of the primary ray alone, for HEATMAP_PRIMARY, primaryhit as for TraceScene
+	Colour TraceHeatmap(Scene* pScene, Ray& ray, RayHitResult* primaryhit = NULL);
 
 	//Trace a given scene
 	//Params: Scene* pScene   Pointer to the scene to be ray traced
 	virtual void DoTrace(Scene* pScene) = 0;
+
+	//Trace a frame into the framebuffer even if the scene has been traced before, and
+	//denoise it if a denoiser is set. Nothing is presented, the caller decides what to do with the framebuffer
+	//Params: Scene* pScene   Pointer to the scene to be ray traced
+	void RenderFrame(Scene* pScene);
+
+	//Trace count rows of a frame from row first, for frames split between processes. The other rows
+	//of the framebuffer are left as they were and nothing is denoised, the whole frame is the same
+	//as RenderFrame traces it once every band is in
+	void RenderRows(Scene* pScene, int first, int count);
+
+	//Denoise the framebuffer as RenderFrame does, for a frame put together from bands traced elsewhere
+	void FinishFrame();
 };
@@ -12,12 +12,21 @@
 #include "Plane.h"
 #include "Box.h"
 #include "TriMesh.h"
+#include "MeshInstance.h"
 #include "ImageIO.h"
+#include "AssetLoader.h"
+#include "SceneFileReader.h"
+#include "EnvironmentMap.h"
+#include "Profiler.h"
 
 Scene::Scene()
 {
 	m_bgtex = NULL;
+	m_environment = NULL;
+	m_loader = NULL;
+	m_rebuildRatio = 1.5f;
 	InitDefaultScene();
+	BuildAccelerationStructure();
 }
 
 
@@ -25,13 +34,15 @@ Scene::~Scene()
 {
 	CleanupScene();
 	if (m_bgtex) delete m_bgtex;
+	if (m_environment) delete m_environment;
+	if (m_loader) delete m_loader;
 }
 
 void Scene::InitDefaultScene()
 {
 	//Create a box and its material
-	Primitive* newobj = new Box(Vector3(-4.0, 4.0, -20.0), 10.0, 15.0, 4.0);
-	Material* newmat = new Material();
+	Primitive* newobj = m_arena.New<Box>(Vector3(-4.0, 4.0, -20.0), 10.0, 15.0, 4.0);
+	Material* newmat = m_arena.New<Material>(&m_arena);
 	//mat for the box1
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.8, 0.0, 0.0);
@@ -41,8 +52,8 @@ void Scene::InitDefaultScene()
 	m_sceneObjects.push_back(newobj);
 	m_objectMaterials.push_back(newmat);
 
-	newobj = new Box(Vector3(4.0, 4.0, -15.0), 4.0, 20.0, 4.0);
-	newmat = new Material();
+	newobj = m_arena.New<Box>(Vector3(4.0, 4.0, -15.0), 4.0, 20.0, 4.0);
+	newmat = m_arena.New<Material>(&m_arena);
 	//mat for the box2
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.8, 0.8, 0.8);
@@ -53,8 +64,8 @@ void Scene::InitDefaultScene()
 	m_objectMaterials.push_back(newmat);
 
 	//light
-	newobj = new Box(Vector3(0.0, 21.5, -10.0), 10.0, 4.0, 10.0);
-	newmat = new Material();
+	newobj = m_arena.New<Box>(Vector3(0.0, 21.5, -10.0), 10.0, 4.0, 10.0);
+	newmat = m_arena.New<Material>(&m_arena);
 	//mat for the box2
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.0, 0.0, 0.0);
@@ -67,8 +78,8 @@ void Scene::InitDefaultScene()
 	m_objectMaterials.push_back(newmat);
 
 	//Create sphere 1 and its material
-	newobj = new Sphere(3.0, 2, -3.5, 2.0); //sphere 2
-	newmat = new Material();
+	newobj = m_arena.New<Sphere>(3.0, 2, -3.5, 2.0); //sphere 2
+	newmat = m_arena.New<Material>(&m_arena);
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.0, 0.8, 0.0);
 	newmat->SetSpecularColour(1.0, 1.0, 1.0);
@@ -78,8 +89,8 @@ void Scene::InitDefaultScene()
 	m_objectMaterials.push_back(newmat);
 
 	//Create sphere 2 and its material
-	newobj = new Sphere(-2.0, 3.0, -5.0, 3.0); //sphere 3
-	newmat = new Material();
+	newobj = m_arena.New<Sphere>(-2.0, 3.0, -5.0, 3.0); //sphere 3
+	newmat = m_arena.New<Material>(&m_arena);
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.0, 0.0, 0.8);
 	newmat->SetSpecularColour(1.0, 1.0, 1.0);
@@ -89,9 +100,9 @@ void Scene::InitDefaultScene()
 	m_objectMaterials.push_back(newmat);
 
 
-	newobj = new Plane(); //an xz plane at the origin, floor
+	newobj = m_arena.New<Plane>(); //an xz plane at the origin, floor
 	static_cast<Plane*>(newobj)->SetPlane(Vector3(0.0, 1.0, 0.0), 0.0);
-	newmat = new Material();
+	newmat = m_arena.New<Material>(&m_arena);
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.7, 0.7, 0.7);
 	newmat->SetSpecularColour(0.0, 0.0, 0.0);
@@ -101,32 +112,33 @@ void Scene::InitDefaultScene()
 	m_sceneObjects.push_back(newobj);
 	m_objectMaterials.push_back(newmat);
 
-	newobj = new Plane(); //an xz plane 40 units above, ceiling
+	newobj = m_arena.New<Plane>(); //an xz plane 40 units above, ceiling
 	static_cast<Plane*>(newobj)->SetPlane(Vector3(0.0, -1.0, 0.0), -20.0);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
 
 	//material for front and back walls
-	newmat = new Material();
+	newmat = m_arena.New<Material>(&m_arena);
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.0, 0.7, 0.0);
 	newmat->SetSpecularColour(0.0, 0.0, 0.0);
 	newmat->SetSpecPower(10);
 	newmat->SetCastShadow(false);
 
-	newobj = new Plane(); //an xy plane 40 units along -z axis, 
+	newobj = m_arena.New<Plane>(); //an xy plane 40 units along -z axis, 
 	static_cast<Plane*>(newobj)->SetPlane(Vector3(0.0, 0.0, 1.0), -40.0);
 	m_sceneObjects.push_back(newobj);
+	m_objectMaterials.push_back(newmat);
 	newobj->SetMaterial(newmat);
 
-	newobj = new Plane(); //an xy plane 40 units along the z axis
+	newobj = m_arena.New<Plane>(); //an xy plane 40 units along the z axis
 	static_cast<Plane*>(newobj)->SetPlane(Vector3(0.0, 0.0, -1.0), -40.0);
 	m_sceneObjects.push_back(newobj);
 	newobj->SetMaterial(newmat);
 
-	newobj = new Plane(); //an yz plane 20 units along -x axis
+	newobj = m_arena.New<Plane>(); //an yz plane 20 units along -x axis
 	static_cast<Plane*>(newobj)->SetPlane(Vector3(1.0, 0.0, 0.0), -20.0);
-	newmat = new Material();
+	newmat = m_arena.New<Material>(&m_arena);
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.0, 0.0, 0.7);
 	newmat->SetSpecularColour(0.0, 0.0, 0.0);
@@ -136,13 +148,13 @@ void Scene::InitDefaultScene()
 	m_sceneObjects.push_back(newobj);
 	m_objectMaterials.push_back(newmat);
 
-	newobj = new Plane(); //an yz plane 20 units along +x axis
+	newobj = m_arena.New<Plane>(); //an yz plane 20 units along +x axis
 	static_cast<Plane*>(newobj)->SetPlane(Vector3(-1.0, 0.0, 0.0), -20.0);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
 
 	//Create one light source for the scene
-	Light *newlight = new Light();
+	Light *newlight = m_arena.New<Light>();
 	newlight->SetLightPosition(0.0, 20.0, 10.0);
 	m_lights.push_back(newlight);
 
@@ -231,93 +243,370 @@ void Scene::InitDefaultScene()
 //#endif
 void Scene::CleanupScene()
 {
-	//Cleanup object list
+	//background loads may still be writing into the assets about to be freed
+	if (m_loader)
+		m_loader->Wait();
+
+	//objects, materials, lights and meshes all live in the arena and go in one go
+	m_sceneObjects.clear();
+	m_objectMaterials.clear();
+	m_lights.clear();
+	m_meshes.clear();
+	m_arena.Release();
+
+	m_primitives.Clear();
+	m_bvh.Clear();
+	m_refs.clear();
+	m_refBounds.clear();
+	m_objectRefs.clear();
+	m_dirtyObjects.clear();
+	m_materialIds.clear();
+}
+
+void Scene::BuildAccelerationStructure()
+{
+	PROFILE_SCOPE("BuildScene");
+
+	m_primitives.Clear();
+	m_refs.clear();
+	m_objectRefs.clear();
+	m_dirtyObjects.clear();
+	m_materialIds.clear();
+
+	for (size_t i = 0; i < m_objectMaterials.size(); i++)
+	{
+		m_materialIds[m_objectMaterials[i]] = (int)i;
+	}
+
 	std::vector<Primitive*>::iterator prim_iter = m_sceneObjects.begin();
 
 	while (prim_iter != m_sceneObjects.end())
 	{
-		delete *prim_iter;
+		Primitive* prim = *prim_iter;
+		PrimRef ref;
+		ref.type = prim->m_primtype;
+
+		ObjectRefs objrefs;
+		objrefs.firstSlot = (int)m_refs.size();
+		objrefs.planeIndex = -1;
+		objrefs.objectId = (int)(prim_iter - m_sceneObjects.begin());
+
+		switch (prim->m_primtype)
+		{
+		case Primitive::PRIMTYPE_Plane:
+			//planes are unbounded so they stay out of the BVH
+			objrefs.planeIndex = m_primitives.AddPlane(static_cast<Plane*>(prim));
+			break;
+		case Primitive::PRIMTYPE_Sphere:
+			ref.index = m_primitives.AddSphere(static_cast<Sphere*>(prim));
+			m_refs.push_back(ref);
+			break;
+		case Primitive::PRIMTYPE_Box:
+			ref.index = m_primitives.AddBox(static_cast<Box*>(prim));
+			m_refs.push_back(ref);
+			break;
+		case Primitive::PRIMTYPE_Triangle:
+			ref.index = m_primitives.AddTriangle(static_cast<Triangle*>(prim), prim, false);
+			m_refs.push_back(ref);
+			break;
+		case Primitive::PRIMTYPE_TRIMESH:
+			{
+				//mesh triangles are flattened into the triangle array but still report the mesh as the hit object
+				TriMesh* mesh = static_cast<TriMesh*>(prim);
+				Triangle* triangles = mesh->GetTriangles();
+
+				ref.type = Primitive::PRIMTYPE_Triangle;
+				for (int i = 0; i < mesh->GetNumTriangles(); i++)
+				{
+					ref.index = m_primitives.AddTriangle(&triangles[i], mesh, true);
+					m_refs.push_back(ref);
+				}
+			}
+			break;
+		case Primitive::PRIMTYPE_Instance:
+			ref.index = m_primitives.AddInstance(static_cast<MeshInstance*>(prim));
+			m_refs.push_back(ref);
+			break;
+		default:
+			break;
+		}
+
+		objrefs.numSlots = (int)m_refs.size() - objrefs.firstSlot;
+		m_objectRefs[prim] = objrefs;
+
 		prim_iter++;
 	}
 
-	m_sceneObjects.clear();
+	m_refBounds.resize(m_refs.size());
+	for (size_t i = 0; i < m_refs.size(); i++)
+	{
+		m_refBounds[i] = m_primitives.GetBounds(m_refs[i]);
+	}
 
-	//Cleanup material list
-	std::vector<Material*>::iterator mat_iter = m_objectMaterials.begin();
+	m_bvh.Build(m_refs, m_refBounds);
+	m_lightTree.Build(m_lights);
+}
+
+int Scene::GetObjectId(Primitive* object) const
+{
+	std::map<Primitive*, ObjectRefs>::const_iterator found = m_objectRefs.find(object);
+
+	return found != m_objectRefs.end() ? found->second.objectId : -1;
+}
+
+int Scene::GetMaterialId(const Material* material) const
+{
+	std::map<const Material*, int>::const_iterator found = m_materialIds.find(material);
 
-	while (mat_iter != m_objectMaterials.end())
+	return found != m_materialIds.end() ? found->second : -1;
+}
+
+//FNV-1a over the bytes of a value
+static void HashBytes(unsigned int& hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+
+	for (size_t i = 0; i < size; i++)
 	{
-		delete *mat_iter;
-		mat_iter++;
+		hash ^= bytes[i];
+		hash *= 16777619u;
 	}
-	m_objectMaterials.clear();
+}
 
-	//cleanup light list
-	std::vector<Light*>::iterator lit_iter = m_lights.begin();
+static void HashVector(unsigned int& hash, const Vector3& v)
+{
+	float xyz[3] = { v[0], v[1], v[2] };
+
+	HashBytes(hash, xyz, sizeof(xyz));
+}
 
-	while (lit_iter != m_lights.end())
+unsigned int Scene::GetContentHash() const
+{
+	unsigned int hash = 2166136261u;
+
+	int counts[3 + Primitive::PRIMTYPE_COUNT] = { (int)m_sceneObjects.size(), (int)m_objectMaterials.size(), (int)m_lights.size() };
+
+	for (int type = 0; type < Primitive::PRIMTYPE_COUNT; type++)
 	{
-		delete *lit_iter;
-		lit_iter++;
+		counts[3 + type] = m_primitives.GetCount(type);
 	}
 
-	m_lights.clear();
+	HashBytes(hash, counts, sizeof(counts));
+
+	if (!m_bvh.IsEmpty())
+	{
+		HashVector(hash, m_bvh.GetBounds().m_min);
+		HashVector(hash, m_bvh.GetBounds().m_max);
+	}
+
+	for (size_t i = 0; i < m_objectMaterials.size(); i++)
+	{
+		Material* material = m_objectMaterials[i];
+		double specpower = material->GetSpecPower();
+
+		HashVector(hash, material->GetEmissiveColour());
+		HashVector(hash, material->GetAmbientColour());
+		HashVector(hash, material->GetDiffuseColour());
+		HashVector(hash, material->GetSpecularColour());
+		HashBytes(hash, &specpower, sizeof(specpower));
+	}
+
+	for (size_t i = 0; i < m_lights.size(); i++)
+	{
+		HashVector(hash, m_lights[i]->GetLightPosition());
+		HashVector(hash, m_lights[i]->GetLightColour());
+	}
+
+	return hash;
 }
 
-RayHitResult Scene::IntersectByRay(Ray& ray, bool isShadowRay)
+void Scene::MarkDirty(Primitive* object)
 {
-	RayHitResult result = Ray::s_defaultHitResult;
+	m_dirtyObjects.push_back(object);
+}
 
-	std::vector<Primitive*>::iterator prim_iter = m_sceneObjects.begin();
+void Scene::UpdateAccelerationStructure()
+{
+	if (m_dirtyObjects.empty())
+		return;
 
-	if (!isShadowRay)
+	PROFILE_SCOPE("UpdateScene");
+
+	std::vector<int> dirtyslots;
+
+	std::vector<Primitive*>::iterator dirty_iter = m_dirtyObjects.begin();
+
+	while (dirty_iter != m_dirtyObjects.end())
 	{
-		while (prim_iter != m_sceneObjects.end())
+		std::map<Primitive*, ObjectRefs>::iterator found = m_objectRefs.find(*dirty_iter);
+		dirty_iter++;
+
+		//objects added since the last build are picked up by the rebuild below
+		if (found == m_objectRefs.end())
 		{
-			RayHitResult current;
+			BuildAccelerationStructure();
+			return;
+		}
 
-			current = (*prim_iter)->IntersectByRay(ray);
+		const ObjectRefs& objrefs = found->second;
 
-			if (current.t > 0.0 && current.t < result.t)
-			{
-				result = current;
-			}
+		if (objrefs.planeIndex >= 0)
+		{
+			PrimRef ref = { Primitive::PRIMTYPE_Plane, objrefs.planeIndex };
+			m_primitives.UpdatePrimitive(ref);
+		}
 
-			prim_iter++;
+		for (int slot = objrefs.firstSlot; slot < objrefs.firstSlot + objrefs.numSlots; slot++)
+		{
+			m_primitives.UpdatePrimitive(m_refs[slot]);
+			m_refBounds[slot] = m_primitives.GetBounds(m_refs[slot]);
+			dirtyslots.push_back(slot);
 		}
 	}
+
+	m_dirtyObjects.clear();
+
+	if (dirtyslots.empty())
+		return;
+
+	m_bvh.Refit(dirtyslots, m_refBounds);
+
+	//refitting and rotations only go so far, once objects have moved a long way from where
+	//the tree was built it is cheaper overall to build it again
+	if (m_bvh.GetSAHCost() > m_bvh.GetBuildSAHCost() * m_rebuildRatio)
+	{
+		BuildAccelerationStructure();
+	}
+}
+
+TriMesh* Scene::LoadMesh(const char* filename)
+{
+	std::map<std::string, TriMesh*>::iterator found = m_meshes.find(filename);
+
+	if (found != m_meshes.end())
+		return found->second;
+
+	TriMesh* mesh;
+
+	if (m_loader)
+	{
+		mesh = m_arena.New<TriMesh>(&m_arena);
+		m_loader->LoadMesh(mesh, filename);
+	}
 	else
 	{
-		while (prim_iter != m_sceneObjects.end())
-		{
-			RayHitResult current = result;
-			bool castShadow = (*prim_iter)->GetMaterial()->CastShadow();
+		mesh = m_arena.New<TriMesh>(filename, &m_arena);
+	}
 
-			current = (*prim_iter)->IntersectByRay(ray);
+	m_meshes[filename] = mesh;
 
-			if (castShadow && current.t > 0.0 && current.t < result.t)
-			{
-				std::vector<Light*>::iterator iter = m_lights.begin();
+	return mesh;
+}
 
-				while (iter != m_lights.end())
-				{
-					Vector3 r = ray.GetRay();
-					double ldotr = (*iter)->GetLightPosition().DotProduct(r);
-					double pdotr = result.point.DotProduct(r);
+bool Scene::LoadSceneFile(const char* filename)
+{
+	PROFILE_SCOPE("LoadScene");
 
-					if (pdotr < ldotr)
-					{
-						result = current;
-					}
+	CleanupScene();
 
-					iter++;
-				}
+	if (m_bgtex) delete m_bgtex;
+	m_bgtex = NULL;
+
+	if (m_environment) delete m_environment;
+	m_environment = NULL;
+
+	if (!m_loader)
+		m_loader = new AssetLoader();
+
+	m_background.SetVector(0.0, 0.0, 0.0);
+	m_sceneWidth = 1.33333333;
+	m_sceneHeight = 1.0;
+	m_activeCamera.InitDefaultCamera();
+
+	bool ok = importSceneFile(filename, this) == 0;
+
+	//the acceleration structure needs the meshes, textures carry on loading while rendering
+	m_loader->WaitForMeshes();
+
+	if (!ok)
+		CleanupScene();
 
+	BuildAccelerationStructure();
+
+	return ok;
+}
+
+void Scene::AddObject(Primitive* object)
+{
+	m_sceneObjects.push_back(object);
+}
+
+void Scene::AddMaterial(Material* material)
+{
+	m_objectMaterials.push_back(material);
+}
+
+void Scene::AddLight(Light* light)
+{
+	m_lights.push_back(light);
+}
+
+void Scene::SetBackgroundTexture(Texture* texture)
+{
+	if (m_bgtex) delete m_bgtex;
+	m_bgtex = texture;
+}
+
+void Scene::SetEnvironmentMap(EnvironmentMap* environment)
+{
+	if (m_environment) delete m_environment;
+	m_environment = environment;
+}
+
+RayHitResult Scene::IntersectByRay(Ray& ray, bool isShadowRay, double maxDistance)
+{
+	RayHitResult result = Ray::s_defaultHitResult;
+
+	//nothing beyond maxDistance is tested
+	PrimHit hit;
+	hit.t = (float)maxDistance;
+
+	bool found = m_primitives.IntersectPlanes(ray, hit, isShadowRay);
+
+	PrimitiveLeafIntersector intersector = { &m_primitives, &ray, &hit, isShadowRay, false };
+	m_bvh.Traverse(ray, hit.t, intersector);
+	found |= intersector.found;
+
+	if (!found)
+		return result;
+
+	if (isShadowRay && maxDistance >= FARFAR_AWAY)
+	{
+		//the closest shadow caster only counts if there is a light beyond it along the ray
+		Vector3 r = ray.GetRay();
+		double pdotr = (ray.GetRayStart() + r*hit.t).DotProduct(r);
+		bool occluding = false;
+
+		std::vector<Light*>::iterator iter = m_lights.begin();
+
+		while (iter != m_lights.end())
+		{
+			double ldotr = (*iter)->GetLightPosition().DotProduct(r);
+
+			if (pdotr < ldotr)
+			{
+				occluding = true;
+				break;
 			}
 
-			prim_iter++;
+			iter++;
 		}
+
+		if (!occluding)
+			return result;
 	}
 
+	m_primitives.ResolveHit(ray, hit, result);
+
 	return result;
 }
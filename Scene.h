@@ -13,19 +13,54 @@
 #include "Primitive.h"
 #include "Material.h"
 #include "Light.h"
+#include "PrimitiveArrays.h"
+#include "BVH.h"
+#include "LightTree.h"
+#include "Arena.h"
 #include <vector>
+#include <map>
+#include <string>
+
+class TriMesh;
+class AssetLoader;
+class EnvironmentMap;
 
 class Scene
 {
 	private:
 		Camera							m_activeCamera;
 		
+		Arena							m_arena;			//holds the objects, materials, lights and meshes, freed by CleanupScene
 		std::vector<Primitive*>			m_sceneObjects;
 		std::vector<Material*>			m_objectMaterials;
 		std::vector<Light*>				m_lights;
+		std::map<std::string, TriMesh*>	m_meshes;			//meshes shared by MeshInstances, keyed by file name
+
+		PrimitiveArrays					m_primitives;		//scene objects flattened into per-type arrays
+		BVH								m_bvh;				//hierarchy over the bounded primitives, planes are tested separately
+		LightTree						m_lightTree;		//hierarchy over m_lights for picking a few lights per shading point
+
+		//where each scene object ended up in the primitive arrays, so that moving it only touches its own entries
+		struct ObjectRefs
+		{
+			int		firstSlot;			//first of the object's references given to the BVH
+			int		numSlots;
+			int		planeIndex;			//index into the plane array, -1 if the object is not a plane
+			int		objectId;			//index into m_sceneObjects
+		};
+
+		std::vector<PrimRef>				m_refs;
+		std::vector<BoundingBox>			m_refBounds;
+		std::map<Primitive*, ObjectRefs>	m_objectRefs;
+		std::vector<Primitive*>				m_dirtyObjects;
+		std::map<const Material*, int>		m_materialIds;		//index of each material in m_objectMaterials
+		float								m_rebuildRatio;		//rebuild once refitting has degraded the SAH cost by this factor
+
+		AssetLoader						*m_loader;			//created when a scene file is loaded
 
 		Colour							m_background;
 		Texture							*m_bgtex;
+		EnvironmentMap					*m_environment;		//lights the scene from all around, NULL for none
 		double							m_sceneWidth;
 		double							m_sceneHeight;
 
@@ -37,11 +72,67 @@ class Scene
 
 		//void InitTexturedScene();
 
+		//Flatten the scene objects into the primitive arrays and build the BVH over them, and
+		//the light tree over the lights. This needs calling again whenever objects are added or moved
+		void BuildAccelerationStructure();
+
+		//Flag an object that has been moved or reshaped since the acceleration structure was built
+		void MarkDirty(Primitive* object);
+
+		//Refit the BVH for the objects marked dirty, falling back to a full rebuild if the
+		//tree quality has degraded past the rebuild ratio. Call this before rendering a frame
+		void UpdateAccelerationStructure();
+
+		inline void SetRebuildRatio(float ratio)
+		{
+			m_rebuildRatio = ratio;
+		}
+
+		//Load an OBJ file once, every MeshInstance placed with the returned mesh shares
+		//its triangles and BVH. The mesh is placed in the arena. While a scene file is being
+		//loaded the mesh is read in the background
+		TriMesh* LoadMesh(const char* filename);
+
+		//Replace the scene with the contents of a scene file, see SceneFileReader.cpp for
+		//the format. Meshes load in parallel, textures on first use. Returns false on a
+		//parse error, the scene is then left empty
+		bool LoadSceneFile(const char* filename);
+
+		//Objects, materials, lights and meshes of the scene are created here, side by side
+		//in memory, and freed together by CleanupScene
+		inline Arena& GetArena()
+		{
+			return m_arena;
+		}
+
+		//Add content to the scene. Objects, materials and lights must come from the arena,
+		//the texture and environment map are the scene's to delete
+		void AddObject(Primitive* object);
+		void AddMaterial(Material* material);
+		void AddLight(Light* light);
+		void SetBackgroundTexture(Texture* texture);
+		void SetEnvironmentMap(EnvironmentMap* environment);
+
+		inline EnvironmentMap* GetEnvironmentMap()
+		{
+			return m_environment;
+		}
+
+		inline AssetLoader* GetAssetLoader()
+		{
+			return m_loader;
+		}
+
 		inline void SetSceneWidth(double width)
 		{
 			m_sceneWidth = width;
 		}
 
+		inline void SetSceneHeight(double height)
+		{
+			m_sceneHeight = height;
+		}
+
 		inline Camera* GetSceneCamera()
 		{
 			return &m_activeCamera;
@@ -67,12 +158,31 @@ class Scene
 			return m_bgtex ? m_bgtex->GetTexelColour(u,v) : m_background;
 		}
 
-		RayHitResult IntersectByRay(Ray& ray, bool isShadowRay = false);
+		//Closest hit along the ray. A shadow ray only finds shadow casters, pass the distance
+		//to the light it was cast towards as maxDistance. Without one, a caster only counts if
+		//some light lies further along the ray
+		RayHitResult IntersectByRay(Ray& ray, bool isShadowRay = false, double maxDistance = FARFAR_AWAY);
+
+		//Index of an object and of a material in the order they were added, -1 if unknown.
+		//These are valid once the acceleration structure has been built
+		int GetObjectId(Primitive* object) const;
+		int GetMaterialId(const Material* material) const;
+
+		//Hash of the object, material and light counts, the primitive counts, the root bounds
+		//and the materials and lights, for telling whether two processes loaded the same scene.
+		//Valid once the acceleration structure has been built
+		unsigned int GetContentHash() const;
 
 		inline std::vector<Light*>* GetLightList()
 		{
 			return &m_lights;
 		}
+
+		//Valid once the acceleration structure has been built, lights added since are missing from it
+		inline const LightTree& GetLightTree() const
+		{
+			return m_lightTree;
+		}
 		
 		void		CleanupScene();
 		
@@ -0,0 +1,559 @@
+//A line based scene description, one statement per line, '#' starts a comment.
+//Positions and colours are given as three numbers, file names are relative to
+//the scene file and may be quoted.
+//
+//	camera px py pz lx ly lz				position and look-at point
+//	background r g b [texture file]
+//	environment file [intensity s]			lat-long image lighting the path tracer
+//	light x y z [colour r g b]
+//	material name [ambient r g b] [diffuse r g b] [specular r g b] [emissive r g b]
+//		[power p] [noshadow] [diffusemap file] [normalmap file]
+//	sphere x y z radius [material name]
+//	plane nx ny nz offset [material name]
+//	box x y z width height depth [material name] [transform]
+//	mesh file [material name]
+//	instance file [material name] [transform]
+//
+//A transform is any sequence of "translate x y z", "rotate ax ay az degrees" and
+//"scale x y z", each applied after the ones before it. Boxes are transformed
+//about their centre. Materials must be defined before they are used
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "SceneFileReader.h"
+#include "Scene.h"
+#include "Sphere.h"
+#include "Plane.h"
+#include "Box.h"
+#include "TriMesh.h"
+#include "MeshInstance.h"
+#include "AssetLoader.h"
+#include "EnvironmentMap.h"
+
+struct SceneFileState
+{
+	const char*							filename;
+	int									line;
+	std::string							directory;		//prefix for relative file names
+	std::vector<std::string>			tokens;			//the statement being read
+	size_t								next;			//next unread token
+	std::map<std::string, Material*>	materials;
+	Material*							defaultMaterial;
+	Scene*								scene;
+	Arena*								arena;			//the scene's, everything read is created here
+};
+
+static bool parseError(SceneFileState& state, const char* message)
+{
+	printf("%s(%d): %s\n", state.filename, state.line, message);
+	return false;
+}
+
+static void tokeniseLine(const char* line, std::vector<std::string>& tokens)
+{
+	tokens.clear();
+
+	const char* c = line;
+
+	while (*c)
+	{
+		while (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n')
+			c++;
+
+		if (*c == '\0' || *c == '#')
+			break;
+
+		const char* start = c;
+
+		if (*c == '"')
+		{
+			start = ++c;
+			while (*c && *c != '"')
+				c++;
+			tokens.push_back(std::string(start, c));
+			if (*c)
+				c++;
+		}
+		else
+		{
+			while (*c && *c != ' ' && *c != '\t' && *c != '\r' && *c != '\n')
+				c++;
+			tokens.push_back(std::string(start, c));
+		}
+	}
+}
+
+static bool hasToken(SceneFileState& state)
+{
+	return state.next < state.tokens.size();
+}
+
+static bool readString(SceneFileState& state, std::string& value)
+{
+	if (!hasToken(state))
+		return parseError(state, "unexpected end of line");
+
+	value = state.tokens[state.next++];
+	return true;
+}
+
+static bool readFloats(SceneFileState& state, float* values, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (!hasToken(state))
+			return parseError(state, "expected a number");
+
+		const char* token = state.tokens[state.next++].c_str();
+		char* end;
+		values[i] = (float)strtod(token, &end);
+
+		if (end == token || *end != '\0')
+			return parseError(state, "expected a number");
+	}
+
+	return true;
+}
+
+static bool readVector(SceneFileState& state, Vector3& value)
+{
+	float v[3];
+
+	if (!readFloats(state, v, 3))
+		return false;
+
+	value.SetVector(v[0], v[1], v[2]);
+	return true;
+}
+
+static std::string resolvePath(SceneFileState& state, const std::string& path)
+{
+	bool absolute = path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':');
+
+	return absolute ? path : state.directory + path;
+}
+
+static bool readMaterialName(SceneFileState& state, Material*& material)
+{
+	std::string name;
+
+	if (!readString(state, name))
+		return false;
+
+	std::map<std::string, Material*>::iterator found = state.materials.find(name);
+
+	if (found == state.materials.end())
+		return parseError(state, "undefined material");
+
+	material = found->second;
+	return true;
+}
+
+static Material* getDefaultMaterial(SceneFileState& state)
+{
+	if (!state.defaultMaterial)
+	{
+		state.defaultMaterial = state.arena->New<Material>(state.arena);
+		state.scene->AddMaterial(state.defaultMaterial);
+	}
+
+	return state.defaultMaterial;
+}
+
+//Read the options following a primitive, a NULL transformed means transforms are not allowed
+static bool readObjectOptions(SceneFileState& state, Material*& material, Transform& toWorld, bool* transformed)
+{
+	material = NULL;
+
+	while (hasToken(state))
+	{
+		std::string option = state.tokens[state.next++];
+		Transform step;
+
+		if (option == "material")
+		{
+			if (!readMaterialName(state, material))
+				return false;
+			continue;
+		}
+		else if (!transformed)
+		{
+			return parseError(state, "unknown option");
+		}
+		else if (option == "translate")
+		{
+			float v[3];
+			if (!readFloats(state, v, 3))
+				return false;
+			step.SetTranslation(v[0], v[1], v[2]);
+		}
+		else if (option == "scale")
+		{
+			float v[3];
+			if (!readFloats(state, v, 3))
+				return false;
+			step.SetScale(v[0], v[1], v[2]);
+		}
+		else if (option == "rotate")
+		{
+			float v[4];
+			if (!readFloats(state, v, 4))
+				return false;
+			Vector3 axis(v[0], v[1], v[2]);
+			if (axis.Norm() <= 0.0)
+				return parseError(state, "rotation axis is zero");
+			step.SetRotation(axis / axis.Norm(), v[3] * 3.14159265f / 180.0f);
+		}
+		else
+		{
+			return parseError(state, "unknown option");
+		}
+
+		toWorld = step * toWorld;
+		*transformed = true;
+	}
+
+	if (!material)
+		material = getDefaultMaterial(state);
+
+	return true;
+}
+
+static bool readCamera(SceneFileState& state)
+{
+	Vector3 position, lookat;
+
+	if (!readVector(state, position) || !readVector(state, lookat))
+		return false;
+
+	state.scene->GetSceneCamera()->SetPositionAndLookAt(position, lookat);
+	return true;
+}
+
+static bool readBackground(SceneFileState& state)
+{
+	if (!readVector(state, state.scene->GetBackgroundColour()))
+		return false;
+
+	while (hasToken(state))
+	{
+		std::string option = state.tokens[state.next++];
+		std::string file;
+
+		if (option != "texture")
+			return parseError(state, "unknown option");
+
+		if (!readString(state, file))
+			return false;
+
+		Texture* texture = new Texture();
+		texture->SetFile(resolvePath(state, file).c_str());
+		state.scene->SetBackgroundTexture(texture);
+		state.scene->GetAssetLoader()->PrefetchTexture(texture);
+	}
+
+	return true;
+}
+
+static bool readEnvironment(SceneFileState& state)
+{
+	std::string file;
+
+	if (!readString(state, file))
+		return false;
+
+	EnvironmentMap* environment = new EnvironmentMap();
+
+	while (hasToken(state))
+	{
+		std::string option = state.tokens[state.next++];
+		float intensity;
+
+		if (option != "intensity")
+		{
+			delete environment;
+			return parseError(state, "unknown option");
+		}
+
+		if (!readFloats(state, &intensity, 1))
+		{
+			delete environment;
+			return false;
+		}
+
+		environment->SetIntensity(intensity);
+	}
+
+	//loaded now rather than in the background, sampling needs the whole image from the first ray
+	if (!environment->LoadFromFile(resolvePath(state, file).c_str()))
+	{
+		delete environment;
+		return parseError(state, "can't load the environment map");
+	}
+
+	state.scene->SetEnvironmentMap(environment);
+
+	return true;
+}
+
+static bool readLight(SceneFileState& state)
+{
+	Vector3 position;
+
+	if (!readVector(state, position))
+		return false;
+
+	Light* light = state.arena->New<Light>();
+	light->SetLightPosition(position[0], position[1], position[2]);
+	state.scene->AddLight(light);
+
+	while (hasToken(state))
+	{
+		std::string option = state.tokens[state.next++];
+		Vector3 colour;
+
+		if (option != "colour")
+			return parseError(state, "unknown option");
+
+		if (!readVector(state, colour))
+			return false;
+
+		light->SetLightColour(colour[0], colour[1], colour[2]);
+	}
+
+	return true;
+}
+
+static bool readMaterial(SceneFileState& state)
+{
+	std::string name;
+
+	if (!readString(state, name))
+		return false;
+
+	if (state.materials.find(name) != state.materials.end())
+		return parseError(state, "material already defined");
+
+	Material* material = state.arena->New<Material>(state.arena);
+	state.scene->AddMaterial(material);
+	state.materials[name] = material;
+
+	while (hasToken(state))
+	{
+		std::string option = state.tokens[state.next++];
+		Vector3 colour;
+		float value;
+		std::string file;
+
+		if (option == "ambient" || option == "diffuse" || option == "specular" || option == "emissive")
+		{
+			if (!readVector(state, colour))
+				return false;
+
+			if (option == "ambient")
+				material->SetAmbientColour(colour[0], colour[1], colour[2]);
+			else if (option == "diffuse")
+				material->SetDiffuseColour(colour[0], colour[1], colour[2]);
+			else if (option == "specular")
+				material->SetSpecularColour(colour[0], colour[1], colour[2]);
+			else
+				material->SetEmissiveColour(colour[0], colour[1], colour[2]);
+		}
+		else if (option == "power")
+		{
+			if (!readFloats(state, &value, 1))
+				return false;
+			material->SetSpecPower(value);
+		}
+		else if (option == "noshadow")
+		{
+			material->SetCastShadow(false);
+		}
+		else if (option == "diffusemap" || option == "normalmap")
+		{
+			if (!readString(state, file))
+				return false;
+
+			Texture::TEXUNIT unit = option == "diffusemap" ? Texture::TEXUNIT_DIFFUSE : Texture::TEXUNIT_NORMAL;
+			material->SetTextureFromFile(unit, resolvePath(state, file).c_str(), true);
+			state.scene->GetAssetLoader()->PrefetchTexture(material->GetTexture(unit));
+		}
+		else
+		{
+			return parseError(state, "unknown option");
+		}
+	}
+
+	return true;
+}
+
+static bool readSphere(SceneFileState& state)
+{
+	float v[4];
+	Material* material;
+	Transform toWorld;
+
+	if (!readFloats(state, v, 4) || !readObjectOptions(state, material, toWorld, NULL))
+		return false;
+
+	Sphere* sphere = state.arena->New<Sphere>(v[0], v[1], v[2], v[3]);
+	sphere->SetMaterial(material);
+	state.scene->AddObject(sphere);
+
+	return true;
+}
+
+static bool readPlane(SceneFileState& state)
+{
+	Vector3 normal;
+	float offset;
+	Material* material;
+	Transform toWorld;
+
+	if (!readVector(state, normal) || !readFloats(state, &offset, 1) || !readObjectOptions(state, material, toWorld, NULL))
+		return false;
+
+	if (normal.Norm() <= 0.0)
+		return parseError(state, "plane normal is zero");
+
+	Plane* plane = state.arena->New<Plane>();
+	plane->SetPlane(normal / normal.Norm(), offset);
+	plane->SetMaterial(material);
+	state.scene->AddObject(plane);
+
+	return true;
+}
+
+static bool readBox(SceneFileState& state)
+{
+	Vector3 position;
+	float size[3];
+	Material* material;
+	Transform toWorld;
+	bool transformed = false;
+
+	if (!readVector(state, position) || !readFloats(state, size, 3) || !readObjectOptions(state, material, toWorld, &transformed))
+		return false;
+
+	Box* box;
+
+	if (transformed)
+	{
+		//the box is built around the origin so the transform turns it about its centre
+		Transform centre;
+		centre.SetTranslation(position[0], position[1], position[2]);
+
+		box = state.arena->New<Box>(Vector3(0.0, 0.0, 0.0), size[0], size[1], size[2]);
+		box->SetTransform(centre * toWorld);
+	}
+	else
+	{
+		box = state.arena->New<Box>(position, size[0], size[1], size[2]);
+	}
+
+	box->SetMaterial(material);
+	state.scene->AddObject(box);
+
+	return true;
+}
+
+static bool readMesh(SceneFileState& state)
+{
+	std::string file;
+	Material* material;
+	Transform toWorld;
+
+	if (!readString(state, file) || !readObjectOptions(state, material, toWorld, NULL))
+		return false;
+
+	TriMesh* mesh = state.arena->New<TriMesh>(state.arena);
+	mesh->SetMaterial(material);
+	state.scene->AddObject(mesh);
+	state.scene->GetAssetLoader()->LoadMesh(mesh, resolvePath(state, file));
+
+	return true;
+}
+
+static bool readInstance(SceneFileState& state)
+{
+	std::string file;
+	Material* material;
+	Transform toWorld;
+	bool transformed = false;
+
+	if (!readString(state, file) || !readObjectOptions(state, material, toWorld, &transformed))
+		return false;
+
+	TriMesh* mesh = state.scene->LoadMesh(resolvePath(state, file).c_str());
+	state.scene->AddObject(state.arena->New<MeshInstance>(mesh, toWorld, material));
+
+	return true;
+}
+
+int importSceneFile(const char* filename, Scene* scene)
+{
+	FILE* pfile;
+
+#if defined(WINDOWS) || defined(WIN32)
+	if (fopen_s(&pfile, filename, "r"))
+		pfile = NULL;
+#else
+	pfile = fopen(filename, "r");
+#endif
+
+	if (!pfile)
+	{
+		printf("Error opening scene file: %s\n", filename);
+		return 1;
+	}
+
+	SceneFileState state;
+	state.filename = filename;
+	state.line = 0;
+	state.defaultMaterial = NULL;
+	state.scene = scene;
+	state.arena = &scene->GetArena();
+
+	const char* slash = strrchr(filename, '/');
+	const char* backslash = strrchr(filename, '\\');
+	if (backslash > slash)
+		slash = backslash;
+	if (slash)
+		state.directory.assign(filename, slash + 1);
+
+	char buffer[4096];
+	bool ok = true;
+
+	//statements are acted on as they are read, there is no intermediate representation
+	while (ok && fgets(buffer, sizeof(buffer), pfile))
+	{
+		state.line++;
+		tokeniseLine(buffer, state.tokens);
+		state.next = 1;
+
+		if (state.tokens.empty())
+			continue;
+
+		const std::string& keyword = state.tokens[0];
+
+		if (keyword == "camera")			ok = readCamera(state);
+		else if (keyword == "background")	ok = readBackground(state);
+		else if (keyword == "environment")	ok = readEnvironment(state);
+		else if (keyword == "light")		ok = readLight(state);
+		else if (keyword == "material")		ok = readMaterial(state);
+		else if (keyword == "sphere")		ok = readSphere(state);
+		else if (keyword == "plane")		ok = readPlane(state);
+		else if (keyword == "box")			ok = readBox(state);
+		else if (keyword == "mesh")			ok = readMesh(state);
+		else if (keyword == "instance")		ok = readInstance(state);
+		else								ok = parseError(state, "unknown statement");
+	}
+
+	fclose(pfile);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+class Scene;
+
+//Read a scene description file into the scene, returns 0 on success.
+//Meshes are queued on the scene's AssetLoader and textures are deferred,
+//so assets may still be loading when this returns
+int importSceneFile(const char* filename, Scene* scene);
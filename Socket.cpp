@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <string.h>
+#include "Socket.h"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#define CloseSocket closesocket
+#else
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+#define CloseSocket close
+#endif
+
+//a closed connection must fail the send rather than raise SIGPIPE
+#if defined(MSG_NOSIGNAL)
+static const int s_sendFlags = MSG_NOSIGNAL;
+#else
+static const int s_sendFlags = 0;
+#endif
+
+static const char* s_unixPrefix = "unix:";
+
+static bool StartSockets()
+{
+#if defined(_WIN32)
+	static bool started = false;
+
+	if (!started)
+	{
+		WSADATA data;
+		started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}
+
+	return started;
+#else
+	return true;
+#endif
+}
+
+static bool IsUnixAddress(const char* address)
+{
+	return strncmp(address, s_unixPrefix, strlen(s_unixPrefix)) == 0;
+}
+
+//host and port of a TCP address, the host is empty for "port" and ":port"
+static void SplitAddress(const char* address, std::string& host, std::string& port)
+{
+	const char* colon = strrchr(address, ':');
+
+	host = colon ? std::string(address, colon - address) : "";
+	port = colon ? colon + 1 : address;
+}
+
+#if !defined(_WIN32)
+static bool MakeUnixAddress(const char* address, sockaddr_un& addr)
+{
+	const char* path = address + strlen(s_unixPrefix);
+
+	if (strlen(path) == 0 || strlen(path) >= sizeof(addr.sun_path))
+		return false;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	return true;
+}
+#endif
+
+//jobs and their replies are answered at once so nothing is held back, keepalive notices a
+//peer whose machine has gone away
+static void SetStreamOptions(intptr_t handle)
+{
+	int on = 1;
+	setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+	setsockopt(handle, SOL_SOCKET, SO_KEEPALIVE, (const char*)&on, sizeof(on));
+}
+
+//select on a single socket, the number of sockets ready, 0 on timeout or -1 on error
+static int SelectReadable(intptr_t handle, double timeout)
+{
+	fd_set readable;
+	FD_ZERO(&readable);
+	FD_SET(handle, &readable);
+
+	timeval wait;
+	wait.tv_sec = (long)timeout;
+	wait.tv_usec = (long)((timeout - (double)wait.tv_sec) * 1e6);
+
+	return select((int)handle + 1, &readable, NULL, NULL, &wait);
+}
+
+Socket::Socket()
+{
+	m_handle = -1;
+}
+
+Socket::~Socket()
+{
+	Close();
+}
+
+bool Socket::Listen(const char* address)
+{
+	Close();
+
+	if (!StartSockets())
+		return false;
+
+	if (IsUnixAddress(address))
+	{
+#if defined(_WIN32)
+		return false;
+#else
+		sockaddr_un addr;
+
+		if (!MakeUnixAddress(address, addr))
+			return false;
+
+		//a socket file left behind by an earlier run would fail the bind
+		unlink(addr.sun_path);
+
+		m_handle = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if (m_handle == -1)
+			return false;
+
+		if (bind(m_handle, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(m_handle, 16) != 0)
+		{
+			Close();
+			return false;
+		}
+
+		m_unixPath = addr.sun_path;
+		return true;
+#endif
+	}
+
+	std::string host, port;
+	SplitAddress(address, host, port);
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	addrinfo* result = NULL;
+
+	if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &result) != 0)
+		return false;
+
+	m_handle = (intptr_t)socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+
+	int on = 1;
+	bool ok = m_handle != -1 &&
+		setsockopt(m_handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on)) == 0 &&
+		bind(m_handle, result->ai_addr, (int)result->ai_addrlen) == 0 &&
+		listen(m_handle, 16) == 0;
+
+	freeaddrinfo(result);
+
+	if (!ok)
+		Close();
+
+	return ok;
+}
+
+Socket* Socket::Accept(double timeout)
+{
+	if (SelectReadable(m_handle, timeout) <= 0)
+		return NULL;
+
+	intptr_t handle = (intptr_t)accept(m_handle, NULL, NULL);
+
+	if (handle == -1)
+		return NULL;
+
+	if (m_unixPath.empty())
+		SetStreamOptions(handle);
+
+	Socket* connection = new Socket;
+	connection->m_handle = handle;
+	return connection;
+}
+
+bool Socket::Connect(const char* address)
+{
+	Close();
+
+	if (!StartSockets())
+		return false;
+
+	if (IsUnixAddress(address))
+	{
+#if defined(_WIN32)
+		return false;
+#else
+		sockaddr_un addr;
+
+		if (!MakeUnixAddress(address, addr))
+			return false;
+
+		m_handle = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if (m_handle == -1 || connect(m_handle, (sockaddr*)&addr, sizeof(addr)) != 0)
+		{
+			Close();
+			return false;
+		}
+
+		return true;
+#endif
+	}
+
+	std::string host, port;
+	SplitAddress(address, host, port);
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* result = NULL;
+
+	if (getaddrinfo(host.empty() ? "localhost" : host.c_str(), port.c_str(), &hints, &result) != 0)
+		return false;
+
+	for (addrinfo* info = result; info && m_handle == -1; info = info->ai_next)
+	{
+		m_handle = (intptr_t)socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+
+		if (m_handle != -1 && connect(m_handle, info->ai_addr, (int)info->ai_addrlen) != 0)
+			Close();
+	}
+
+	freeaddrinfo(result);
+
+	if (m_handle == -1)
+		return false;
+
+	SetStreamOptions(m_handle);
+	return true;
+}
+
+bool Socket::Send(const void* data, size_t size)
+{
+	const char* src = (const char*)data;
+
+	while (size > 0 && m_handle != -1)
+	{
+		int chunk = size > (1 << 30) ? (1 << 30) : (int)size;
+		int sent = (int)send(m_handle, src, chunk, s_sendFlags);
+
+#if !defined(_WIN32)
+		if (sent < 0 && errno == EINTR)
+			continue;
+#endif
+		if (sent <= 0)
+			return false;
+
+		src += sent;
+		size -= sent;
+	}
+
+	return m_handle != -1;
+}
+
+bool Socket::Receive(void* data, size_t size, double timeout)
+{
+	char* dst = (char*)data;
+
+	while (size > 0 && m_handle != -1)
+	{
+		if (timeout > 0.0 && !WaitForData(timeout))
+			return false;
+
+		int chunk = size > (1 << 30) ? (1 << 30) : (int)size;
+		int received = (int)recv(m_handle, dst, chunk, 0);
+
+#if !defined(_WIN32)
+		if (received < 0 && errno == EINTR)
+			continue;
+#endif
+		if (received <= 0)
+			return false;
+
+		dst += received;
+		size -= received;
+	}
+
+	return m_handle != -1;
+}
+
+bool Socket::WaitForData(double timeout)
+{
+	//an error is left for the next Receive to report
+	return m_handle == -1 || SelectReadable(m_handle, timeout) != 0;
+}
+
+void Socket::Close()
+{
+	if (m_handle != -1)
+		CloseSocket(m_handle);
+
+	m_handle = -1;
+
+	if (!m_unixPath.empty())
+		remove(m_unixPath.c_str());
+
+	m_unixPath.clear();
+}
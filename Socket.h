@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+//A blocking stream socket, TCP or a Unix domain socket. Addresses are "host:port",
+//":port" or "port" to listen on every interface, or "unix:path" for a socket file,
+//which is handy for worker processes on the same machine
+class Socket
+{
+	private:
+		intptr_t	m_handle;					//-1 when closed
+		std::string	m_unixPath;					//socket file of a listening Unix socket, removed by Close
+
+		Socket(const Socket&);
+		Socket& operator=(const Socket&);
+
+	public:
+		Socket();
+		~Socket();
+
+		bool Listen(const char* address);
+
+		//The next connection to a listening socket, NULL if none comes within timeout seconds
+		Socket* Accept(double timeout);
+
+		bool Connect(const char* address);
+
+		//Send or receive exactly size bytes, false once the connection is closed or broken. With
+		//a timeout Receive also fails once nothing has arrived for that many seconds
+		bool Send(const void* data, size_t size);
+		bool Receive(void* data, size_t size, double timeout = 0.0);
+
+		//Wait up to timeout seconds for something to read, true as well if the connection closed
+		bool WaitForData(double timeout);
+
+		void Close();
+
+		inline bool IsOpen() const
+		{
+			return m_handle != -1;
+		}
+};
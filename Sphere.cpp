@@ -0,0 +1,63 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <math.h>
+#include "Sphere.h"
+
+
+Sphere::Sphere()
+{
+	//a default sphere is a unit sphere at the origin
+	m_centre.SetVector(0.0, 0.0, 0.0);
+	m_radius = 1.0;
+	m_primtype = PRIMTYPE_Sphere;
+}
+
+Sphere::Sphere(double x, double y, double z, double r)
+{
+	m_centre.SetVector(x, y, z);
+	m_radius = r;
+	m_primtype = PRIMTYPE_Sphere;
+}
+
+Sphere::~Sphere()
+{
+}
+
+RayHitResult Sphere::IntersectByRay(Ray& ray)
+{
+	RayHitResult result = Ray::s_defaultHitResult;
+
+	Vector3 oc = ray.GetRayStart() - m_centre;
+	Vector3 r = ray.GetRay();
+
+	double a = r.DotProduct(r);
+	double b = oc.DotProduct(r);
+	double c = oc.DotProduct(oc) - m_radius*m_radius;
+	double disc = b*b - a*c;
+
+	if (disc < 0.0)
+		return result;
+
+	disc = sqrt(disc);
+
+	//take the nearest root in front of the ray, which is the far root when the ray starts inside
+	double t = (-b - disc) / a;
+	if (t <= 0.0)
+		t = (-b + disc) / a;
+	if (t <= 0.0)
+		return result;
+
+	result.t = t;
+	result.point = ray.GetRayStart() + r*t;
+	result.normal = (result.point - m_centre) * (1.0 / m_radius);
+	result.data = this;
+
+	return result;
+}
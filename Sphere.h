@@ -33,6 +33,16 @@ class Sphere : public Primitive
 			return m_radius;
 		}
 
+		inline void			SetCentre(const Vector3& centre)
+		{
+			m_centre = centre;
+		}
+
+		inline void			SetRadius(double r)
+		{
+			m_radius = r;
+		}
+
 		RayHitResult		IntersectByRay(Ray& ray);
 };
 
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <string.h>
+#include "TextureCache.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char s_magic[4] = { 'T', 'R', 'T', 'X' };
+static const int s_version = 1;
+static const size_t s_defaultBudget = 256 * 1024 * 1024;
+
+//Pages a thread used last, direct mapped by key. The shared pointers keep
+//pages alive after the shared cache has evicted them, so reading a page
+//found here needs no lock. Hits are counted here and added to the shared
+//counters every so often
+struct LocalPages
+{
+	unsigned long long						keys[TextureCache::LOCAL_ENTRIES];
+	std::shared_ptr<TextureCache::Page>		pages[TextureCache::LOCAL_ENTRIES];
+	unsigned long long						hits;
+
+	LocalPages()
+	{
+		for (int i = 0; i < TextureCache::LOCAL_ENTRIES; i++)
+		{
+			keys[i] = ~0ull;
+		}
+
+		hits = 0;
+	}
+};
+
+static thread_local LocalPages s_localPages;
+
+static const unsigned long long s_flushHits = 4096;
+
+static inline unsigned long long PageKey(int file, int level, int page)
+{
+	return ((unsigned long long)file << 48) | ((unsigned long long)level << 40) | (unsigned long long)page;
+}
+
+TextureCache& TextureCache::GetInstance()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+TextureCache::TextureCache()
+{
+	m_budgetPages = s_defaultBudget / PAGE_BYTES;
+	m_localHits = 0;
+	m_sharedHits = 0;
+	m_misses = 0;
+	m_evictions = 0;
+}
+
+TextureCache::~TextureCache()
+{
+	for (size_t i = 0; i < m_files.size(); i++)
+	{
+#if defined(_WIN32)
+		if (m_files[i].handle != INVALID_HANDLE_VALUE)
+			CloseHandle(m_files[i].handle);
+#else
+		if (m_files[i].handle >= 0)
+			close(m_files[i].handle);
+#endif
+	}
+}
+
+int TextureCache::OpenFile(const char* filename, std::vector<LevelInfo>& levels)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	//textures shared between materials share their pages
+	for (size_t i = 0; i < m_files.size(); i++)
+	{
+		if (m_files[i].name == filename)
+		{
+			levels = m_files[i].levels;
+			return (int)i;
+		}
+	}
+
+	FILE* file = fopen(filename, "rb");
+
+	if (!file)
+		return -1;
+
+	char magic[4];
+	int header[4];
+	bool valid = fread(magic, 1, 4, file) == 4 && memcmp(magic, s_magic, 4) == 0 &&
+		fread(header, sizeof(int), 4, file) == 4 && header[0] == s_version &&
+		header[3] > 0 && header[3] <= 32;
+
+	std::vector<LevelInfo> filelevels;
+
+	for (int i = 0; valid && i < header[3]; i++)
+	{
+		int dims[4];
+		long long offset;
+
+		valid = fread(dims, sizeof(int), 4, file) == 4 && fread(&offset, sizeof(long long), 1, file) == 1 &&
+			dims[0] > 0 && dims[1] > 0 &&
+			dims[2] == (dims[0] + PAGE_SIZE - 1) / PAGE_SIZE && dims[3] == (dims[1] + PAGE_SIZE - 1) / PAGE_SIZE;
+
+		LevelInfo level = { dims[0], dims[1], dims[2], dims[3], offset };
+		filelevels.push_back(level);
+	}
+
+	fclose(file);
+
+	if (!valid)
+		return -1;
+
+	File entry;
+	entry.name = filename;
+	entry.levels = filelevels;
+
+#if defined(_WIN32)
+	entry.handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (entry.handle == INVALID_HANDLE_VALUE)
+		return -1;
+#else
+	entry.handle = open(filename, O_RDONLY);
+	if (entry.handle < 0)
+		return -1;
+#endif
+
+	//file ids are never reused, so stale keys left in the per thread tables can't match a different file
+	m_files.push_back(entry);
+	levels = filelevels;
+
+	return (int)m_files.size() - 1;
+}
+
+bool TextureCache::WriteFile(const char* filename, const std::vector<LevelInfo>& levels,
+							const std::vector<const unsigned int*>& images)
+{
+	int numlevels = (int)levels.size();
+
+	if (numlevels == 0 || numlevels > 32)
+		return false;
+
+	FILE* file = fopen(filename, "wb");
+
+	if (!file)
+		return false;
+
+	//pages start on a page boundary after the header
+	long long offset = 4 + 4*sizeof(int) + numlevels*(4*sizeof(int) + sizeof(long long));
+	offset = (offset + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES;
+	long long datastart = offset;
+
+	int header[4] = { s_version, levels[0].width, levels[0].height, numlevels };
+	bool ok = fwrite(s_magic, 1, 4, file) == 4 && fwrite(header, sizeof(int), 4, file) == 4;
+
+	for (int i = 0; ok && i < numlevels; i++)
+	{
+		int pagesx = (levels[i].width + PAGE_SIZE - 1) / PAGE_SIZE;
+		int pagesy = (levels[i].height + PAGE_SIZE - 1) / PAGE_SIZE;
+		int dims[4] = { levels[i].width, levels[i].height, pagesx, pagesy };
+
+		ok = fwrite(dims, sizeof(int), 4, file) == 4 && fwrite(&offset, sizeof(long long), 1, file) == 1;
+		offset += (long long)pagesx*pagesy*PAGE_BYTES;
+	}
+
+	//zero pad up to the first page
+	std::vector<char> padding((size_t)datastart - (size_t)ftell(file), 0);
+	ok = ok && (padding.empty() || fwrite(&padding[0], 1, padding.size(), file) == padding.size());
+
+	Page page;
+
+	for (int i = 0; ok && i < numlevels; i++)
+	{
+		int width = levels[i].width;
+		int height = levels[i].height;
+		int pagesx = (width + PAGE_SIZE - 1) / PAGE_SIZE;
+		int pagesy = (height + PAGE_SIZE - 1) / PAGE_SIZE;
+
+		for (int py = 0; ok && py < pagesy; py++)
+		{
+			for (int px = 0; ok && px < pagesx; px++)
+			{
+				//texels past the edge of the level are never fetched and are left black
+				memset(page.texels, 0, sizeof(page.texels));
+
+				for (int y = 0; y < PAGE_SIZE && py*PAGE_SIZE + y < height; y++)
+				{
+					for (int x = 0; x < PAGE_SIZE && px*PAGE_SIZE + x < width; x++)
+					{
+						int block = (y / BLOCK_SIZE) * (PAGE_SIZE / BLOCK_SIZE) + (x / BLOCK_SIZE);
+						page.texels[block*BLOCK_SIZE*BLOCK_SIZE + (y % BLOCK_SIZE)*BLOCK_SIZE + (x % BLOCK_SIZE)] =
+							images[i][(py*PAGE_SIZE + y)*width + px*PAGE_SIZE + x];
+					}
+				}
+
+				ok = fwrite(page.texels, PAGE_BYTES, 1, file) == 1;
+			}
+		}
+	}
+
+	fclose(file);
+
+	return ok;
+}
+
+const TextureCache::Page* TextureCache::GetPage(int file, int level, int page)
+{
+	unsigned long long key = PageKey(file, level, page);
+	LocalPages& local = s_localPages;
+	int slot = (int)((unsigned int)(page + level*7919 + file*104729) & (LOCAL_ENTRIES - 1));
+
+	if (local.keys[slot] == key)
+	{
+		if (++local.hits == s_flushHits)
+		{
+			m_localHits += local.hits;
+			local.hits = 0;
+		}
+
+		return local.pages[slot].get();
+	}
+
+	m_localHits += local.hits;
+	local.hits = 0;
+
+	const Page* result = LoadPage(key, file, level, page, local.pages[slot]);
+	local.keys[slot] = key;
+
+	return result;
+}
+
+const TextureCache::Page* TextureCache::LoadPage(unsigned long long key, int file, int level, int page, std::shared_ptr<Page>& owner)
+{
+	File source;
+	long long offset;
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		std::unordered_map<unsigned long long, Entry>::iterator found = m_pages.find(key);
+
+		if (found != m_pages.end())
+		{
+			m_lru.splice(m_lru.begin(), m_lru, found->second.lru);
+			owner = found->second.page;
+			m_sharedHits++;
+			return owner.get();
+		}
+
+		//m_files may grow while the page is read, so take what's needed under the lock
+		source.handle = m_files[file].handle;
+		offset = m_files[file].levels[level].offset + (long long)page*PAGE_BYTES;
+	}
+
+	//read without holding the lock so other threads carry on sampling
+	std::shared_ptr<Page> loaded = std::make_shared<Page>();
+
+	if (!ReadPage(source, offset, loaded.get()))
+	{
+		//a truncated or unreadable file samples as black rather than failing the render
+		memset(loaded->texels, 0, sizeof(loaded->texels));
+	}
+
+	m_misses++;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	std::unordered_map<unsigned long long, Entry>::iterator found = m_pages.find(key);
+
+	if (found != m_pages.end())
+	{
+		//another thread read the same page meanwhile, use its copy
+		m_lru.splice(m_lru.begin(), m_lru, found->second.lru);
+		owner = found->second.page;
+		return owner.get();
+	}
+
+	m_lru.push_front(key);
+
+	Entry& entry = m_pages[key];
+	entry.page = loaded;
+	entry.lru = m_lru.begin();
+
+	Evict();
+
+	owner = loaded;
+	return owner.get();
+}
+
+bool TextureCache::ReadPage(const File& file, long long offset, Page* page)
+{
+#if defined(_WIN32)
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.Offset = (DWORD)(offset & 0xffffffff);
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+	DWORD bytesread = 0;
+	return ReadFile(file.handle, page->texels, PAGE_BYTES, &bytesread, &overlapped) && bytesread == PAGE_BYTES;
+#else
+	return pread(file.handle, page->texels, PAGE_BYTES, (off_t)offset) == PAGE_BYTES;
+#endif
+}
+
+void TextureCache::Evict()
+{
+	//called with m_mutex held
+	while (m_pages.size() > m_budgetPages && !m_lru.empty())
+	{
+		m_pages.erase(m_lru.back());
+		m_lru.pop_back();
+		m_evictions++;
+	}
+}
+
+void TextureCache::SetBudget(size_t bytes)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	m_budgetPages = bytes / PAGE_BYTES > 0 ? bytes / PAGE_BYTES : 1;
+	Evict();
+}
+
+void TextureCache::GetStats(Stats& stats)
+{
+	//hits other threads haven't flushed yet are not counted
+	LocalPages& local = s_localPages;
+	m_localHits += local.hits;
+	local.hits = 0;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	stats.localHits = m_localHits;
+	stats.sharedHits = m_sharedHits;
+	stats.misses = m_misses;
+	stats.evictions = m_evictions;
+	stats.residentBytes = m_pages.size() * PAGE_BYTES;
+}
+
+void TextureCache::PrintStats()
+{
+	Stats stats;
+	GetStats(stats);
+
+	unsigned long long lookups = stats.localHits + stats.sharedHits + stats.misses;
+	double hitrate = lookups > 0 ? 100.0 * (double)(stats.localHits + stats.sharedHits) / (double)lookups : 0.0;
+
+	printf("Texture cache: %llu lookups, %llu thread hits, %llu shared hits, %llu misses (%.2f%% hit rate), %llu evictions, %.1f MB resident\n",
+		lookups, stats.localHits, stats.sharedHits, stats.misses, hitrate, stats.evictions,
+		(double)stats.residentBytes / (1024.0 * 1024.0));
+}
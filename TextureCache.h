@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <list>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+//A process wide cache of texture pages read on demand from tiled texture files.
+//
+//A tiled texture file (.trtx) holds every mip level of a texture as 32x32 texel
+//pages of RGBA8, each page laid out as 4x4 blocks of 8x8 texels like the in-memory
+//textures. Pages are 4KiB and 4KiB aligned in the file:
+//
+//	char	magic[4]			"TRTX"
+//	int		version, width, height, numLevels
+//	numLevels x { int width, height, pagesX, pagesY; long long offset }
+//	pages, level by level, row by row
+//
+//The cache keeps at most a budget's worth of pages and evicts the least recently
+//used ones. Each thread keeps a small direct mapped table of the pages it used
+//last, so hits in it take no lock
+class TextureCache
+{
+	public:
+		enum
+		{
+			PAGE_SIZE = 32,						//page width and height in texels
+			PAGE_TEXELS = PAGE_SIZE*PAGE_SIZE,
+			PAGE_BYTES = PAGE_TEXELS*4,
+			BLOCK_SIZE = 8,
+			LOCAL_ENTRIES = 256					//pages remembered by each thread
+		};
+
+		struct LevelInfo
+		{
+			int			width;
+			int			height;
+			int			pagesX;
+			int			pagesY;
+			long long	offset;					//file offset of the level's first page
+		};
+
+		struct Page
+		{
+			unsigned int	texels[PAGE_TEXELS];
+		};
+
+		struct Stats
+		{
+			unsigned long long	localHits;		//found in the thread's own table
+			unsigned long long	sharedHits;		//found in the shared cache
+			unsigned long long	misses;			//read from disk
+			unsigned long long	evictions;
+			size_t				residentBytes;
+		};
+
+		static TextureCache& GetInstance();
+
+		//Open a tiled texture file, returns an id for GetPage or -1 if the file can't be read
+		int		OpenFile(const char* filename, std::vector<LevelInfo>& levels);
+
+		//Write a tiled texture file from mip levels given as rows of RGBA8 texels, bottom row first
+		static bool WriteFile(const char* filename, const std::vector<LevelInfo>& levels,
+							const std::vector<const unsigned int*>& images);
+
+		const Page*	GetPage(int file, int level, int page);
+
+		inline unsigned int FetchTexel(int file, int level, const LevelInfo& info, int x, int y)
+		{
+			const Page* page = GetPage(file, level, (y / PAGE_SIZE) * info.pagesX + (x / PAGE_SIZE));
+
+			int px = x % PAGE_SIZE;
+			int py = y % PAGE_SIZE;
+			int block = (py / BLOCK_SIZE) * (PAGE_SIZE / BLOCK_SIZE) + (px / BLOCK_SIZE);
+
+			return page->texels[block*BLOCK_SIZE*BLOCK_SIZE + (py % BLOCK_SIZE)*BLOCK_SIZE + (px % BLOCK_SIZE)];
+		}
+
+		void	SetBudget(size_t bytes);
+		void	GetStats(Stats& stats);
+		void	PrintStats();
+
+	private:
+		struct File
+		{
+			std::string				name;
+			std::vector<LevelInfo>	levels;
+#if defined(_WIN32)
+			void*					handle;
+#else
+			int						handle;
+#endif
+		};
+
+		struct Entry
+		{
+			std::shared_ptr<Page>					page;
+			std::list<unsigned long long>::iterator	lru;
+		};
+
+		std::mutex										m_mutex;
+		std::vector<File>								m_files;
+		std::unordered_map<unsigned long long, Entry>	m_pages;
+		std::list<unsigned long long>					m_lru;			//most recently used first
+		size_t											m_budgetPages;
+
+		std::atomic<unsigned long long>					m_localHits;
+		std::atomic<unsigned long long>					m_sharedHits;
+		std::atomic<unsigned long long>					m_misses;
+		std::atomic<unsigned long long>					m_evictions;
+
+		TextureCache();
+		~TextureCache();
+
+		const Page*	LoadPage(unsigned long long key, int file, int level, int page, std::shared_ptr<Page>& owner);
+		bool		ReadPage(const File& file, long long offset, Page* page);
+		void		Evict();
+};
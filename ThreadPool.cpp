@@ -0,0 +1,88 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int numThreads)
+{
+	m_activeJobs = 0;
+	m_stop = false;
+
+	if (numThreads <= 0)
+		numThreads = (int)std::thread::hardware_concurrency();
+
+	if (numThreads <= 0)
+		numThreads = 1;
+
+	for (int i = 0; i < numThreads; i++)
+	{
+		m_threads.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_jobAvailable.notify_all();
+
+	for (size_t i = 0; i < m_threads.size(); i++)
+	{
+		m_threads[i].join();
+	}
+}
+
+void ThreadPool::Submit(const std::function<void()>& job)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_jobs.push_back(job);
+		m_activeJobs++;
+	}
+
+	m_jobAvailable.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (m_activeJobs > 0)
+	{
+		m_jobsDone.wait(lock);
+	}
+}
+
+void ThreadPool::WorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			while (!m_stop && m_jobs.empty())
+			{
+				m_jobAvailable.wait(lock);
+			}
+
+			//queued jobs are still run when the pool is being destroyed
+			if (m_jobs.empty())
+				return;
+
+			job = m_jobs.front();
+			m_jobs.pop_front();
+		}
+
+		job();
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_activeJobs--;
+
+			if (m_activeJobs == 0)
+				m_jobsDone.notify_all();
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+//A fixed set of worker threads that stays alive for the lifetime of the pool.
+//Jobs are run in the order they are submitted, Wait blocks until every
+//submitted job has finished
+class ThreadPool
+{
+	private:
+		std::vector<std::thread>			m_threads;
+		std::deque<std::function<void()> >	m_jobs;
+		std::mutex							m_mutex;
+		std::condition_variable				m_jobAvailable;
+		std::condition_variable				m_jobsDone;
+		int									m_activeJobs;		//jobs queued or running
+		bool								m_stop;
+
+		void	WorkerLoop();
+
+	public:
+		//numThreads of 0 uses one thread per hardware thread
+		ThreadPool(int numThreads = 0);
+		~ThreadPool();
+
+		void	Submit(const std::function<void()>& job);
+		void	Wait();
+
+		inline int GetNumThreads() const
+		{
+			return (int)m_threads.size();
+		}
+};
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "TileServer.h"
+#include "PathTracer.h"
+#include "RenderControl.h"
+#include "Profiler.h"
+
+static const char s_magic[4] = { 'T', 'R', 'T', 'S' };
+static const int s_version = 3;
+
+//a band is given up once it has taken s_bandTimeout seconds more than the slowest band so
+//far would take for its rows s_bandTimeoutFactor times over. A reply stalled for
+//s_bandTimeout seconds midway is given up too
+static const double s_bandTimeout = 60.0;
+static const double s_bandTimeoutFactor = 4.0;
+
+TileServer::TileServer(Renderer* renderer, int rowsPerTile)
+{
+	m_renderer = renderer;
+	m_rowsPerTile = rowsPerTile > 0 ? rowsPerTile : 1;
+	m_bandsLeft = 0;
+	m_numFrames = 0;
+	m_numWorkers = 0;
+	m_secondsPerRow = 0.0;
+	m_stop = false;
+
+	memset(&m_job, 0, sizeof(m_job));
+	memset(&m_settings, 0, sizeof(m_settings));
+}
+
+TileServer::~TileServer()
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_changed.notify_all();
+
+	if (m_acceptThread.joinable())
+		m_acceptThread.join();
+
+	//no more threads are added once the accept loop is done
+	for (size_t i = 0; i < m_workerThreads.size(); i++)
+	{
+		m_workerThreads[i].join();
+	}
+
+	m_listener.Close();
+}
+
+void TileServer::GetSettings(Renderer* renderer, Scene* pScene, TileSettings& settings)
+{
+	//zeroed so the padding compares equal too
+	memset(&settings, 0, sizeof(settings));
+	memcpy(settings.magic, s_magic, sizeof(s_magic));
+
+	settings.version = s_version;
+	settings.width = renderer->m_buffWidth;
+	settings.height = renderer->m_buffHeight;
+	settings.pathtrace = dynamic_cast<PathTracer*>(renderer) != NULL;
+	settings.samples = renderer->m_samplesPerPixel;
+	settings.maxSamples = renderer->m_control ? renderer->m_control->GetMaxSamples() : 0;
+	settings.firstSample = renderer->m_firstSample;
+	settings.numSamples = renderer->m_numSamples;
+	settings.lightSamples = renderer->m_lightSamples;
+	settings.traceLevel = renderer->m_traceLevel;
+	settings.traceflags = (int)renderer->m_traceflag;
+	settings.seed = renderer->m_sampleSeed;
+	settings.aovflags = (int)renderer->m_aovFlags;
+	settings.numLayers = renderer->GetFramebuffer()->GetNumLayers();
+	settings.heatmap = (int)renderer->m_heatmap;
+	settings.heatmapScale = renderer->m_heatmapScale;
+	settings.sceneHash = pScene->GetContentHash();
+}
+
+bool TileServer::Listen(const char* address, Scene* pScene)
+{
+	GetSettings(m_renderer, pScene, m_settings);
+
+	if (!m_listener.Listen(address))
+		return false;
+
+	m_acceptThread = std::thread(&TileServer::AcceptLoop, this);
+
+	fprintf(stdout, "Waiting for workers on %s\n", address);
+	return true;
+}
+
+void TileServer::AcceptLoop()
+{
+	int id = 0;
+
+	while (true)
+	{
+		//wake up now and then to see whether the server is being shut down
+		Socket* connection = m_listener.Accept(0.25);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if (m_stop)
+		{
+			delete connection;
+			break;
+		}
+
+		if (connection)
+			m_workerThreads.push_back(std::thread(&TileServer::ServeWorker, this, connection, ++id));
+	}
+}
+
+void TileServer::ServeWorker(Socket* connection, int id)
+{
+	TileSettings settings;
+	int accepted = 0;
+
+	if (connection->Receive(&settings, sizeof(settings)))
+	{
+		accepted = memcmp(&settings, &m_settings, sizeof(settings)) == 0;
+
+		if (!accepted && settings.sceneHash != m_settings.sceneHash)
+			fprintf(stdout, "\nWorker %d has another scene loaded, turned away\n", id);
+		else if (!accepted)
+			fprintf(stdout, "\nWorker %d renders with other settings, turned away\n", id);
+
+		connection->Send(&accepted, sizeof(accepted));
+	}
+
+	if (!accepted)
+	{
+		delete connection;
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_numWorkers++;
+	fprintf(stdout, "\nWorker %d joined, %d working\n", id, m_numWorkers);
+
+	std::vector<Colour> rows;
+
+	while (true)
+	{
+		m_changed.wait(lock, [this]() { return m_stop || !m_bands.empty(); });
+
+		if (m_stop)
+			break;
+
+		Band band = m_bands.front();
+		m_bands.pop_front();
+
+		TileJob job = m_job;
+		job.firstRow = band.firstRow;
+		job.numRows = band.numRows;
+
+		lock.unlock();
+
+		std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+		bool ok = connection->Send(&job, sizeof(job)) && ReceiveBand(connection, job, rows);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - sent).count();
+
+		if (ok)
+		{
+			//bands never overlap, so the workers write their rows side by side
+			Framebuffer* framebuffer = m_renderer->GetFramebuffer();
+			int width = m_renderer->m_buffWidth;
+			const Colour* src = &rows[0];
+
+			for (int layer = 0; layer < m_settings.numLayers; layer++)
+			{
+				for (int y = band.firstRow; y < band.firstRow + band.numRows; y++)
+				{
+					for (int x = 0; x < width; x++)
+					{
+						framebuffer->WriteLayer(layer, *src++, x, y);
+					}
+				}
+			}
+		}
+
+		lock.lock();
+
+		if (!ok)
+		{
+			//another worker picks the band up, or the next one to join
+			m_bands.push_front(band);
+			m_numWorkers--;
+			m_changed.notify_all();
+
+			fprintf(stdout, "\nWorker %d failed, rows %d to %d are handed out again, %d working\n",
+				id, band.firstRow, band.firstRow + band.numRows - 1, m_numWorkers);
+
+			lock.unlock();
+			delete connection;
+			return;
+		}
+
+		m_secondsPerRow = std::max(m_secondsPerRow, seconds / band.numRows);
+		m_bandsLeft--;
+		m_changed.notify_all();
+	}
+
+	m_numWorkers--;
+	lock.unlock();
+
+	//a job without rows tells the worker to finish
+	TileJob done;
+	memset(&done, 0, sizeof(done));
+	connection->Send(&done, sizeof(done));
+
+	delete connection;
+}
+
+double TileServer::GetBandTimeout(int numRows)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	//until a band has come back there is nothing to tell a slow worker from a lost one
+	return m_secondsPerRow > 0.0 ? s_bandTimeout + s_bandTimeoutFactor * m_secondsPerRow * numRows : 0.0;
+}
+
+bool TileServer::ReceiveBand(Socket* connection, const TileJob& job, std::vector<Colour>& rows)
+{
+	std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+
+	//a worker that hangs, or a machine gone from the network, never closes the connection.
+	//The deadline is looked at again every second as other bands come back
+	while (!connection->WaitForData(1.0))
+	{
+		double timeout = GetBandTimeout(job.numRows);
+		double waited = std::chrono::duration<double>(std::chrono::steady_clock::now() - sent).count();
+
+		if (timeout > 0.0 && waited > timeout)
+		{
+			fprintf(stdout, "\nNo reply for rows %d to %d after %.0fs\n", job.firstRow, job.firstRow + job.numRows - 1, waited);
+			return false;
+		}
+	}
+
+	TileResult result;
+
+	if (!connection->Receive(&result, sizeof(result), s_bandTimeout) ||
+		result.frame != job.frame || result.firstRow != job.firstRow || result.numRows != job.numRows)
+		return false;
+
+	rows.resize((size_t)m_settings.numLayers * job.numRows * m_renderer->m_buffWidth);
+
+	return connection->Receive(&rows[0], rows.size() * sizeof(Colour), s_bandTimeout);
+}
+
+void TileServer::RenderFrame(Scene* pScene)
+{
+	PROFILE_SCOPE("RenderFrame");
+
+	Camera* cam = pScene->GetSceneCamera();
+	Vector3* vectors[5] = { &cam->GetPosition(), &cam->GetUpVector(), &cam->GetRightVector(), &cam->GetViewVector(), &cam->GetViewCentre() };
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	m_job.frame = m_numFrames++;
+
+	for (int v = 0; v < 5; v++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			m_job.camera[v*3 + c] = (*vectors[v])[c];
+		}
+	}
+
+	m_job.sceneWidth = pScene->GetSceneWidth();
+	m_job.sceneHeight = pScene->GetSceneHeight();
+
+	int height = m_renderer->m_buffHeight;
+
+	for (int first = 0; first < height; first += m_rowsPerTile)
+	{
+		Band band = { first, std::min(m_rowsPerTile, height - first) };
+		m_bands.push_back(band);
+	}
+
+	int numBands = (int)m_bands.size();
+	m_bandsLeft = numBands;
+	m_changed.notify_all();
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	while (m_bandsLeft > 0)
+	{
+		fprintf(stdout, "\rRendering on %d workers %5.2f%% (%.2fs Time taken)", m_numWorkers, 100.0 * (numBands - m_bandsLeft) / numBands,
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+
+		m_changed.wait(lock);
+	}
+
+	fprintf(stdout, "\rRendering on %d workers 100.00%% (%.2fs Time taken)\n", m_numWorkers,
+		std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+
+	lock.unlock();
+
+	m_renderer->FinishFrame();
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Renderer.h"
+#include "Scene.h"
+#include "Socket.h"
+
+//Sent by a worker as it connects, the coordinator only hands bands to workers rendering
+//exactly as it would. Both ends are meant to be the same build on machines of the same
+//byte order, the messages go over the wire as they are laid out here
+struct TileSettings
+{
+	char	magic[4];
+	int		version;
+	int		width;
+	int		height;
+	int		pathtrace;
+	int		samples;							//samples per pixel asked for, 0 for the renderer's default
+	int		maxSamples;							//cap of the render control, 0 for none
+	int		firstSample;						//sample range, see Renderer::SetSampleRange
+	int		numSamples;
+	int		lightSamples;
+	int		traceLevel;
+	int		traceflags;
+	int		seed;
+	int		aovflags;
+	int		numLayers;
+	int		heatmap;
+	float	heatmapScale;
+	unsigned int	sceneHash;					//Scene::GetContentHash of the scene as loaded
+};
+
+//A band of rows of a frame to trace, with the frame's camera
+struct TileJob
+{
+	int		frame;								//frames are numbered in the order the coordinator renders them
+	int		firstRow;
+	int		numRows;							//0 when the coordinator has nothing more
+	float	camera[15];							//position, up, right and view vectors and view centre
+	double	sceneWidth;
+	double	sceneHeight;
+};
+
+//Sent back by a worker, followed by the rows of every framebuffer layer in turn as Colour
+struct TileResult
+{
+	int		frame;
+	int		firstRow;
+	int		numRows;
+};
+
+//Coordinator of frames traced by worker processes, on this or other machines, that connect
+//to it at any time. Each frame is cut into bands of rows that are handed to the workers as
+//they ask for them. A band whose worker fails, disconnects or stops answering goes to the
+//next worker free.
+//Pixels are seeded by their position alone, so a frame put together from bands is the same
+//as one traced in a single process
+class TileServer
+{
+	private:
+		struct Band
+		{
+			int	firstRow;
+			int	numRows;
+		};
+
+		Renderer*					m_renderer;			//frames are put together and denoised in its framebuffer
+		int							m_rowsPerTile;
+		TileSettings				m_settings;
+		Socket						m_listener;
+		std::thread					m_acceptThread;
+		std::vector<std::thread>	m_workerThreads;
+		std::mutex					m_mutex;
+		std::condition_variable		m_changed;
+		std::deque<Band>			m_bands;			//bands of the frame waiting for a worker
+		int							m_bandsLeft;		//bands of the frame not yet back
+		TileJob						m_job;				//the frame being rendered, the rows are filled in per band
+		int							m_numFrames;
+		int							m_numWorkers;
+		double						m_secondsPerRow;	//slowest a band has come back so far, 0 before any has
+		bool						m_stop;
+
+		void	AcceptLoop();
+		void	ServeWorker(Socket* connection, int id);
+		bool	ReceiveBand(Socket* connection, const TileJob& job, std::vector<Colour>& rows);
+		double	GetBandTimeout(int numRows);
+
+	public:
+		TileServer(Renderer* renderer, int rowsPerTile = 16);
+		~TileServer();
+
+		//Start taking workers, see Socket for the address. The renderer and scene must be set up
+		//by now, workers are checked against the renderer's settings and the scene's contents
+		bool	Listen(const char* address, Scene* pScene);
+
+		//Render a frame of the scene's camera into the renderer's framebuffer, waiting for
+		//workers to join while there are none
+		void	RenderFrame(Scene* pScene);
+
+		//The settings a worker sends for a renderer and the scene it has loaded
+		static void GetSettings(Renderer* renderer, Scene* pScene, TileSettings& settings);
+};
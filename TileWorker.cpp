@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include "TileWorker.h"
+#include "TileServer.h"
+#include "Socket.h"
+
+bool TileWorker::Run(const char* address, Scene* pScene, Renderer* renderer, double timeout)
+{
+	Socket connection;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	//workers may well be started before the coordinator is listening
+	while (!connection.Connect(address))
+	{
+		if (std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() >= timeout)
+		{
+			fprintf(stdout, "Could not connect to the coordinator at %s\n", address);
+			return false;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	}
+
+	TileSettings settings;
+	TileServer::GetSettings(renderer, pScene, settings);
+
+	int accepted = 0;
+
+	if (!connection.Send(&settings, sizeof(settings)) || !connection.Receive(&accepted, sizeof(accepted)) || !accepted)
+	{
+		fprintf(stdout, "The coordinator at %s renders with other settings or another scene\n", address);
+		return false;
+	}
+
+	fprintf(stdout, "Connected to the coordinator at %s\n", address);
+
+	Framebuffer* framebuffer = renderer->GetFramebuffer();
+	Camera* cam = pScene->GetSceneCamera();
+	Vector3* vectors[5] = { &cam->GetPosition(), &cam->GetUpVector(), &cam->GetRightVector(), &cam->GetViewVector(), &cam->GetViewCentre() };
+
+	int width = renderer->m_buffWidth;
+	int height = renderer->m_buffHeight;
+	int frame = -1;
+
+	std::vector<Colour> rows;
+	TileJob job;
+
+	while (connection.Receive(&job, sizeof(job)))
+	{
+		if (job.numRows <= 0)
+			return true;
+
+		if (job.firstRow < 0 || job.firstRow + job.numRows > height)
+			break;
+
+		//the camera is copied as it is rather than rebuilt from a look at point, which could round differently
+		if (job.frame != frame)
+		{
+			for (int v = 0; v < 5; v++)
+			{
+				*vectors[v] = Vector3(job.camera[v*3], job.camera[v*3 + 1], job.camera[v*3 + 2]);
+			}
+
+			pScene->SetSceneWidth(job.sceneWidth);
+			pScene->SetSceneHeight(job.sceneHeight);
+			pScene->UpdateAccelerationStructure();
+			frame = job.frame;
+		}
+
+		renderer->RenderRows(pScene, job.firstRow, job.numRows);
+
+		rows.resize((size_t)framebuffer->GetNumLayers() * job.numRows * width);
+		Colour* dst = &rows[0];
+
+		for (int layer = 0; layer < framebuffer->GetNumLayers(); layer++)
+		{
+			Framebuffer::FORMAT format = framebuffer->GetLayerFormat(layer);
+			size_t rowSize = (size_t)width * Framebuffer::GetPixelSize(format);
+
+			for (int y = job.firstRow; y < job.firstRow + job.numRows; y++)
+			{
+				Framebuffer::DecodePixels(format, framebuffer->GetLayerData(layer) + y*rowSize, dst, width);
+				dst += width;
+			}
+		}
+
+		TileResult result = { job.frame, job.firstRow, job.numRows };
+
+		if (!connection.Send(&result, sizeof(result)) || !connection.Send(&rows[0], rows.size() * sizeof(Colour)))
+			break;
+
+		fprintf(stdout, "\nFrame %d rows %d to %d sent\n", job.frame, job.firstRow, job.firstRow + job.numRows - 1);
+	}
+
+	fprintf(stdout, "Lost the coordinator at %s\n", address);
+	return false;
+}
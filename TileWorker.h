@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Renderer.h"
+#include "Scene.h"
+
+//The worker end of a TileServer. The scene and renderer are set up as the coordinator's
+//are, from the same options, only the camera of each frame comes with the bands
+class TileWorker
+{
+	public:
+		//Connect to the coordinator, trying for up to timeout seconds, and trace the bands it hands
+		//out until it has no more. Returns false if it could not connect, turned the worker away or
+		//went away before the end
+		static bool Run(const char* address, Scene* pScene, Renderer* renderer, double timeout);
+};
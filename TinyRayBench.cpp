@@ -0,0 +1,414 @@
+//Microbenchmarks of the intersection kernels, each primitive type, meshes of
+//increasing size and the whole default scene, traced with fixed ray sets so
+//runs on different commits can be compared. Single threaded on purpose, this
+//measures the cost of a ray rather than the scaling of the renderer
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <chrono>
+
+#if defined(_WIN32)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#include "Scene.h"
+#include "Camera.h"
+#include "Sphere.h"
+#include "Plane.h"
+#include "Box.h"
+#include "Triangle.h"
+#include "TriMesh.h"
+#include "Random.h"
+
+#define M_PI 3.14159265358979323846
+
+struct BenchResult
+{
+	std::string			name;
+	int					rays;
+	double				nsPerRay;
+	double				cyclesPerRay;
+	unsigned long long	hits;			//per pass over the ray set, a checksum that the kernel still finds the same hits
+};
+
+struct BenchOptions
+{
+	int					numRays;
+	double				minTime;		//seconds each trial runs for at least
+	int					trials;			//the fastest trial is reported
+	const char*			filter;			//only run cases whose name contains this, NULL for all
+};
+
+static void PrintUsage()
+{
+	printf("Usage: tinyray-bench [options]\n");
+	printf("  -rays n           rays in each ray set (default 65536)\n");
+	printf("  -time s           minimum seconds per trial (default 0.2)\n");
+	printf("  -trials n         trials per case, the fastest is reported (default 5)\n");
+	printf("  -filter text      only run the cases whose name contains text\n");
+	printf("  -json file        also write the results as JSON\n");
+}
+
+static Vector3 RandomDirection()
+{
+	double z = 1.0 - 2.0 * Random::Uniform();
+	double r = sqrt(z > 1.0 ? 0.0 : 1.0 - z*z);
+	double phi = 2.0 * M_PI * Random::Uniform();
+
+	return Vector3((float)(r*cos(phi)), (float)(r*sin(phi)), (float)z);
+}
+
+//Rays through a pinhole camera looking at the target from one side, neighbouring rays take the same path
+static void MakeCoherentRays(const Vector3& centre, float radius, int count, std::vector<Ray>& rays)
+{
+	Vector3 view = Vector3(-0.3f, -0.4f, -1.0f).Normalise();
+	Vector3 eye = centre - view * (3.0f * radius);
+	Vector3 right = view.CrossProduct(Vector3(0.0f, 1.0f, 0.0f)).Normalise();
+	Vector3 up = right.CrossProduct(view);
+
+	int side = (int)sqrt((double)count);
+	float extent = 1.2f * radius;
+
+	rays.resize(side * side);
+
+	for (int y = 0; y < side; y++)
+	{
+		for (int x = 0; x < side; x++)
+		{
+			float sx = ((x + 0.5f) / side * 2.0f - 1.0f) * extent;
+			float sy = ((y + 0.5f) / side * 2.0f - 1.0f) * extent;
+			Vector3 target = centre + right * sx + up * sy;
+
+			rays[y * side + x].SetRay(eye, (target - eye).Normalise());
+		}
+	}
+}
+
+//Rays from random points around the target towards random points in it, as bounced rays would be
+static void MakeIncoherentRays(const Vector3& centre, float radius, int count, unsigned int seed, std::vector<Ray>& rays)
+{
+	Random::SeedPixel((int)seed, 0x5eed);
+	rays.resize(count);
+
+	for (int i = 0; i < count; i++)
+	{
+		Vector3 origin = centre + RandomDirection() * (3.0f * radius);
+		Vector3 target = centre + RandomDirection() * (1.2f * radius * (float)Random::Uniform());
+
+		rays[i].SetRay(origin, (target - origin).Normalise());
+	}
+}
+
+//The camera rays of the default scene, one per pixel of a square image
+static void MakeCameraRays(Scene* scene, int count, std::vector<Ray>& rays)
+{
+	Camera* cam = scene->GetSceneCamera();
+	int side = (int)sqrt((double)count);
+
+	double width = scene->GetSceneWidth();
+	double height = scene->GetSceneHeight();
+	Vector3 start = cam->GetViewCentre() - (cam->GetRightVector() * (float)width + cam->GetUpVector() * (float)height) * 0.5f;
+
+	rays.resize(side * side);
+
+	for (int y = 0; y < side; y++)
+	{
+		for (int x = 0; x < side; x++)
+		{
+			Vector3 pixel = start + cam->GetUpVector() * (float)((y + 0.5) * height / side)
+				+ cam->GetRightVector() * (float)((x + 0.5) * width / side);
+
+			rays[y * side + x].SetRay(cam->GetPosition(), (pixel - cam->GetPosition()).Normalise());
+		}
+	}
+}
+
+//Random rays from inside the walls of the default scene in every direction
+static void MakeSceneRays(int count, unsigned int seed, std::vector<Ray>& rays)
+{
+	Random::SeedPixel((int)seed, 0x5eed);
+	rays.resize(count);
+
+	for (int i = 0; i < count; i++)
+	{
+		Vector3 origin((float)(Random::Uniform() * 38.0 - 19.0), (float)(Random::Uniform() * 18.0 + 1.0),
+			(float)(Random::Uniform() * 78.0 - 39.0));
+
+		rays[i].SetRay(origin, RandomDirection());
+	}
+}
+
+//A UV sphere of about the given number of triangles
+static TriMesh* MakeSphereMesh(int triangles, float radius)
+{
+	int stacks = (int)sqrt(triangles / 2.0);
+	stacks = stacks > 2 ? stacks : 2;
+	int slices = triangles / (2 * stacks);
+	slices = slices > 3 ? slices : 3;
+
+	std::vector<Vector3> points((stacks + 1) * (slices + 1));
+
+	for (int i = 0; i <= stacks; i++)
+	{
+		double theta = M_PI * i / stacks;
+
+		for (int j = 0; j <= slices; j++)
+		{
+			double phi = 2.0 * M_PI * j / slices;
+			points[i * (slices + 1) + j] = Vector3((float)(radius * sin(theta) * cos(phi)), (float)(radius * cos(theta)),
+				(float)(radius * sin(theta) * sin(phi)));
+		}
+	}
+
+	int count = 2 * stacks * slices;
+	Triangle* tris = new Triangle[count];
+
+	for (int i = 0; i < stacks; i++)
+	{
+		for (int j = 0; j < slices; j++)
+		{
+			Vector3 a = points[i * (slices + 1) + j];
+			Vector3 b = points[i * (slices + 1) + j + 1];
+			Vector3 c = points[(i + 1) * (slices + 1) + j];
+			Vector3 d = points[(i + 1) * (slices + 1) + j + 1];
+
+			//wound to face outwards, the mesh culls back faces
+			Triangle* t = &tris[2 * (i * slices + j)];
+			t[0].SetVertices(a, b, c);
+			t[1].SetVertices(b, d, c);
+
+			for (int k = 0; k < 2; k++)
+			{
+				Vector3 n = (t[k].m_vertices[1].m_position - t[k].m_vertices[0].m_position).CrossProduct(
+					t[k].m_vertices[2].m_position - t[k].m_vertices[0].m_position).Normalise();
+				t[k].SetNormals(n, n, n);
+			}
+		}
+	}
+
+	TriMesh* mesh = new TriMesh();
+	mesh->SetTriangles(tris, count);
+
+	return mesh;
+}
+
+static bool Selected(const BenchOptions& options, const std::string& name)
+{
+	return !options.filter || name.find(options.filter) != std::string::npos;
+}
+
+//Time intersect(ray) over the ray set, repeating passes until a trial has run long enough
+template <typename Intersect>
+static void RunCase(const BenchOptions& options, const std::string& name, std::vector<Ray>& rays,
+	Intersect intersect, std::vector<BenchResult>& results)
+{
+	if (!Selected(options, name) || rays.empty())
+		return;
+
+	BenchResult result;
+	result.name = name;
+	result.rays = (int)rays.size();
+	result.nsPerRay = 1e30;
+	result.cyclesPerRay = 1e30;
+	result.hits = 0;
+
+	//one untimed pass to warm the caches and count the hits
+	for (size_t i = 0; i < rays.size(); i++)
+	{
+		if (intersect(rays[i]))
+			result.hits++;
+	}
+
+	for (int trial = 0; trial < options.trials; trial++)
+	{
+		unsigned long long traced = 0;
+		unsigned long long hits = 0;
+		double seconds = 0.0;
+
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		unsigned long long cycles = __rdtsc();
+
+		do
+		{
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				if (intersect(rays[i]))
+					hits++;
+			}
+
+			traced += rays.size();
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		} while (seconds < options.minTime);
+
+		cycles = __rdtsc() - cycles;
+
+		if (hits != result.hits * (traced / rays.size()))
+			printf("warning: %s found a different number of hits between passes\n", name.c_str());
+
+		double ns = seconds * 1e9 / (double)traced;
+
+		if (ns < result.nsPerRay)
+		{
+			result.nsPerRay = ns;
+			result.cyclesPerRay = (double)cycles / (double)traced;
+		}
+	}
+
+	printf("%-28s %8d rays %10.2f Mrays/s %10.1f ns/ray %10.1f cycles/ray %8llu hits\n", name.c_str(), result.rays,
+		1e3 / result.nsPerRay, result.nsPerRay, result.cyclesPerRay, result.hits);
+	fflush(stdout);
+
+	results.push_back(result);
+}
+
+//Coherent and incoherent ray sets against a primitive bounded by the sphere (centre, radius)
+static void RunPrimitive(const BenchOptions& options, const char* name, Primitive* prim,
+	const Vector3& centre, float radius, std::vector<BenchResult>& results)
+{
+	std::vector<Ray> rays;
+	std::string prefix = name;
+
+	auto intersect = [prim](Ray& ray) { return prim->IntersectByRay(ray).data != NULL; };
+
+	MakeCoherentRays(centre, radius, options.numRays, rays);
+	RunCase(options, prefix + "/coherent", rays, intersect, results);
+
+	MakeIncoherentRays(centre, radius, options.numRays, 1, rays);
+	RunCase(options, prefix + "/incoherent", rays, intersect, results);
+}
+
+static bool WriteJSON(const char* filename, const BenchOptions& options, const std::vector<BenchResult>& results)
+{
+	FILE* file = fopen(filename, "w");
+
+	if (!file)
+		return false;
+
+	fprintf(file, "{\n\t\"benchmark\": \"tinyray-bench\",\n\t\"version\": 1,\n");
+	fprintf(file, "\t\"rays\": %d,\n\t\"min_time\": %g,\n\t\"trials\": %d,\n", options.numRays, options.minTime, options.trials);
+	fprintf(file, "\t\"results\": [\n");
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult& r = results[i];
+
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"rays\": %d, \"rays_per_sec\": %.0f, \"ns_per_ray\": %.3f, \"cycles_per_ray\": %.1f, \"hits\": %llu }%s\n",
+			r.name.c_str(), r.rays, 1e9 / r.nsPerRay, r.nsPerRay, r.cyclesPerRay, r.hits, i + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(file, "\t]\n}\n");
+
+	return fclose(file) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions options;
+	options.numRays = 65536;
+	options.minTime = 0.2;
+	options.trials = 5;
+	options.filter = NULL;
+
+	const char* jsonfile = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-rays") == 0 && i + 1 < argc)
+		{
+			options.numRays = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-time") == 0 && i + 1 < argc)
+		{
+			options.minTime = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-trials") == 0 && i + 1 < argc)
+		{
+			options.trials = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc)
+		{
+			options.filter = argv[++i];
+		}
+		else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+		{
+			jsonfile = argv[++i];
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (options.numRays <= 0 || options.trials <= 0)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	std::vector<BenchResult> results;
+
+	Sphere sphere(0.0, 0.0, 0.0, 1.0);
+	RunPrimitive(options, "sphere", &sphere, Vector3(0.0f, 0.0f, 0.0f), 1.0f, results);
+
+	Plane plane;
+	plane.SetPlane(Vector3(0.0f, 1.0f, 0.0f), 0.0);
+	RunPrimitive(options, "plane", &plane, Vector3(0.0f, 0.0f, 0.0f), 1.0f, results);
+
+	Box box(Vector3(0.0f, 0.0f, 0.0f), 1.2, 1.2, 1.2);
+	RunPrimitive(options, "box", &box, Vector3(0.0f, 0.0f, 0.0f), 1.0f, results);
+
+	Transform rotation;
+	rotation.SetRotation(Vector3(1.0f, 1.0f, 0.0f).Normalise(), 0.6f);
+	Box orientedbox(Vector3(0.0f, 0.0f, 0.0f), 1.2, 1.2, 1.2);
+	orientedbox.SetTransform(rotation);
+	RunPrimitive(options, "box_oriented", &orientedbox, Vector3(0.0f, 0.0f, 0.0f), 1.0f, results);
+
+	Vector3 v0(-1.0f, -0.8f, 0.0f), v1(1.0f, -0.8f, 0.0f), v2(0.0f, 1.0f, 0.0f);
+	Triangle triangle(v0, v1, v2);
+	RunPrimitive(options, "triangle", &triangle, Vector3(0.0f, 0.0f, 0.0f), 1.0f, results);
+
+	int meshsizes[3] = { 1000, 16000, 256000 };
+
+	for (int i = 0; i < 3; i++)
+	{
+		char name[32];
+		sprintf(name, "trimesh_%dk", meshsizes[i] / 1000);
+
+		if (!Selected(options, name))
+			continue;
+
+		TriMesh* mesh = MakeSphereMesh(meshsizes[i], 1.0f);
+		RunPrimitive(options, name, mesh, Vector3(0.0f, 0.0f, 0.0f), 1.0f, results);
+		delete mesh;
+	}
+
+	if (Selected(options, "scene"))
+	{
+		Scene scene;
+		std::vector<Ray> rays;
+
+		auto closest = [&scene](Ray& ray) { return scene.IntersectByRay(ray).data != NULL; };
+		auto shadow = [&scene](Ray& ray) { return scene.IntersectByRay(ray, true, 10.0).data != NULL; };
+
+		MakeCameraRays(&scene, options.numRays, rays);
+		RunCase(options, "scene/coherent", rays, closest, results);
+
+		MakeSceneRays(options.numRays, 2, rays);
+		RunCase(options, "scene/incoherent", rays, closest, results);
+		RunCase(options, "scene/shadow", rays, shadow, results);
+	}
+
+	if (jsonfile && !WriteJSON(jsonfile, options, results))
+	{
+		printf("Error writing %s\n", jsonfile);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <math.h>
+#include "Vector3.h"
+#include "BoundingBox.h"
+
+//An affine 3x4 transform stored as four SSE columns, the last column is the translation
+class Transform
+{
+	private:
+		Vec4		m_columns[4];
+
+	public:
+		Transform()
+		{
+			SetIdentity();
+		}
+
+		inline void SetIdentity()
+		{
+			m_columns[0] = _mm_set_ps(0.0f, 0.0f, 0.0f, 1.0f);
+			m_columns[1] = _mm_set_ps(0.0f, 0.0f, 1.0f, 0.0f);
+			m_columns[2] = _mm_set_ps(0.0f, 1.0f, 0.0f, 0.0f);
+			m_columns[3] = _mm_setzero_ps();
+		}
+
+		//Set the transform from the rows of the 3x4 matrix
+		inline void SetMatrix(const float rows[3][4])
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				m_columns[c] = _mm_set_ps(0.0f, rows[2][c], rows[1][c], rows[0][c]);
+			}
+		}
+
+		inline float GetElement(int row, int column) const
+		{
+			return Vector3(m_columns[column])[row];
+		}
+
+		inline void SetTranslation(float x, float y, float z)
+		{
+			SetIdentity();
+			m_columns[3] = _mm_set_ps(0.0f, z, y, x);
+		}
+
+		inline void SetScale(float x, float y, float z)
+		{
+			SetIdentity();
+			m_columns[0] = _mm_set_ps(0.0f, 0.0f, 0.0f, x);
+			m_columns[1] = _mm_set_ps(0.0f, 0.0f, y, 0.0f);
+			m_columns[2] = _mm_set_ps(0.0f, z, 0.0f, 0.0f);
+		}
+
+		//Rotation of angle radians about a unit axis
+		inline void SetRotation(const Vector3& axis, float angle)
+		{
+			float c = cosf(angle);
+			float s = sinf(angle);
+			float t = 1.0f - c;
+			float x = axis[0], y = axis[1], z = axis[2];
+
+			float rows[3][4] =
+			{
+				{ t*x*x + c,	t*x*y - s*z,	t*x*z + s*y,	0.0f },
+				{ t*x*y + s*z,	t*y*y + c,		t*y*z - s*x,	0.0f },
+				{ t*x*z - s*y,	t*y*z + s*x,	t*z*z + c,		0.0f }
+			};
+
+			SetMatrix(rows);
+		}
+
+		inline Vector3 TransformPoint(const Vector3& p) const
+		{
+			return Vector3(TransformPoint(p.GetVec4()));
+		}
+
+		inline Vector3 TransformVector(const Vector3& v) const
+		{
+			return Vector3(TransformVector(v.GetVec4()));
+		}
+
+		inline Vec4 TransformPoint(const Vec4& p) const
+		{
+			return _mm_add_ps(TransformVector(p), m_columns[3]);
+		}
+
+		inline Vec4 TransformVector(const Vec4& v) const
+		{
+			Vec4 r = _mm_mul_ps(m_columns[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+			r = _mm_add_ps(r, _mm_mul_ps(m_columns[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+			r = _mm_add_ps(r, _mm_mul_ps(m_columns[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+			return r;
+		}
+
+		//Transform a normal by the inverse transpose, call this on the inverse of the
+		//transform that was applied to the points
+		inline Vector3 TransformNormalByInverse(const Vector3& n) const
+		{
+			Vec4 v = n.GetVec4();
+			Vector3 r(Dot3(m_columns[0], v), Dot3(m_columns[1], v), Dot3(m_columns[2], v));
+			return r.Normalise();
+		}
+
+		//Bounds of the transformed corners of a box
+		inline BoundingBox TransformBounds(const BoundingBox& box) const
+		{
+			BoundingBox bounds;
+
+			for (int i = 0; i < 8; i++)
+			{
+				Vector3 corner((i & 1) ? box.m_max[0] : box.m_min[0],
+					(i & 2) ? box.m_max[1] : box.m_min[1],
+					(i & 4) ? box.m_max[2] : box.m_min[2]);
+
+				bounds.Expand(TransformPoint(corner));
+			}
+
+			return bounds;
+		}
+
+		//this * rhs, i.e. rhs is applied first
+		inline Transform operator * (const Transform& rhs) const
+		{
+			Transform result;
+			result.m_columns[0] = TransformVector(rhs.m_columns[0]);
+			result.m_columns[1] = TransformVector(rhs.m_columns[1]);
+			result.m_columns[2] = TransformVector(rhs.m_columns[2]);
+			result.m_columns[3] = TransformPoint(rhs.m_columns[3]);
+			return result;
+		}
+
+		inline float GetDeterminant() const
+		{
+			return Dot3(m_columns[0], Cross3(m_columns[1], m_columns[2]));
+		}
+
+		inline Transform GetInverse() const
+		{
+			Vec4 c0 = m_columns[0];
+			Vec4 c1 = m_columns[1];
+			Vec4 c2 = m_columns[2];
+
+			//the rows of the inverse of the 3x3 part are the cross products of its columns over the determinant
+			Vec4 r0 = Cross3(c1, c2);
+			Vec4 r1 = Cross3(c2, c0);
+			Vec4 r2 = Cross3(c0, c1);
+
+			float det = Dot3(c0, r0);
+			float invdet = fabsf(det) > 1e-12f ? 1.0f / det : 0.0f;
+
+			Vector3 row0 = Vector3(r0) * invdet;
+			Vector3 row1 = Vector3(r1) * invdet;
+			Vector3 row2 = Vector3(r2) * invdet;
+
+			float rows[3][4] =
+			{
+				{ row0[0], row0[1], row0[2], 0.0f },
+				{ row1[0], row1[1], row1[2], 0.0f },
+				{ row2[0], row2[1], row2[2], 0.0f }
+			};
+
+			Transform inverse;
+			inverse.SetMatrix(rows);
+
+			Vec4 t = inverse.TransformVector(m_columns[3]);
+			inverse.m_columns[3] = _mm_sub_ps(_mm_setzero_ps(), t);
+
+			return inverse;
+		}
+};
@@ -1,52 +1,93 @@
 #include <stdlib.h>
 #include "TriMesh.h"
 #include "OBJFileReader.h"
+#include "Profiler.h"
 
-TriMesh::TriMesh()
+TriMesh::TriMesh(Arena* arena)
 {
 	m_triangles = NULL;
+	m_numtriangles = 0;
+	m_ownsTriangles = false;
+	m_arena = arena;
 	m_primtype = PRIMTYPE::PRIMTYPE_TRIMESH;
 }
 
-TriMesh::TriMesh(const char* filename) : TriMesh()
+TriMesh::TriMesh(const char* filename, Arena* arena) : TriMesh(arena)
 {
 	LoadTriMeshFromOBJFile(filename);
 }
 
 TriMesh::~TriMesh()
 {
-	delete [] m_triangles;
+	if (m_ownsTriangles)
+		delete [] m_triangles;
 }
 
 void TriMesh::LoadTriMeshFromOBJFile(const char* filename)
 {
-  	m_numtriangles = importOBJMesh(filename, &m_triangles);
+	{
+		PROFILE_SCOPE("ParseOBJ");
+		if (m_ownsTriangles)
+			delete [] m_triangles;
+
+		m_numtriangles = importOBJMesh(filename, &m_triangles, m_arena);
+		m_ownsTriangles = m_arena == NULL;
+	}
+
+	BuildBVH();
 }
 
-RayHitResult TriMesh::IntersectByRay(Ray& ray)
+void TriMesh::SetTriangles(Triangle* triangles, int count)
 {
-	RayHitResult result = Ray::s_defaultHitResult;
+	if (m_ownsTriangles)
+		delete [] m_triangles;
+
+	m_triangles = triangles;
+	m_numtriangles = count;
+	m_ownsTriangles = true;
+
+	BuildBVH();
+}
+
+void TriMesh::BuildBVH()
+{
+	std::vector<PrimRef> refs(m_numtriangles);
+	std::vector<BoundingBox> bounds(m_numtriangles);
+
+	m_primitives.Clear();
 
 	for (int i = 0; i < m_numtriangles; i++)
 	{
-		Vector3 v1 = m_triangles[i].m_vertices[1].m_position - m_triangles[i].m_vertices[0].m_position;
-		Vector3 v2 = m_triangles[i].m_vertices[2].m_position - m_triangles[i].m_vertices[0].m_position;
-		Vector3 normal = v1.CrossProduct(v2);
-		
-		if (normal.DotProduct(ray.GetRay()) < 0.0)
-		{
-
-			Primitive* prim = static_cast<Primitive*>(&m_triangles[i]);
-
-			RayHitResult tempresult = prim->IntersectByRay(ray);
-
-			if (tempresult.t < result.t)
-			{
-				tempresult.data = this;
-				result = tempresult;
-			}
-		}
+		refs[i].type = PRIMTYPE_Triangle;
+		refs[i].index = m_primitives.AddTriangle(&m_triangles[i], this, true);
+		bounds[i] = m_primitives.GetBounds(refs[i]);
 	}
 
-	return result;
+	m_bvh.Build(refs, bounds);
+}
+
+bool TriMesh::IntersectMesh(Ray& ray, PrimHit& hit) const
+{
+	PrimitiveLeafIntersector intersector = { &m_primitives, &ray, &hit, false, false };
+	m_bvh.Traverse(ray, hit.t, intersector);
+
+	return intersector.found;
 }
+
+void TriMesh::ResolveHit(Ray& ray, const PrimHit& hit, RayHitResult& result) const
+{
+	m_primitives.ResolveHit(ray, hit, result);
+}
+
+RayHitResult TriMesh::IntersectByRay(Ray& ray)
+{
+	RayHitResult result = Ray::s_defaultHitResult;
+
+	PrimHit hit;
+	hit.t = FARFAR_AWAY;
+
+	if (IntersectMesh(ray, hit))
+		ResolveHit(ray, hit, result);
+
+	return result;
+}
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #include "Primitive.h"
 #include "Triangle.h"
+#include "PrimitiveArrays.h"
+#include "BVH.h"
+#include "Arena.h"
 
 
 class TriMesh :	public Primitive
@@ -9,14 +12,45 @@ class TriMesh :	public Primitive
 	private: 
 		Triangle*					m_triangles;
 		int							m_numtriangles;
+		bool						m_ownsTriangles;	//false when the triangles are in the arena
+		Arena*						m_arena;			//loaded triangles go here when set
+
+		PrimitiveArrays				m_primitives;		//the triangles in intersection friendly form
+		BVH							m_bvh;				//built once the mesh is loaded, shared by every instance of it
 
 	public:
-		TriMesh();
-		TriMesh(const char* filename);
+		//A mesh given an arena places the triangles it loads there
+		TriMesh(Arena* arena = NULL);
+		TriMesh(const char* filename, Arena* arena = NULL);
 		~TriMesh();
 
 		void LoadTriMeshFromOBJFile(const char* filename);
 
+		//Take over triangles allocated with new[] and build the BVH over them
+		void SetTriangles(Triangle* triangles, int count);
+
+		inline Triangle* GetTriangles()
+		{
+			return m_triangles;
+		}
+
+		inline int GetNumTriangles() const
+		{
+			return m_numtriangles;
+		}
+
+		//Build the mesh BVH, needed again if the triangles are modified
+		void BuildBVH();
+
+		inline const BoundingBox& GetBounds() const
+		{
+			return m_bvh.GetBounds();
+		}
+
+		//Intersect the mesh in its own space, hit.ref.index is set to the triangle hit
+		bool IntersectMesh(Ray& ray, PrimHit& hit) const;
+		void ResolveHit(Ray& ray, const PrimHit& hit, RayHitResult& result) const;
+
 		RayHitResult IntersectByRay(Ray& ray);
 };
 
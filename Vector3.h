@@ -26,6 +26,8 @@ public:
 
 	Vector3(float x, float y, float z);
 
+	explicit Vector3(const Vec4& v) : mVector(v) { ; }
+
 	~Vector3() { ; }
 
 	float operator [] (const int i) const;
@@ -54,4 +56,26 @@ public:
 	{
 		mVector = _mm_set_ps(0.0f, z, y, x);
 	}
+
+	inline const Vec4& GetVec4() const
+	{
+		return mVector;
+	}
 };
+
+//Helpers for the intersection kernels that work on raw Vec4 lanes, the w lane is ignored
+inline float Dot3(const Vec4& a, const Vec4& b)
+{
+	Vec4 m = _mm_mul_ps(a, b);
+	Vec4 s = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+	s = _mm_add_ss(s, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2)));
+	return _mm_cvtss_f32(s);
+}
+
+inline Vec4 Cross3(const Vec4& a, const Vec4& b)
+{
+	Vec4 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	Vec4 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	Vec4 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}